@@ -708,3 +708,31 @@ void S7_SetDTLAt(byte Buffer[], int Pos, uint16_t year, uint16_t month, uint16_t
   S7_SetByteAt(Buffer, Pos + 7, second);   // [0, 59]
   S7_SetUDIntAt(Buffer, Pos + 8, nanosec); // [0, 999999999]
 }
+
+//****************************************************************************
+// Nanoseconds since 1970-01-01 of a DATE_AND_TIME / DTL, the PLC time read as UTC.
+// Same time base as the PLC clock estimator (Clock_PlcToHost / Clock_HostToPlc)
+
+static int64_t S7_DaysFromCivil(int year, unsigned month, unsigned day)
+{
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(year - era * 400);                       // [0, 399]
+  const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1; // [0, 365]
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                         // [0, 146096]
+  return static_cast<int64_t>(era) * 146097 + static_cast<int64_t>(doe) - 719468;   // 1970-01-01 = 0
+}
+
+int64_t S7_DATE_AND_TIMEToNs(DATE_AND_TIME Value)
+{
+  int64_t secs = S7_DaysFromCivil(Value.year, Value.month, Value.day) * 86400 +
+                 Value.hour * 3600 + Value.minute * 60 + Value.second;
+  return secs * 1000000000LL + static_cast<int64_t>(Value.msec) * 1000000;
+}
+
+int64_t S7_DTLToNs(DTL Value)
+{
+  int64_t secs = S7_DaysFromCivil(Value.year, Value.month, Value.day) * 86400 +
+                 Value.hour * 3600 + Value.minute * 60 + Value.second;
+  return secs * 1000000000LL + Value.nanosec;
+}
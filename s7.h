@@ -183,4 +183,8 @@ int64_t S7_GetLIntAt(byte Buffer[], int Pos); // Get 64 bit signed value (S7 LIn
 
    void S7_SetDTLAt(byte Buffer[], int Pos, uint16_t year, uint16_t month, uint16_t day, uint16_t hour, uint16_t minute, uint16_t second, uint32_t nanosec); // Set struct of DTL (S7 DTL)
 
+   int64_t S7_DATE_AND_TIMEToNs(DATE_AND_TIME Value); // ns since 1970-01-01 of a DATE_AND_TIME read as UTC (PLC clock estimator time base)
+
+   int64_t S7_DTLToNs(DTL Value); // ns since 1970-01-01 of a DTL read as UTC (PLC clock estimator time base)
+
 #endif // S7_H
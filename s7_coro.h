@@ -0,0 +1,342 @@
+//*************************************************************************************
+// S7 Coroutines : C++20 awaitable versions of the Snap7 client functions
+//
+// Built on the Snap7 async machinery (Cli_As* + completion callback), so a
+// suspended coroutine costs only its frame : no thread is blocked waiting.
+//
+//   S7Task Poll(S7Object Client, S7Executor *Loop)
+//   {
+//       byte Buffer[64];
+//       int Result = co_await S7_CoReadArea(Client, S7AreaDB, 1, 0, 64, S7WLByte, Buffer, Loop);
+//       ...
+//   }
+//
+// Notes
+//   - One client serves one awaiting coroutine at a time : a Snap7 client runs
+//     one job at a time and awaiting a second operation on the same client
+//     while the first is pending returns errCliJobPending. Use one client per
+//     concurrent logical task (or per PLC) and as many coroutines as you like
+//     across them.
+//   - While suspended, an awaitable borrows the client's completion callback
+//     (Cli_SetAsCallback) : the previous callback is restored before the
+//     coroutine resumes. Don't start other async jobs on that client from
+//     outside the coroutine meanwhile.
+//   - Without executor the coroutine resumes on the client's worker thread;
+//     with an executor it's posted there (e.g. S7LoopExecutor::Run()).
+//   - Buffers (and items of MultiVars) must outlive the co_await, which is
+//     natural if they live in the coroutine frame.
+//
+// The header is empty unless compiled as C++20 (the library itself is C++11).
+//
+// MIT License
+//*************************************************************************************
+
+#ifndef S7_CORO_H
+#define S7_CORO_H
+
+#if (__cplusplus >= 202002L) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include "snap7_libmain.h"
+
+//****************************************************************************
+// Executors : where a coroutine is resumed when its job completes
+//****************************************************************************
+class S7Executor
+{
+public:
+    virtual ~S7Executor() {}
+    // Called from the Snap7 worker thread, must not block
+    virtual void Post(std::coroutine_handle<> Handle) = 0;
+};
+
+// Queue of ready coroutines, drained by the owner's loop (Run or Poll)
+class S7LoopExecutor : public S7Executor
+{
+private:
+    std::mutex Mutex;
+    std::condition_variable Ready;
+    std::deque<std::coroutine_handle<> > Queue;
+    bool Stopped = false;
+public:
+    void Post(std::coroutine_handle<> Handle) override
+    {
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Queue.push_back(Handle);
+        }
+        Ready.notify_one();
+    }
+
+    // Resumes the coroutines ready now, returns how many
+    size_t Poll()
+    {
+        std::deque<std::coroutine_handle<> > Batch;
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Batch.swap(Queue);
+        }
+        for (std::coroutine_handle<> Handle : Batch)
+            Handle.resume();
+        return Batch.size();
+    }
+
+    // Resumes coroutines until Stop()
+    void Run()
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> Lock(Mutex);
+                Ready.wait(Lock, [this] { return Stopped || !Queue.empty(); });
+                if (Stopped)
+                    return;
+            }
+            Poll();
+        }
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Stopped = true;
+        }
+        Ready.notify_all();
+    }
+};
+
+//****************************************************************************
+// Fire-and-forget coroutine type : starts immediately, frees its frame at the end
+//****************************************************************************
+struct S7Task
+{
+    struct promise_type
+    {
+        S7Task get_return_object() { return S7Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+//****************************************************************************
+// Awaitable base : starts the async job in await_suspend and resumes the
+// coroutine from the completion callback. co_await returns the job result.
+//****************************************************************************
+class S7Awaitable
+{
+private:
+    S7Object Client;
+    S7Executor *Executor;
+    std::coroutine_handle<> Handle;
+    int Result = 0;
+    // User callback, restored when the job completes
+    pfn_CliCompletion PrevCompletion = nullptr;
+    void *PrevUsrPtr = nullptr;
+
+    void RestoreCallback()
+    {
+        Cli_SetAsCallback(Client, PrevCompletion, PrevUsrPtr);
+    }
+
+    static void S7API Completion(void *usrPtr, int /* opCode */, int opResult)
+    {
+        S7Awaitable *Self = static_cast<S7Awaitable *>(usrPtr);
+        S7Executor *Target = Self->Executor;
+        std::coroutine_handle<> Resume = Self->Handle;
+        Self->Result = opResult;
+        Self->RestoreCallback();
+        // From here the awaiter may be gone
+        if (Target != nullptr)
+            Target->Post(Resume);
+        else
+            Resume.resume();
+    }
+protected:
+    virtual int Start(S7Object Client) = 0;
+public:
+    S7Awaitable(S7Object Client, S7Executor *Executor) : Client(Client), Executor(Executor) {}
+    virtual ~S7Awaitable() {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> Caller)
+    {
+        int StartResult;
+        Handle = Caller;
+        Cli_GetAsCallback(Client, PrevCompletion, PrevUsrPtr);
+        Cli_SetAsCallback(Client, Completion, this);
+        StartResult = Start(Client);
+        if (StartResult != 0)
+        {
+            // Not started : no completion will come, resume now with the error
+            RestoreCallback();
+            Result = StartResult;
+            return false;
+        }
+        return true; // don't touch *this here, the job may be already complete
+    }
+
+    int await_resume() const noexcept { return Result; }
+};
+
+//****************************************************************************
+// Data I/O
+//****************************************************************************
+class S7ReadAreaAwaitable : public S7Awaitable
+{
+private:
+    int Area, DBNumber, Start_, Amount, WordLen;
+    void *pUsrData;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsReadArea(Client, Area, DBNumber, Start_, Amount, WordLen, pUsrData);
+    }
+public:
+    S7ReadAreaAwaitable(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), Area(Area), DBNumber(DBNumber), Start_(Start), Amount(Amount), WordLen(WordLen), pUsrData(pUsrData) {}
+};
+
+class S7WriteAreaAwaitable : public S7Awaitable
+{
+private:
+    int Area, DBNumber, Start_, Amount, WordLen;
+    void *pUsrData;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsWriteArea(Client, Area, DBNumber, Start_, Amount, WordLen, pUsrData);
+    }
+public:
+    S7WriteAreaAwaitable(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), Area(Area), DBNumber(DBNumber), Start_(Start), Amount(Amount), WordLen(WordLen), pUsrData(pUsrData) {}
+};
+
+class S7ReadMultiVarsAwaitable : public S7Awaitable
+{
+private:
+    PS7DataItem Item;
+    int ItemsCount;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsReadMultiVars(Client, Item, ItemsCount);
+    }
+public:
+    S7ReadMultiVarsAwaitable(S7Object Client, PS7DataItem Item, int ItemsCount, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), Item(Item), ItemsCount(ItemsCount) {}
+};
+
+class S7WriteMultiVarsAwaitable : public S7Awaitable
+{
+private:
+    PS7DataItem Item;
+    int ItemsCount;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsWriteMultiVars(Client, Item, ItemsCount);
+    }
+public:
+    S7WriteMultiVarsAwaitable(S7Object Client, PS7DataItem Item, int ItemsCount, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), Item(Item), ItemsCount(ItemsCount) {}
+};
+
+class S7DBGetAwaitable : public S7Awaitable
+{
+private:
+    int DBNumber;
+    void *pUsrData;
+    int *Size;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsDBGet(Client, DBNumber, pUsrData, *Size);
+    }
+public:
+    S7DBGetAwaitable(S7Object Client, int DBNumber, void *pUsrData, int &Size, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), DBNumber(DBNumber), pUsrData(pUsrData), Size(&Size) {}
+};
+
+//****************************************************************************
+// System info
+//****************************************************************************
+class S7ReadSZLAwaitable : public S7Awaitable
+{
+private:
+    int ID, Index;
+    TS7SZL *pUsrData;
+    int *Size;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsReadSZL(Client, ID, Index, pUsrData, *Size);
+    }
+public:
+    S7ReadSZLAwaitable(S7Object Client, int ID, int Index, TS7SZL *pUsrData, int &Size, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), ID(ID), Index(Index), pUsrData(pUsrData), Size(&Size) {}
+};
+
+class S7ReadSZLListAwaitable : public S7Awaitable
+{
+private:
+    TS7SZLList *pUsrData;
+    int *ItemsCount;
+protected:
+    int Start(S7Object Client) override
+    {
+        return Cli_AsReadSZLList(Client, pUsrData, *ItemsCount);
+    }
+public:
+    S7ReadSZLListAwaitable(S7Object Client, TS7SZLList *pUsrData, int &ItemsCount, S7Executor *Executor)
+        : S7Awaitable(Client, Executor), pUsrData(pUsrData), ItemsCount(&ItemsCount) {}
+};
+
+//****************************************************************************
+// Factory functions : int Result = co_await S7_CoXxx(...);
+//****************************************************************************
+inline S7ReadAreaAwaitable S7_CoReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData, S7Executor *Executor = nullptr)
+{
+    return S7ReadAreaAwaitable(Client, Area, DBNumber, Start, Amount, WordLen, pUsrData, Executor);
+}
+
+inline S7WriteAreaAwaitable S7_CoWriteArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData, S7Executor *Executor = nullptr)
+{
+    return S7WriteAreaAwaitable(Client, Area, DBNumber, Start, Amount, WordLen, pUsrData, Executor);
+}
+
+inline S7ReadMultiVarsAwaitable S7_CoReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount, S7Executor *Executor = nullptr)
+{
+    return S7ReadMultiVarsAwaitable(Client, Item, ItemsCount, Executor);
+}
+
+inline S7WriteMultiVarsAwaitable S7_CoWriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount, S7Executor *Executor = nullptr)
+{
+    return S7WriteMultiVarsAwaitable(Client, Item, ItemsCount, Executor);
+}
+
+inline S7DBGetAwaitable S7_CoDBGet(S7Object Client, int DBNumber, void *pUsrData, int &Size, S7Executor *Executor = nullptr)
+{
+    return S7DBGetAwaitable(Client, DBNumber, pUsrData, Size, Executor);
+}
+
+inline S7ReadSZLAwaitable S7_CoReadSZL(S7Object Client, int ID, int Index, TS7SZL *pUsrData, int &Size, S7Executor *Executor = nullptr)
+{
+    return S7ReadSZLAwaitable(Client, ID, Index, pUsrData, Size, Executor);
+}
+
+inline S7ReadSZLListAwaitable S7_CoReadSZLList(S7Object Client, TS7SZLList *pUsrData, int &ItemsCount, S7Executor *Executor = nullptr)
+{
+    return S7ReadSZLListAwaitable(Client, pUsrData, ItemsCount, Executor);
+}
+
+#endif // C++20 coroutines
+
+#endif // S7_CORO_H
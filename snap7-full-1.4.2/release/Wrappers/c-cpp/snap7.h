@@ -189,7 +189,7 @@ const longword errIsoPduOverflow    	= 0x00080000; // The sum of fragments data
 const longword errIsoSendPacket         = 0x00090000; // An error occurred during send
 const longword errIsoRecvPacket         = 0x000A0000; // An error occurred during recv
 const longword errIsoInvalidParams    	= 0x000B0000; // Invalid TSAP params
-const longword errIsoResvd_1            = 0x000C0000; // Unassigned
+const longword errIsoNoSlot             = 0x000C0000; // All the demux slots in use
 const longword errIsoResvd_2            = 0x000D0000; // Unassigned
 const longword errIsoResvd_3            = 0x000E0000; // Unassigned
 const longword errIsoResvd_4            = 0x000F0000; // Unassigned
@@ -221,6 +221,63 @@ const int p_i32_BSendTimeout    = 12;
 const int p_i32_BRecvTimeout    = 13;
 const int p_u32_RecoveryTime    = 14;
 const int p_u32_KeepAliveTime   = 15;
+const int p_i32_SocketBackend   = 16;
+const int p_i32_JobTimeout      = 17; // ms, 0 = no job deadline
+const int p_i32_HedgePercentile = 18; // 0 = no hedged reads
+const int p_i32_HedgeDelay      = 19; // ms, min hedge threshold
+const int p_i32_PoolSize        = 20; // Max sessions of a client pool
+const int p_i32_PoolReserve     = 21; // PLC connections left to HMI/PG
+const int p_i32_ReconnectMode   = 22;
+const int p_i32_ReconnectMin    = 23; // ms, first retry delay
+const int p_i32_ReconnectMax    = 24; // ms, max retry delay
+const int p_i32_ShareSession    = 25; // 1 : share one connection with the clients to the same PLC
+const int p_i32_AdaptTarget     = 26; // Scheduler : target link load (%), 0 = fixed rates
+const int p_i32_AdaptMin        = 27; // Scheduler : min intervals (% of the nominal ones)
+const int p_i32_AdaptMax        = 28; // Scheduler : max intervals (% of the nominal ones)
+const int p_i32_AdaptCycle      = 29; // Scheduler : tolerated OB1 cycle time rise (%), 0 = not read
+const int p_i32_RateLimitPDU    = 30; // Requests/s to the PLC, 0 = no limit
+const int p_i32_RateLimitBytes  = 31; // Bytes/s to the PLC, 0 = no limit
+const int p_i32_RateLimitMode   = 32;
+const int p_i32_JobPriority     = 33; // Lane of the jobs on a shared session
+const int p_i32_WriteWindow     = 34; // ms, writes held to be merged, 0 = no coalescing
+const int p_i32_WriteMaxItems   = 35; // Writes that close the window before its end
+const int p_i32_RecvStamps      = 36; // Kernel receive stamps (Cli_GetJobStamps), set before connecting
+const int p_i32_PipeDepth       = 37; // Requests in flight (1..4), asked to the CPU at the next connection
+
+// Background reconnection (p_i32_ReconnectMode)
+const int rmNone                = 0; // The application reconnects
+const int rmFailFast            = 1; // Jobs fail with errCliLinkDown while reconnecting
+const int rmQueue               = 2; // Jobs wait for the reconnection
+
+// Job priority (p_i32_JobPriority) : high priority jobs go ahead of the normal
+// ones on a shared session, interrupting them between two PDUs
+const int jpNormal              = 0;
+const int jpHigh                = 1;
+
+// Rate limit (p_i32_RateLimitMode)
+const int rlBlock               = 0; // Requests wait for their tokens (up to the job deadline)
+const int rlFailFast            = 1; // Requests fail with errCliThrottled
+
+// CPU families (Cli_GetCapabilities), same values as S7_PLC_xxx of s7.h
+const int plcUnknown            = -1;
+const int plc300_400            = 0;
+const int plc1200_1500          = 1;
+const int plcLogo_200           = 2;
+const int plcSinamics           = 3;
+
+// Response demultiplexer events (Cli_SetDemuxCallback)
+const int deParked              = 1; // Answer received while waiting for another one
+const int deLate                = 2; // Answer of an exchange given up, dropped
+const int deStray               = 3; // Frame of no exchange, dropped
+
+// Link states
+const int lsDisconnected        = 0;
+const int lsConnected           = 1;
+const int lsReconnecting        = 2;
+
+// Socket backends (p_i32_SocketBackend)
+const int sbClassic             = 0; // select() + recv()
+const int sbIoUring             = 1; // io_uring (Linux), falls back to sbClassic
 
 // Client/Partner Job status 
 const int JobComplete           = 0;
@@ -269,6 +326,11 @@ const longword errCliFunctionRefused        = 0x02300000;
 const longword errCliDestroying             = 0x02400000;
 const longword errCliInvalidParamNumber     = 0x02500000;
 const longword errCliCannotChangeParam      = 0x02600000;
+const longword errCliJobCanceled            = 0x02700000;
+const longword errCliLinkDown               = 0x02800000;
+const longword errCliThrottled              = 0x02900000;
+const longword errCliClockNotSynced         = 0x02A00000;
+const longword errCliBackupFile             = 0x02B00000;
 
 const int MaxVars     = 20; // Max vars that can be transferred with MultiRead/MultiWrite
 
@@ -331,6 +393,24 @@ typedef struct{
    void  *pdata;
 } TS7DataItem, *PS7DataItem;
 
+// Bit write batch : one tuple per bit, Result is filled per bit
+typedef struct{
+   int   Area;
+   int   DBNumber;
+   int   Byte;
+   int   Bit;
+   int   Value;
+   int   Result;
+} TS7BitItem, *PS7BitItem;
+
+// Whole DB read (Cli_DBGetMulti) : Size is the room in input, the bytes read in output
+typedef struct{
+   int   DBNumber;
+   int   Result;
+   int   Size;
+   void  *pdata;
+} TS7DBItem, *PS7DBItem;
+
 //typedef int TS7ResultItems[MaxVars];
 //typedef TS7ResultItems *PS7ResultItems;
 
@@ -365,6 +445,34 @@ typedef struct {
    char Header[9];    // Header
 } TS7BlockInfo, *PS7BlockInfo ;
 
+// Block infos of many blocks (Cli_GetAgBlockInfoMulti) : BlkType and BlkNumber
+// in input, Result and Info in output
+typedef struct{
+   int   BlkType;   // Block_OB, Block_DB ...
+   int   BlkNumber;
+   int   Result;
+   TS7BlockInfo Info;
+} TS7BlockInfoItem, *PS7BlockInfoItem;
+
+// Online/offline comparison (Cli_CompareBlocks) : pBlock and Size in input
+// (an offline block image as returned by Cli_FullUpload), the rest in output
+typedef struct{
+   void  *pBlock;
+   int   Size;
+   int   BlkType;   // Block_OB, Block_DB ... taken from the image
+   int   BlkNumber;
+   int   Result;    // Image not valid or online block info failed
+   int   Diff;      // cdXXX mask, 0 : the online block is the same
+   TS7BlockInfo Offline;
+   TS7BlockInfo Online;
+} TS7BlockCompare, *PS7BlockCompare;
+
+// Block differences (TS7BlockCompare.Diff)
+const int cdCheckSum = 0x01;
+const int cdLength   = 0x02; // MC7 size
+const int cdIntfDate = 0x04; // Interface time stamp
+const int cdMissing  = 0x08; // The block is not in the PLC
+
 typedef word TS7BlocksOfType[0x2000];
 typedef TS7BlocksOfType *PS7BlocksOfType;
 
@@ -420,8 +528,142 @@ typedef struct {
    word  anl_sch;
 } TS7Protection, *PS7Protection;
 
+// Hedged reads counters
+typedef struct {
+    longword Reads;     // Reads performed with hedging enabled
+    longword Hedged;    // Reads repeated on the second connection
+    longword Won;       // Reads answered first by the second connection
+    longword Threshold; // Current hedge threshold (ms)
+} TS7HedgeStats, *PS7HedgeStats;
+
+// Rate limit counters (shared by the clients of a PLC)
+typedef struct {
+    longword PDUs;          // Requests sent
+    longword Bytes;         // Bytes exchanged (requests + answers)
+    longword Throttled;     // Requests delayed
+    longword Rejected;      // Requests refused (rlFailFast)
+    longword ThrottledTime; // Total delay (ms)
+} TS7RateStats, *PS7RateStats;
+
+// Negotiated PDU, CPU family and limits advised for it
+typedef struct {
+    int Family;         // plcXXX
+    int PDURequested;   // PDU size asked
+    int PDUGranted;     // PDU size granted
+    int MaxAmqCaller;   // Parallel jobs granted (calling side)
+    int MaxAmqCallee;   // Parallel jobs granted (called side)
+    int ParallelJobs;   // Parallel jobs advised
+    int MaxConnections; // Connections advised
+} TS7Capabilities, *PS7Capabilities;
+
+// Response demultiplexer counters
+typedef struct {
+    longword Matched; // Answers delivered to their exchange
+    longword Parked;  // Answers received while waiting for another one
+    longword Late;    // Answers of exchanges given up, dropped
+    longword Stray;   // Frames of no exchange, dropped
+} TS7DemuxStats, *PS7DemuxStats;
+
+// Operation codes (completion callback, Cli_GetStats)
+const int s7opNone              = 0;
+const int s7opReadArea          = 1;
+const int s7opWriteArea         = 2;
+const int s7opReadMultiVars     = 3;
+const int s7opWriteMultiVars    = 4;
+const int s7opDBGet             = 5;
+const int s7opUpload            = 6;
+const int s7opDownload          = 7;
+const int s7opDelete            = 8;
+const int s7opListBlocks        = 9;
+const int s7opAgBlockInfo       = 10;
+const int s7opListBlocksOfType  = 11;
+const int s7opReadSzlList       = 12;
+const int s7opReadSZL           = 13;
+const int s7opGetDateTime       = 14;
+const int s7opSetDateTime       = 15;
+const int s7opGetOrderCode      = 16;
+const int s7opGetCpuInfo        = 17;
+const int s7opGetCpInfo         = 18;
+const int s7opGetPlcStatus      = 19;
+const int s7opPlcHotStart       = 20;
+const int s7opPlcColdStart      = 21;
+const int s7opCopyRamToRom      = 22;
+const int s7opCompress          = 23;
+const int s7opPlcStop           = 24;
+const int s7opGetProtection     = 25;
+const int s7opSetPassword       = 26;
+const int s7opClearPassword     = 27;
+const int s7opDBFill            = 28;
+const int s7opDBGetMulti        = 29;
+const int s7opAgBlockInfoMulti  = 30;
+
+// Client statistics (Cli_GetStats), the execution times are within 1/8
+const int MaxStatOps            = 31; // Ops[] is indexed by the operation code (s7opXXX)
+const int HistBuckets           = 240;
+
+typedef struct {
+    longword Count;  // Jobs performed
+    longword Errors; // Jobs failed
+    longword MeanUs; // Execution times (us)
+    longword MinUs;
+    longword P50Us;
+    longword P90Us;
+    longword P99Us;
+    longword MaxUs;
+} TS7OpStats;
+
+typedef struct {
+    longword Jobs;
+    longword PDUsSent;
+    longword PDUsRecv;
+    longword BytesSent;
+    longword BytesRecv;
+    longword Slices;     // PDUs exchanged by the jobs
+    longword Retries;    // Requests repeated (PDU negotiation, hedged reads, reconnections)
+    longword Mismatches; // Frames out of sequence (parked, late or stray)
+    longword Timeouts;   // Jobs expired or failed on a receive timeout
+    TS7OpStats Ops[MaxStatOps];
+} TS7ClientStats, *PS7ClientStats;
+
+// Raw histogram of an operation (Cli_GetHistogram)
+typedef struct {
+    longword Low[HistBuckets];    // Lower bound of the bucket (us)
+    longword Counts[HistBuckets];
+} TS7Histogram, *PS7Histogram;
+
+// Wall clock stamps of the last job (Cli_GetJobStamps), ns since 1970-01-01 UTC
+typedef struct {
+    uint64_t Sent;      // First request sent
+    uint64_t Received;  // Last answer received
+    int Kernel;         // Received is the kernel arrival time (else taken after the read)
+    int PDUs;           // Exchanges of the job
+} TS7JobStamps, *PS7JobStamps;
+
+// Memory taken by a client (Cli_GetMemory) or by the sessions of a server (Srv_GetMemory), bytes
+typedef struct {
+    int Sessions;         // Connections
+    longword Fixed;       // Objects, whatever the traffic
+    longword Buffers;     // Working buffers held now (blocks and SZL jobs borrow them)
+    longword Pooled;      // Free buffers kept by the pool (shared by the process)
+    longword PerSession;  // (Fixed+Buffers)/Sessions, or the cost of a new session
+} TS7MemoryInfo, *PS7MemoryInfo;
+
 // Client completion callback
 typedef void (S7API *pfn_CliCompletion) (void *usrPtr, int opCode, int opResult);
+// Client link state callback
+typedef void (S7API *pfn_CliLinkState) (void *usrPtr, int State, int Error);
+// Response demultiplexer log hook (at most 10 calls/s, Suppressed = events skipped)
+typedef void (S7API *pfn_DemuxLog) (void *usrPtr, int Event, int Sequence, int PDUType, int Suppressed);
+
+// Diagnostic buffer entry (Cli_DiagTail)
+typedef struct{
+   word EventID;    // Host order
+   byte Info[10];   // Event dependent info (priority class, OB number ...)
+   byte Time[8];    // DATE_AND_TIME (BCD) as sent by the CPU
+} TS7DiagEntry, *PS7DiagEntry;
+
+// Diagnostic event callback, called once per new entry, oldest first
+typedef void (S7API *pfn_CliDiagEvent) (void *usrPtr, PS7DiagEntry Entry);
 //------------------------------------------------------------------------------
 //  Import prototypes
 //------------------------------------------------------------------------------
@@ -435,11 +677,13 @@ int S7API Cli_Disconnect(S7Object Client);
 int S7API Cli_GetParam(S7Object Client, int ParamNumber, void *pValue);
 int S7API Cli_SetParam(S7Object Client, int ParamNumber, void *pValue);
 int S7API Cli_SetAsCallback(S7Object Client, pfn_CliCompletion pCompletion, void *usrPtr);
+int S7API Cli_GetAsCallback(S7Object Client, pfn_CliCompletion *pCompletion, void **usrPtr);
 // Data I/O main functions
 int S7API Cli_ReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 int S7API Cli_WriteArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 int S7API Cli_ReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
 int S7API Cli_WriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
+int S7API Cli_WriteBits(S7Object Client, PS7BitItem Item, int ItemsCount);
 // Data I/O Lean functions
 int S7API Cli_DBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 int S7API Cli_DBWrite(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
@@ -456,6 +700,8 @@ int S7API Cli_CTWrite(S7Object Client, int Start, int Amount, void *pUsrData);
 // Directory functions
 int S7API Cli_ListBlocks(S7Object Client, TS7BlocksList *pUsrData);
 int S7API Cli_GetAgBlockInfo(S7Object Client, int BlockType, int BlockNum, TS7BlockInfo *pUsrData);
+int S7API Cli_GetAgBlockInfoMulti(S7Object Client, TS7BlockInfoItem *Items, int ItemsCount);
+int S7API Cli_CompareBlocks(S7Object Client, TS7BlockCompare *Items, int ItemsCount, int *Mismatches);
 int S7API Cli_GetPgBlockInfo(S7Object Client, void *pBlock, TS7BlockInfo *pUsrData, int Size);
 int S7API Cli_ListBlocksOfType(S7Object Client, int BlockType, TS7BlocksOfType *pUsrData, int *ItemsCount);
 // Blocks functions
@@ -465,6 +711,7 @@ int S7API Cli_Download(S7Object Client, int BlockNum, void *pUsrData, int Size);
 int S7API Cli_Delete(S7Object Client, int BlockType, int BlockNum);
 int S7API Cli_DBGet(S7Object Client, int DBNumber, void *pUsrData, int *Size);
 int S7API Cli_DBFill(S7Object Client, int DBNumber, int FillChar);
+int S7API Cli_DBGetMulti(S7Object Client, TS7DBItem *Items, int ItemsCount);
 // Date/Time functions
 int S7API Cli_GetPlcDateTime(S7Object Client, tm *DateTime);
 int S7API Cli_SetPlcDateTime(S7Object Client, tm *DateTime);
@@ -500,6 +747,8 @@ int S7API Cli_GetConnected(S7Object Client, int *Connected);
 //------------------------------------------------------------------------------
 int S7API Cli_AsReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 int S7API Cli_AsWriteArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+int S7API Cli_AsReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
+int S7API Cli_AsWriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
 int S7API Cli_AsDBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 int S7API Cli_AsDBWrite(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 int S7API Cli_AsMBRead(S7Object Client, int Start, int Size, void *pUsrData);
@@ -524,6 +773,193 @@ int S7API Cli_AsDBGet(S7Object Client, int DBNumber, void *pUsrData, int *Size);
 int S7API Cli_AsDBFill(S7Object Client, int DBNumber, int FillChar);
 int S7API Cli_CheckAsCompletion(S7Object Client, int *opResult);
 int S7API Cli_WaitAsCompletion(S7Object Client, int Timeout);
+int S7API Cli_GetAsCompletionFd(S7Object Client, int *Fd);
+// Job cancellation (p_i32_JobTimeout for the deadlines)
+int S7API Cli_CancelJob(S7Object Client);
+// Hedged reads
+int S7API Cli_GetHedgeStats(S7Object Client, TS7HedgeStats *pStats, int Reset);
+// Rate limit
+int S7API Cli_GetRateStats(S7Object Client, TS7RateStats *pStats, int Reset);
+// CPU capabilities (family detected from the order code)
+int S7API Cli_GetCapabilities(S7Object Client, TS7Capabilities *pCaps);
+// Response demultiplexer
+int S7API Cli_GetDemuxStats(S7Object Client, TS7DemuxStats *pStats, int Reset);
+int S7API Cli_SetDemuxCallback(S7Object Client, pfn_DemuxLog pCallback, void *usrPtr);
+// Statistics since the last reset
+int S7API Cli_GetStats(S7Object Client, TS7ClientStats *pStats, int Reset);
+int S7API Cli_GetHistogram(S7Object Client, int Op, TS7Histogram *pHist);
+int S7API Cli_GetJobStamps(S7Object Client, TS7JobStamps *pStamps);
+int S7API Cli_GetMemory(S7Object Client, TS7MemoryInfo *pInfo);
+// Background reconnection
+int S7API Cli_SetLinkCallback(S7Object Client, pfn_CliLinkState pCallback, void *usrPtr);
+int S7API Cli_GetLinkState(S7Object Client, int *State);
+// Diagnostic buffer tail : the first call takes the newest entry as reference
+int S7API Cli_SetDiagCallback(S7Object Client, pfn_CliDiagEvent pCallback, void *usrPtr);
+int S7API Cli_DiagTail(S7Object Client, int *NewEvents);
+// Fleet connection : many clients connected in parallel
+typedef struct {
+    S7Object Client;      // Created with Cli_Create
+    char     Address[16]; // PLC Address
+    int      Rack;
+    int      Slot;
+    int      Result;      // Output : connection result
+    int      Time;        // Output : connection time (ms)
+} TS7FleetItem, *PS7FleetItem;
+
+int S7API Cli_ConnectFleet(TS7FleetItem *Items, int ItemsCount, int MaxParallel, int Timeout);
+
+//******************************************************************************
+//                                CLIENT POOL
+//******************************************************************************
+// Pool sessions info
+typedef struct {
+    int      Connected; // Session connected
+    int      Busy;      // Session in use
+    longword Jobs;      // Jobs performed
+    longword Errors;    // Jobs failed
+    int      LastError; // Last job error
+    int      LastTime;  // Last job execution time (ms)
+} TS7PoolSession, *PS7PoolSession;
+
+S7Object S7API Pool_Create();
+void S7API Pool_Destroy(S7Object *Pool);
+int S7API Pool_SetConnectionParams(S7Object Pool, const char *Address, word LocalTSAP, word RemoteTSAP);
+int S7API Pool_SetConnectionType(S7Object Pool, word ConnectionType);
+int S7API Pool_ConnectTo(S7Object Pool, const char *Address, int Rack, int Slot);
+int S7API Pool_Connect(S7Object Pool);
+int S7API Pool_Disconnect(S7Object Pool);
+int S7API Pool_GetParam(S7Object Pool, int ParamNumber, void *pValue);
+int S7API Pool_SetParam(S7Object Pool, int ParamNumber, void *pValue);
+int S7API Pool_ReadArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+int S7API Pool_WriteArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+int S7API Pool_ReadMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount);
+int S7API Pool_WriteMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount);
+int S7API Pool_AcquireSession(S7Object Pool, S7Object *Client, int Timeout);
+int S7API Pool_ReleaseSession(S7Object Pool, S7Object Client);
+int S7API Pool_GetSessions(S7Object Pool, TS7PoolSession *pUsrData, int *ItemsCount);
+
+//******************************************************************************
+//                            RATE-GROUP SCHEDULER
+//******************************************************************************
+// Group cycle done (called from the scheduler thread)
+typedef void (S7API *pfn_SchedGroupDone) (void *usrPtr, int GroupId, int Result);
+
+// Group statistics (times in us)
+typedef struct {
+    longword Cycles;     // Cycles performed
+    longword Overruns;   // Cycles skipped because the scheduler was late
+    longword Errors;     // Cycles with at least an item failed
+    int      LastError;  // Last error (job or item)
+    longword JitterLast; // Delay of the cycle start vs. the ideal tick
+    longword JitterMax;
+    longword JitterAvg;
+    longword TimeLast;   // Execution time of the (merged) cycle
+    longword TimeMax;
+} TS7GroupStats, *PS7GroupStats;
+
+typedef struct {
+    int      BaseTick;   // Current base tick (ms)
+    longword Ticks;      // Ticks elapsed
+    longword Requests;   // PDUs sent
+    longword Items;      // Items read
+} TS7SchedStats, *PS7SchedStats;
+
+// Adaptive rates (p_i32_AdaptTarget > 0) : reasons of the last adjustment
+const int arNone     = 0;
+const int arLoad     = 1; // Link load over the target
+const int arOverrun  = 2; // Cycles lost
+const int arPlcCycle = 3; // OB1 cycle time rise
+const int arIdle     = 4; // Load under the target : faster
+
+typedef struct {
+    int      Stretch;     // Current intervals (% of the nominal ones)
+    int      Load;        // Link load of the last period (%)
+    int      RTT;         // Average request time of the last period (us)
+    int      PlcCycle;    // Last OB1 cycle time (ms), 0 = not available
+    int      PlcCycleMin; // Lowest OB1 cycle time seen (ms)
+    longword Adjustments; // Changes of the intervals
+    longword SlowDowns;
+    longword SpeedUps;
+    int      LastReason;  // arXXX
+} TS7AdaptStats, *PS7AdaptStats;
+
+S7Object S7API Sched_Create(S7Object Client);
+void S7API Sched_Destroy(S7Object *Sched);
+int S7API Sched_AddGroup(S7Object Sched, int Interval, PS7DataItem Items, int ItemsCount, pfn_SchedGroupDone pCallback, void *usrPtr, int *GroupId);
+int S7API Sched_RemoveGroup(S7Object Sched, int GroupId);
+int S7API Sched_Start(S7Object Sched);
+int S7API Sched_Stop(S7Object Sched);
+int S7API Sched_GetGroupStats(S7Object Sched, int GroupId, TS7GroupStats *pStats, int Reset);
+int S7API Sched_GetStats(S7Object Sched, TS7SchedStats *pStats);
+int S7API Sched_GetParam(S7Object Sched, int ParamNumber, void *pValue);
+int S7API Sched_SetParam(S7Object Sched, int ParamNumber, void *pValue);
+int S7API Sched_GetAdaptStats(S7Object Sched, TS7AdaptStats *pStats, int Reset);
+
+//******************************************************************************
+//                            PLC CLOCK ESTIMATOR
+//******************************************************************************
+// Times are ns since 1970-01-01 : host time in UTC, PLC time as its clock
+// reads (DT/DTL taken as UTC, see S7_DATE_AND_TIMEToNs/S7_DTLToNs of s7.h)
+typedef struct {
+    longword Samples;    // Clock reads performed
+    longword Errors;     // Clock reads failed
+    longword Steps;      // PLC clock steps detected
+    int      Valid;      // The model is usable
+    int      Kernel;     // The last sample used kernel receive stamps
+    int64_t  Offset;     // PLC - host time now (ns), the time zone of the PLC included
+    int      Drift;      // PLC clock rate vs host (ppb, > 0 : the PLC runs faster)
+    int      RTT;        // Round trip of the best recent sample (us)
+    int      Jitter;     // RMS residual of the fit (us)
+    int64_t  LastSample; // Host time of the last sample
+} TS7ClockStats, *PS7ClockStats;
+
+S7Object S7API Clock_Create(S7Object Client);
+void S7API Clock_Destroy(S7Object *Clock);
+int S7API Clock_Start(S7Object Clock, int Interval);
+int S7API Clock_Stop(S7Object Clock);
+int S7API Clock_Sample(S7Object Clock);
+int S7API Clock_GetStats(S7Object Clock, TS7ClockStats *pStats);
+int S7API Clock_PlcToHost(S7Object Clock, int64_t PlcTime, int64_t *HostTime);
+int S7API Clock_HostToPlc(S7Object Clock, int64_t HostTime, int64_t *PlcTime);
+
+//******************************************************************************
+//                                BLOCK BACKUP
+//******************************************************************************
+// OB, FB, FC, DB and SDB of the PLC of a pool, only the blocks changed since
+// the previous run (checksum, version, load size) are uploaded, in parallel.
+// Images stored in Folder as <hash>.mc7, IndexName (in Folder) maps the
+// blocks of the PLC to them.
+const int bsUnchanged = 0; // As in the index, not uploaded
+const int bsUploaded  = 1; // Uploaded and stored
+const int bsFailed    = 2; // Block info or upload failed (Result)
+
+typedef struct {
+    int      BlkType;   // Block_OB, Block_DB ...
+    int      BlkNumber;
+    int      CheckSum;
+    int      Version;
+    int      LoadSize;  // From the block info
+    int      Size;      // Bytes of the image
+    int      Status;
+    int      Result;
+    uint64_t Hash;      // Key of the image in the folder
+} TS7BackupEntry, *PS7BackupEntry;
+
+typedef struct {
+    int      Blocks;
+    int      Unchanged;
+    int      Uploaded;
+    int      Failed;
+    int      Stored;    // Images new to the folder
+    longword Bytes;     // Bytes uploaded
+    int      Time;      // ms
+} TS7BackupStats, *PS7BackupStats;
+
+S7Object S7API Bak_Create(S7Object Pool);
+void S7API Bak_Destroy(S7Object *Backup);
+int S7API Bak_Run(S7Object Backup, const char *Folder, const char *IndexName);
+int S7API Bak_GetEntries(S7Object Backup, TS7BackupEntry *pUsrData, int *ItemsCount);
+int S7API Bak_GetStats(S7Object Backup, TS7BackupStats *pStats);
 
 //******************************************************************************
 //                                   SERVER
@@ -667,6 +1103,7 @@ int S7API Srv_LockArea(S7Object Server, int AreaCode, word Index);
 int S7API Srv_UnlockArea(S7Object Server, int AreaCode, word Index);
 int S7API Srv_GetStatus(S7Object Server, int *ServerStatus, int *CpuStatus, int *ClientsCount);
 int S7API Srv_SetCpuStatus(S7Object Server, int CpuStatus);
+int S7API Srv_GetMemory(S7Object Server, TS7MemoryInfo *pInfo);
 int S7API Srv_ClearEvents(S7Object Server);
 int S7API Srv_PickEvent(S7Object Server, TSrvEvent *pEvent, int *EvtReady);
 int S7API Srv_GetMask(S7Object Server, int MaskKind, longword *Mask);
@@ -751,6 +1188,9 @@ int S7API Par_ErrorText(int Error, char *Text, int TextLen);
 
 #ifdef __cplusplus
 
+// The classes below wrap the classic API only. The newer functions (completion
+// fd, cancel, hedging, pool, scheduler, statistics, backup, diagnostics ...)
+// are C-only : use them on the objects created with Cli_Create, Pool_Create ...
 //******************************************************************************
 //                           CLIENT CLASS DEFINITION
 //******************************************************************************
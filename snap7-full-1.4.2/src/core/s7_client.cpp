@@ -24,16 +24,78 @@
 |  If not, see  http://www.gnu.org/licenses/                                   |
 |=============================================================================*/
 #include "s7_client.h"
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 //---------------------------------------------------------------------------
 TSnap7Client::TSnap7Client()
 {
      FThread = 0;
      CliCompletion = 0;
+     FNotifier = NULL;
+     NotifierCS = new TSnapCriticalSection();
+     AsDone = false;
+     AsRunning = false;
 	 EvtJob = NULL;
      EvtComplete = NULL;
 	 FThread=NULL;
 	 ThreadCreated = false;
+     FHedgeThread = NULL;
+     FHedge = NULL;
+     EvtHedgeStart = NULL;
+     EvtHedgeStop = NULL;
+     EvtHedgeIdle = NULL;
+     HedgeCS = NULL;
+     HedgePercentile = 0;
+     HedgeDelay = 50;
+     HedgeSamplesCount = 0;
+     HedgeSamplesIdx = 0;
+     memset(&HedgeStats,0,sizeof(TS7HedgeStats));
+     HedgeThreshold = 0;
+     HedgeBusy = false;
+     MainRunning = false;
+     HedgeRunning = false;
+     HedgeWon = false;
+     HedgeDropped = false;
+     HedgeLastTry = 0;
+     HedgeData = NULL;
+     HedgeDataSize = 0;
+     FReconnect = NULL;
+     EvtReconnect = NULL;
+     EvtReconnectStop = NULL;
+     EvtReconnectIdle = NULL;
+     EvtLinkUp = new TSnapEvent(true);
+     ReconnectMode = rmNone;
+     ReconnectMin = 500;
+     ReconnectMax = 30000;
+     LinkState = lsDisconnected;
+     LinkWanted = false;
+     LastPDU = 0;
+     JitterSeed = SysGetTick() ^ longword(uintptr_t(this));
+     CliLinkState = NULL;
+     FLinkUsrPtr = NULL;
+     CliDiagEvent = NULL;
+     FDiagUsrPtr = NULL;
+     memset(DiagLast,0,sizeof(DiagLast));
+     DiagSynced = false;
+     DiagBuffer = NULL;
+     DiagBufferSize = 0;
+     ShareSession = false;
+     JobPriority = jpNormal;
+     FShared = NULL;
+     EvtTurn = new TSnapEvent(false);
+     ShareNext = NULL;
+     ShareQueued = false;
+     WriteWindow = 0;
+     WriteMaxItems = WriteMaxItemsDef;
+     WriteBatch = NULL;
+     WriteCS = new TSnapCriticalSection();
+     FlushCS = new TSnapCriticalSection();
 }
 //---------------------------------------------------------------------------
 TSnap7Client::~TSnap7Client()
@@ -48,6 +110,31 @@ TSnap7Client::~TSnap7Client()
 	    delete EvtJob;
 		ThreadCreated=false;
 	}
+	if (FNotifier!=NULL)
+	    delete FNotifier;
+    delete NotifierCS;
+    CloseHedge();
+    delete[] HedgeData;
+    if (FReconnect!=NULL)
+    {
+        FReconnect->Terminate();
+        EvtReconnect->Set();
+        if (FReconnect->WaitFor(3000)!=WAIT_OBJECT_0)
+            FReconnect->Kill();
+        try {
+            delete FReconnect;
+        }
+        catch (...){
+        }
+        delete EvtReconnectIdle;
+        delete EvtReconnectStop;
+        delete EvtReconnect;
+    }
+    delete[] DiagBuffer;
+    delete EvtLinkUp;
+    delete EvtTurn;
+    delete FlushCS;
+    delete WriteCS;
 }
 //---------------------------------------------------------------------------
 void TSnap7Client::CloseThread()
@@ -98,6 +185,29 @@ int TSnap7Client::Reset(bool DoReconnect)
        return 0;
 }
 //---------------------------------------------------------------------------
+int TSnap7Client::Disconnect()
+{
+    int Result;
+    StopReconnect();
+    if (FHedge!=NULL)
+    {
+        EvtHedgeIdle->WaitForever(); // a connection attempt could be in progress
+        FHedge->Disconnect();
+    }
+    HedgeDropped=false;
+    HedgeLastTry=0;
+    if (FShared!=NULL)
+    {
+        TSnap7Session::Detach(FShared);
+        FShared=NULL;
+        Connected=false; // we have no socket of our own
+    }
+    Result=TSnap7MicroClient::Disconnect();
+    SetLinkState(lsDisconnected, 0);
+    EvtLinkUp->Set(); // releases the queued job
+    return Result;
+}
+//---------------------------------------------------------------------------
 void TSnap7Client::DoCompletion()
 {
     if ((CliCompletion!=NULL) && !Destroying)
@@ -117,22 +227,118 @@ int TSnap7Client::SetAsCallback(pfn_CliCompletion pCompletion, void * usrPtr)
     return 0;
 }
 //---------------------------------------------------------------------------
+int TSnap7Client::GetAsCallback(pfn_CliCompletion &pCompletion, void * &usrPtr)
+{
+    pCompletion=CliCompletion;
+    usrPtr=FUsrPtr;
+    return 0;
+}
+//---------------------------------------------------------------------------
 int TSnap7Client::GetParam(int ParamNumber, void * pValue)
 {
-    // Actually there are no specific client params, maybe in future...
-	return TSnap7MicroClient::GetParam(ParamNumber, pValue);
+    switch (ParamNumber)
+    {
+    case p_i32_HedgePercentile:
+        *Pint32_t(pValue)=HedgePercentile;
+        break;
+    case p_i32_HedgeDelay:
+        *Pint32_t(pValue)=HedgeDelay;
+        break;
+    case p_i32_ReconnectMode:
+        *Pint32_t(pValue)=ReconnectMode;
+        break;
+    case p_i32_ReconnectMin:
+        *Pint32_t(pValue)=ReconnectMin;
+        break;
+    case p_i32_ReconnectMax:
+        *Pint32_t(pValue)=ReconnectMax;
+        break;
+    case p_i32_ShareSession:
+        *Pint32_t(pValue)=ShareSession;
+        break;
+    case p_i32_JobPriority:
+        *Pint32_t(pValue)=JobPriority;
+        break;
+    case p_i32_WriteWindow:
+        *Pint32_t(pValue)=WriteWindow;
+        break;
+    case p_i32_WriteMaxItems:
+        *Pint32_t(pValue)=WriteMaxItems;
+        break;
+    default:
+        return TSnap7MicroClient::GetParam(ParamNumber, pValue);
+    }
+    return 0;
 }
 //---------------------------------------------------------------------------
 int TSnap7Client::SetParam(int ParamNumber, void * pValue)
 {
-    // Actually there are no specific client params, maybe in future...
-	return TSnap7MicroClient::SetParam(ParamNumber, pValue);
+    int Value;
+    switch (ParamNumber)
+    {
+    case p_i32_HedgePercentile:
+        Value=*Pint32_t(pValue);
+        if ((Value<0) || (Value>99))
+            return errCliInvalidParams;
+        HedgePercentile=Value;
+        break;
+    case p_i32_HedgeDelay:
+        HedgeDelay=*Pint32_t(pValue);
+        break;
+    case p_i32_ReconnectMode:
+        Value=*Pint32_t(pValue);
+        if ((Value<rmNone) || (Value>rmQueue))
+            return errCliInvalidParams;
+        ReconnectMode=Value;
+        break;
+    case p_i32_ReconnectMin:
+        Value=*Pint32_t(pValue);
+        if (Value<1)
+            return errCliInvalidParams;
+        ReconnectMin=Value;
+        break;
+    case p_i32_ReconnectMax:
+        Value=*Pint32_t(pValue);
+        if (Value<1)
+            return errCliInvalidParams;
+        ReconnectMax=Value;
+        break;
+    case p_i32_ShareSession:
+        if (Connected)
+            return errCliCannotChangeParam;
+        ShareSession=*Pint32_t(pValue)!=0;
+        break;
+    case p_i32_JobPriority:
+        Value=*Pint32_t(pValue);
+        if ((Value!=jpNormal) && (Value!=jpHigh))
+            return errCliInvalidParams;
+        JobPriority=Value;
+        break;
+    case p_i32_WriteWindow:
+        Value=*Pint32_t(pValue);
+        if (Value<0)
+            return errCliInvalidParams;
+        WriteWindow=Value;
+        break;
+    case p_i32_WriteMaxItems:
+        Value=*Pint32_t(pValue);
+        if (Value<1)
+            return errCliInvalidParams;
+        WriteMaxItems=Value;
+        break;
+    default:
+        return TSnap7MicroClient::SetParam(ParamNumber, pValue);
+    }
+    return 0;
 }
 //---------------------------------------------------------------------------
 bool TSnap7Client::CheckAsCompletion(int &opResult)
 {
     if (!Job.Pending)
+    {
         opResult=Job.Result;
+        ClearAsDone();
+    }
     else
         if (!Destroying)
             opResult=errCliJobPending; // don't set LastError here
@@ -181,13 +387,14 @@ int TSnap7Client::AsWriteArea(int Area, int DBNumber, int Start, int Amount, int
         TotalSize=ByteSize*Amount; // Total size in bytes
         if (ByteSize==0)
             return SetError(errCliInvalidWordLen);
-        if ((TotalSize < 1) || (TotalSize > int(sizeof(opData))))
+        if ((TotalSize < 1) || (TotalSize > int(sizeof(TS7Buffer))))
             return SetError(errCliInvalidParams);
         Job.Amount  =Amount;
         Job.WordLen =WordLen;
         // Doublebuffering
-        memcpy(&opData, pUsrData, TotalSize);
-        Job.pData =&opData;
+        NeedData();
+        memcpy(opData, pUsrData, TotalSize);
+        Job.pData =opData;
         JobStart  =SysGetTick();
         StartAsyncJob();
         return 0;
@@ -196,6 +403,40 @@ int TSnap7Client::AsWriteArea(int Area, int DBNumber, int Start, int Amount, int
         return SetError(errCliJobPending);
 }
 //---------------------------------------------------------------------------
+int TSnap7Client::AsReadMultiVars(PS7DataItem Item, int ItemsCount)
+{
+    // Items (and their buffers) must remain valid until the job completes
+    if (!Job.Pending)
+    {
+        Job.Pending  =true;
+        Job.Op       =s7opReadMultiVars;
+        Job.Amount   =ItemsCount;
+        Job.pData    =Item;
+        JobStart     =SysGetTick();
+        StartAsyncJob();
+        return 0;
+    }
+    else
+        return SetError(errCliJobPending);
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::AsWriteMultiVars(PS7DataItem Item, int ItemsCount)
+{
+    // Items (and their buffers) must remain valid until the job completes
+    if (!Job.Pending)
+    {
+        Job.Pending  =true;
+        Job.Op       =s7opWriteMultiVars;
+        Job.Amount   =ItemsCount;
+        Job.pData    =Item;
+        JobStart     =SysGetTick();
+        StartAsyncJob();
+        return 0;
+    }
+    else
+        return SetError(errCliJobPending);
+}
+//---------------------------------------------------------------------------
 int TSnap7Client::AsListBlocksOfType(int BlockType, PS7BlocksOfType pUsrData, int & ItemsCount)
 {
     if (!Job.Pending)
@@ -302,7 +543,8 @@ int TSnap7Client::AsDownload(int BlockNum, void * pUsrData, int Size)
         Job.Pending  =true;
         Job.Op       =s7opDownload;
         // Doublebuffering
-        memcpy(&opData, pUsrData, Size);
+        NeedData();
+        memcpy(opData, pUsrData, Size);
         Job.Number   =BlockNum;
         Job.Amount   =Size;
         JobStart     =SysGetTick();
@@ -460,6 +702,7 @@ void TSnap7Client::StartAsyncJob()
 		ThreadCreated=true;
 	}
 	EvtComplete->Reset(); // reset if previously was not called WaitAsCompletion
+	ClearAsDone();
     EvtJob->Set();
 }
 //---------------------------------------------------------------------------
@@ -470,7 +713,10 @@ int TSnap7Client::WaitAsCompletion(unsigned long Timeout)
         if (ThreadCreated)
 		{
 			if (EvtComplete->WaitFor(Timeout)==WAIT_OBJECT_0)
+			{
+				ClearAsDone();
 				return Job.Result;
+			}
 			else
 			{  
 				if (Destroying)
@@ -483,21 +729,3406 @@ int TSnap7Client::WaitAsCompletion(unsigned long Timeout)
 			return SetError(errCliJobTimeout);
     }
     else
+    {
+        ClearAsDone();
         return Job.Result;
+    }
 }
 //---------------------------------------------------------------------------
-void TClientThread::Execute()
+// An async job is signaled before it's seen completed (Pending cleared) : a
+// consumer which finds it done and clears the descriptor always does it after
+// the signal, so no stale completion is left.
+void TSnap7Client::JobCompleted()
 {
-     while (!Terminated)
-     {
-          FClient->EvtJob->WaitForever();
-          if (!Terminated)
-          {
-               FClient->PerformOperation();
-               FClient->EvtComplete->Set();
-               // Notify the caller the end of job (if callback is set)
-               FClient->DoCompletion();
-          }
-     };
+    if (!AsRunning)
+        return;
+    NotifierCS->Enter();
+    AsDone=true;
+    if (FNotifier!=NULL)
+        FNotifier->Signal();
+    NotifierCS->Leave();
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::ClearAsDone()
+{
+    NotifierCS->Enter();
+    AsDone=false;
+    if (FNotifier!=NULL)
+        FNotifier->Clear();
+    NotifierCS->Leave();
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::GetAsCompletionFd(int &Fd)
+{
+    int Result = 0;
+    // Created on demand : it stays readable from the end of an async job
+    // until CheckAsCompletion/WaitAsCompletion or the next async job.
+    NotifierCS->Enter();
+    if (FNotifier==NULL)
+    {
+        FNotifier = new TMsgNotifier();
+        // A job that completed before the descriptor existed is not missed
+        if (AsDone)
+            FNotifier->Signal();
+    }
+    if (FNotifier->Valid())
+        Fd=FNotifier->Handle();
+    else
+    {
+        Fd=-1;
+        Result=errCliFunNotAvailable;
+    }
+    NotifierCS->Leave();
+    return SetError(Result);
+}
+//---------------------------------------------------------------------------
+// HEDGED READS
+//---------------------------------------------------------------------------
+void TSnap7Client::OpenHedge()
+{
+    HedgeCS = new TSnapCriticalSection();
+    EvtHedgeStart = new TSnapEvent(false);
+    EvtHedgeStop = new TSnapEvent(true);
+    EvtHedgeIdle = new TSnapEvent(true);
+    EvtHedgeIdle->Set();
+    FHedge = new TSnap7MicroClient();
+    FHedgeThread = new THedgeThread(this);
+    FHedgeThread->Start();
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::CloseHedge()
+{
+    if (FHedgeThread)
+    {
+        FHedgeThread->Terminate();
+        EvtHedgeStop->Set();
+        EvtHedgeStart->Set();
+        if (FHedgeThread->WaitFor(3000)!=WAIT_OBJECT_0)
+            FHedgeThread->Kill();
+        try {
+            delete FHedgeThread;
+        }
+        catch (...){
+        }
+        FHedgeThread=NULL;
+        FHedge->Disconnect();
+        delete FHedge;
+        delete EvtHedgeIdle;
+        delete EvtHedgeStop;
+        delete EvtHedgeStart;
+        delete HedgeCS;
+        FHedge=NULL;
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::ConnectHedge()
+{
+    // Same PLC, same connection parameters of the main connection
+    FHedge->CopySettings(this);
+    FHedge->Connect();
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::PerformHedge()
+{
+    int Timeout = 0;
+    int Result;
+    bool Fire;
+
+    if (!FHedge->Connected)
+    {
+        ConnectHedge();
+        return;
+    }
+    // Most reads end here
+    if (EvtHedgeStop->WaitFor(HedgeThreshold)==WAIT_OBJECT_0)
+        return;
+
+    HedgeCS->Enter();
+    Fire=MainRunning;
+    HedgeRunning=Fire;
+    HedgeCS->Leave();
+    if (!Fire)
+        return;
+
+    HedgeStats.Hedged++;
+    AddRetry();
+    // The repeated read has the same deadline of the job
+    if (Job.Deadline!=0)
+    {
+        Timeout=int(Job.Deadline-SysGetTick());
+        if (Timeout<1)
+            Timeout=1;
+    }
+    FHedge->SetParam(p_i32_JobTimeout, &Timeout);
+    if (Job.Op==s7opReadArea)
+        Result=FHedge->ReadArea(Job.Area, Job.Number, Job.Start, Job.Amount, Job.WordLen, HedgeData);
+    else
+        Result=FHedge->ReadMultiVars(HedgeItems, Job.Amount);
+
+    HedgeCS->Enter();
+    HedgeRunning=false;
+    if ((Result==0) && MainRunning)
+    {
+        HedgeWon=true;
+        CancelJob();
+    }
+    HedgeCS->Leave();
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::AddHedgeSample(longword Time)
+{
+    HedgeSamples[HedgeSamplesIdx]=Time;
+    HedgeSamplesIdx=(HedgeSamplesIdx+1) % HedgeWindow;
+    if (HedgeSamplesCount<HedgeWindow)
+        HedgeSamplesCount++;
+}
+//---------------------------------------------------------------------------
+longword TSnap7Client::GetHedgeThreshold()
+{
+    longword Sorted[HedgeWindow];
+    longword Value;
+    int c, i, Count = HedgeSamplesCount;
+    longword Result = longword(HedgeDelay);
+
+    if (Count>=HedgeMinSamples)
+    {
+        // Insertion sort, the window is small
+        for (c = 0; c < Count; c++)
+        {
+            Value=HedgeSamples[c];
+            for (i = c; (i > 0) && (Sorted[i-1] > Value); i--)
+                Sorted[i]=Sorted[i-1];
+            Sorted[i]=Value;
+        }
+        i=(Count*HedgePercentile)/100;
+        if (i>=Count)
+            i=Count-1;
+        if (Sorted[i]>Result)
+            Result=Sorted[i];
+    }
+    if (Result<1)
+        Result=1;
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::HedgeItemSize(PS7DataItem Item)
+{
+    int WordSize = DataSizeByte(Item->WordLen);
+    if ((WordSize==0) || (Item->Amount<1) || (Item->Amount>HedgeMaxData))
+        return -1;
+    return Item->Amount*WordSize;
+}
+//---------------------------------------------------------------------------
+bool TSnap7Client::PrepareHedgeData()
+{
+    PS7DataItem Item = PS7DataItem(Job.pData);
+    TS7DataItem Area;
+    int c, Offset, Size = 0;
+
+    if (Job.Op==s7opReadArea)
+    {
+        Area.WordLen=Job.WordLen;
+        Area.Amount=Job.Amount;
+        Size=HedgeItemSize(&Area);
+    }
+    else
+    {
+        if ((Job.Amount<1) || (Job.Amount>MaxVars))
+            return false;
+        for (c = 0; (c < Job.Amount) && (Size>=0); c++)
+        {
+            Offset=HedgeItemSize(&Item[c]);
+            Size=(Offset<0) ? -1 : Size+Offset;
+        }
+    }
+    // Invalid or big reads are left to the main connection alone
+    if ((Size<=0) || (Size>HedgeMaxData))
+        return false;
+
+    if (Size>HedgeDataSize)
+    {
+        delete[] HedgeData;
+        HedgeData=new byte[Size];
+        HedgeDataSize=Size;
+    }
+    if (Job.Op==s7opReadMultiVars)
+    {
+        Offset=0;
+        for (c = 0; c < Job.Amount; c++)
+        {
+            HedgeItems[c]=Item[c];
+            HedgeItems[c].pdata=HedgeData+Offset;
+            Offset+=HedgeItemSize(&Item[c]);
+        }
+    }
+    return true;
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::TakeHedgeData()
+{
+    PS7DataItem Item = PS7DataItem(Job.pData);
+    int c;
+
+    if (Job.Op==s7opReadArea)
+        memcpy(Job.pData, HedgeData, Job.Amount*DataSizeByte(Job.WordLen));
+    else
+        for (c = 0; c < Job.Amount; c++)
+        {
+            Item[c].Result=HedgeItems[c].Result;
+            if (Item[c].Result==0)
+                memcpy(Item[c].pdata, HedgeItems[c].pdata, HedgeItemSize(&Item[c]));
+        }
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::RunHedged(int Operation)
+{
+    longword Elapsed;
+    bool Won;
+
+    if (FHedgeThread==NULL)
+        OpenHedge();
+    HedgeStats.Reads++;
+    Elapsed=SysGetTick();
+
+    if (HedgeBusy || !FHedge->Connected || !PrepareHedgeData())
+    {
+        // The second connection is (re)connected in background, meanwhile plain reads
+        if (!HedgeBusy && !FHedge->Connected && Connected && (DeltaTime(HedgeLastTry)>=longword(HedgeRetryTime)))
+        {
+            HedgeLastTry=SysGetTick();
+            HedgeBusy=true;
+            EvtHedgeIdle->Reset();
+            EvtHedgeStart->Set();
+        }
+        TSnap7MicroClient::RunOperation(Operation);
+        if (Job.Result==0)
+            AddHedgeSample(DeltaTime(Elapsed));
+        return;
+    }
+
+    HedgeThreshold=GetHedgeThreshold();
+    HedgeStats.Threshold=HedgeThreshold;
+    HedgeWon=false;
+    MainRunning=true;
+    HedgeBusy=true;
+    EvtHedgeStop->Reset();
+    EvtHedgeIdle->Reset();
+    EvtHedgeStart->Set();
+
+    TSnap7MicroClient::RunOperation(Operation);
+
+    HedgeCS->Enter();
+    MainRunning=false;
+    Won=HedgeWon;
+    if (HedgeRunning)
+        FHedge->CancelJob();
+    HedgeCS->Leave();
+    EvtHedgeStop->Set();
+    EvtHedgeIdle->WaitForever();
+
+    // When the second connection won, Elapsed is a lower bound of the main read time
+    AddHedgeSample(DeltaTime(Elapsed));
+    if (Won)
+    {
+        TakeHedgeData();
+        Job.Result=0;
+        HedgeStats.Won++;
+        HedgeDropped=!Connected;
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::RunOperation(int Operation)
+{
+    // Shared session : the job runs on the physical connection in its turn
+    if ((FShared!=NULL) && (Operation!=s7opNone))
+    {
+        FShared->Perform(this, Job, JobStart, JobTimeout);
+        Connected=FShared->Connected();
+        if (Connected)
+            PDULength=FShared->PDULength();
+        return;
+    }
+    // A previous hedge canceled the main read in the middle of a telegram : the
+    // connection was dropped on purpose and is reopened here, before the link
+    // state is checked, so the reconnection is not started as well. If it
+    // fails, the link is lost as usual.
+    if (HedgeDropped && (Operation!=s7opNone))
+    {
+        if (!Connected)
+            PeerConnect();
+        HedgeDropped=false;
+    }
+    // Link down : the job waits for the reconnection or fails at once
+    if ((Operation!=s7opNone) && !LinkReady())
+    {
+        Job.Result=errCliLinkDown;
+        return;
+    }
+    if ((HedgePercentile>0) && ((Operation==s7opReadArea) || (Operation==s7opReadMultiVars)))
+        RunHedged(Operation);
+    else
+        TSnap7MicroClient::RunOperation(Operation);
+    if (!Connected && !HedgeDropped)
+        LinkLost(Job.Result);
+}
+//---------------------------------------------------------------------------
+// WRITE COALESCING
+//---------------------------------------------------------------------------
+class TWriteBatch
+{
+public:
+    PWriteEntry Head;
+    PWriteEntry Tail;
+    int Count;
+    int Refs;            // Callers still using the batch
+    bool Flushing;       // The entries can no longer be withdrawn
+    PSnapEvent EvtFull;  // Max items reached : the leader flushes at once
+    PSnapEvent EvtDone;  // Results available
+    TWriteBatch()
+    {
+        Head = NULL;
+        Tail = NULL;
+        Count = 0;
+        Refs = 0;
+        Flushing = false;
+        EvtFull = new TSnapEvent(false);
+        EvtDone = new TSnapEvent(true);
+    }
+    ~TWriteBatch()
+    {
+        delete EvtDone;
+        delete EvtFull;
+    }
+    void Remove(PWriteEntry Entry)
+    {
+        PWriteEntry Prev = NULL;
+        PWriteEntry Item = Head;
+        while ((Item!=NULL) && (Item!=Entry))
+        {
+            Prev=Item;
+            Item=Item->Next;
+        }
+        if (Item==NULL)
+            return;
+        if (Prev==NULL)
+            Head=Item->Next;
+        else
+            Prev->Next=Item->Next;
+        if (Tail==Item)
+            Tail=Prev;
+        Count--;
+    }
+};
+//---------------------------------------------------------------------------
+// Merged byte range of an area
+typedef struct {
+    int Area;
+    int DBNumber;
+    int Start;
+    int End;
+    pbyte Data;
+    int Entries;
+} TWriteSegment;
+//---------------------------------------------------------------------------
+static bool ByteWrite(PWriteEntry Entry)
+{
+    return (Entry->WordLen!=S7WLBit) && (Entry->WordLen!=S7WLCounter) && (Entry->WordLen!=S7WLTimer) &&
+           (Entry->Area!=S7AreaCT) && (Entry->Area!=S7AreaTM);
+}
+//---------------------------------------------------------------------------
+// Segment holding the byte of a single bit write, or -1
+static int BitSegment(TWriteSegment *Segments, int SegCount, PWriteEntry Entry)
+{
+    int Byte = Entry->Start / 8;
+    int c;
+    if ((Entry->WordLen!=S7WLBit) || (Entry->Amount!=1))
+        return -1;
+    for (c = 0; c < SegCount; c++)
+        if ((Segments[c].Area==Entry->Area) && (Segments[c].DBNumber==Entry->DBNumber) &&
+            (Byte>=Segments[c].Start) && (Byte<Segments[c].End))
+            return c;
+    return -1;
+}
+//---------------------------------------------------------------------------
+static int CompareWrites(const void *A, const void *B)
+{
+    PWriteEntry E1 = *(PWriteEntry *)A;
+    PWriteEntry E2 = *(PWriteEntry *)B;
+    if (E1->Area!=E2->Area)
+        return E1->Area-E2->Area;
+    if (E1->DBNumber!=E2->DBNumber)
+        return E1->DBNumber-E2->DBNumber;
+    return E1->Start-E2->Start;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void * pUsrData)
+{
+    if (WriteWindow>0)
+        return CoalesceWrite(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+    else
+        return TSnap7MicroClient::WriteArea(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::CoalesceWrite(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    TWriteEntry Entry;
+    TWriteBatch *Batch;
+    longword Elapsed = SysGetTick();
+    int Left;
+    bool Leader, Last, Dropped;
+
+    if ((pUsrData==NULL) || (Amount<1))
+        return SetError(errCliInvalidParams);
+    Entry.Area=Area;
+    Entry.DBNumber=DBNumber;
+    Entry.Start=Start;
+    Entry.Amount=Amount;
+    Entry.WordLen=WordLen;
+    Entry.pData=pUsrData;
+    Entry.Result=0;
+    Entry.Next=NULL;
+
+    // The first caller of a batch is its leader : it waits for the window
+    // and performs the writes of everybody
+    WriteCS->Enter();
+    Batch=WriteBatch;
+    Leader=Batch==NULL;
+    if (Leader)
+    {
+        Batch=new TWriteBatch();
+        WriteBatch=Batch;
+    }
+    if (Batch->Tail!=NULL)
+        Batch->Tail->Next=&Entry;
+    else
+        Batch->Head=&Entry;
+    Batch->Tail=&Entry;
+    Batch->Count++;
+    Batch->Refs++;
+    if (Batch->Count>=WriteMaxItems)
+    {
+        WriteBatch=NULL; // closed
+        Batch->EvtFull->Set();
+    }
+    WriteCS->Leave();
+
+    if (Leader)
+    {
+        Batch->EvtFull->WaitFor(WriteWindow);
+        WriteCS->Enter();
+        if (WriteBatch==Batch)
+            WriteBatch=NULL;
+        WriteCS->Leave();
+        // The previous batch may be still in progress
+        FlushCS->Enter();
+        WriteCS->Enter();
+        Batch->Flushing=true;
+        WriteCS->Leave();
+        FlushWrites(Batch);
+        FlushCS->Leave();
+        Batch->EvtDone->Set();
+    }
+    else
+    {
+        // Withdrawn at the deadline if not yet sent, otherwise the writes
+        // in progress are waited for (they are bounded by their own jobs)
+        Dropped=false;
+        if (JobTimeout>0)
+        {
+            Left=JobTimeout-int(DeltaTime(Elapsed));
+            if (Left<0)
+                Left=0;
+            if (Batch->EvtDone->WaitFor(Left)!=WAIT_OBJECT_0)
+            {
+                WriteCS->Enter();
+                Dropped=!Batch->Flushing;
+                if (Dropped)
+                {
+                    Batch->Remove(&Entry);
+                    Entry.Result=errCliJobTimeout;
+                }
+                WriteCS->Leave();
+            }
+        }
+        if (!Dropped)
+            Batch->EvtDone->WaitForever();
+    }
+
+    WriteCS->Enter();
+    Batch->Refs--;
+    Last=Batch->Refs==0;
+    WriteCS->Leave();
+    if (Last)
+        delete Batch;
+    return Entry.Result;
+}
+//---------------------------------------------------------------------------
+// One WriteMultiVars, the results go back to Items[Index[]]
+void TSnap7Client::SendWrites(PS7DataItem Pack, int *Index, int Count, PS7DataItem Items)
+{
+    int Result, c;
+    if (Count==0)
+        return;
+    Result=WriteMultiVars(Pack, Count);
+    for (c = 0; c < Count; c++)
+        if (Result!=0)
+            Items[Index[c]].Result=Result;
+        else
+            Items[Index[c]].Result=Pack[c].Result;
+}
+//---------------------------------------------------------------------------
+// Packs the items into WriteMultiVars requests
+void TSnap7Client::WritePacked(PS7DataItem Items, int ItemsCount)
+{
+    TS7DataItem Pack[MaxVars];
+    int Index[MaxVars];
+    int Count = 0;
+    int ReqSize = ReqHeaderSize+2;
+    int Size, c;
+
+    for (c = 0; c < ItemsCount; c++)
+    {
+        Size=Items[c].Amount*DataSizeByte(Items[c].WordLen);
+        Size=sizeof(TReqFunWriteItem)+4+Size+(Size & 1);
+        // Too big to share a PDU : WriteArea splits it
+        if (ReqHeaderSize+2+Size>PDULength)
+        {
+            Items[c].Result=TSnap7MicroClient::WriteArea(Items[c].Area, Items[c].DBNumber,
+                Items[c].Start, Items[c].Amount, Items[c].WordLen, Items[c].pdata);
+            continue;
+        }
+        if ((Count==MaxVars) || (ReqSize+Size>PDULength))
+        {
+            SendWrites(Pack, Index, Count, Items);
+            Count=0;
+            ReqSize=ReqHeaderSize+2;
+        }
+        Pack[Count]=Items[c];
+        Index[Count++]=c;
+        ReqSize+=Size;
+    }
+    SendWrites(Pack, Index, Count, Items);
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::FlushWrites(TWriteBatch *Batch)
+{
+    PWriteEntry *Sorted = new PWriteEntry[Batch->Count];
+    TWriteSegment *Segments = new TWriteSegment[Batch->Count];
+    PS7DataItem Items = new TS7DataItem[Batch->Count];
+    TWriteSegment *Seg = NULL;
+    PWriteEntry Entry;
+    int SortedCount = 0;
+    int SegCount = 0;
+    int ItemsCount = 0;
+    int Size, c;
+
+    // Byte ranges sorted by address, merged when they overlap or touch
+    for (Entry = Batch->Head; Entry!=NULL; Entry=Entry->Next)
+        if (ByteWrite(Entry))
+            Sorted[SortedCount++]=Entry;
+    qsort(Sorted, SortedCount, sizeof(PWriteEntry), CompareWrites);
+    for (c = 0; c < SortedCount; c++)
+    {
+        Entry=Sorted[c];
+        Size=Entry->Amount*DataSizeByte(Entry->WordLen);
+        if ((Seg==NULL) || (Seg->Area!=Entry->Area) || (Seg->DBNumber!=Entry->DBNumber) || (Entry->Start>Seg->End))
+        {
+            Seg=&Segments[SegCount++];
+            Seg->Area=Entry->Area;
+            Seg->DBNumber=Entry->DBNumber;
+            Seg->Start=Entry->Start;
+            Seg->End=Entry->Start+Size;
+            Seg->Entries=0;
+        }
+        else if (Entry->Start+Size>Seg->End)
+            Seg->End=Entry->Start+Size;
+        Seg->Entries++;
+        Entry->Item=SegCount-1;
+    }
+    // Last writer wins : the data are copied in arrival order. A bit inside a
+    // segment is applied to its byte there (the PLC would otherwise write the
+    // separate bit item after the segment, whatever the order of the calls).
+    for (c = 0; c < SegCount; c++)
+        Segments[c].Data=new byte[Segments[c].End-Segments[c].Start];
+    for (Entry = Batch->Head; Entry!=NULL; Entry=Entry->Next)
+        if (ByteWrite(Entry))
+        {
+            Seg=&Segments[Entry->Item];
+            memcpy(Seg->Data+Entry->Start-Seg->Start, Entry->pData, Entry->Amount*DataSizeByte(Entry->WordLen));
+        }
+        else
+        {
+            Entry->Item=BitSegment(Segments, SegCount, Entry);
+            if (Entry->Item>=0)
+            {
+                Seg=&Segments[Entry->Item];
+                Seg->Entries++;
+                if ((*pbyte(Entry->pData) & 0x01)!=0) // As the PLC reads it
+                    Seg->Data[Entry->Start/8-Seg->Start]|=byte(1 << (Entry->Start % 8));
+                else
+                    Seg->Data[Entry->Start/8-Seg->Start]&=byte(~(1 << (Entry->Start % 8)));
+            }
+        }
+
+    // One item per segment, then the other bits, timers and counters as they are
+    for (c = 0; c < SegCount; c++)
+    {
+        Items[c].Area=Segments[c].Area;
+        Items[c].WordLen=S7WLByte;
+        Items[c].DBNumber=Segments[c].DBNumber;
+        Items[c].Start=Segments[c].Start;
+        Items[c].Amount=Segments[c].End-Segments[c].Start;
+        Items[c].pdata=Segments[c].Data;
+        Items[c].Result=0;
+    }
+    ItemsCount=SegCount;
+    for (Entry = Batch->Head; Entry!=NULL; Entry=Entry->Next)
+        if (!ByteWrite(Entry) && (Entry->Item<0))
+        {
+            Items[ItemsCount].Area=Entry->Area;
+            Items[ItemsCount].WordLen=Entry->WordLen;
+            Items[ItemsCount].DBNumber=Entry->DBNumber;
+            Items[ItemsCount].Start=Entry->Start;
+            Items[ItemsCount].Amount=Entry->Amount;
+            Items[ItemsCount].pdata=Entry->pData;
+            Items[ItemsCount].Result=0;
+            Entry->Item=ItemsCount++;
+        }
+
+    WritePacked(Items, ItemsCount);
+
+    // A merged segment refused by the PLC (while the link is up) is written
+    // again entry by entry, in arrival order, to fail only the bad ones
+    for (Entry = Batch->Head; Entry!=NULL; Entry=Entry->Next)
+    {
+        Entry->Result=Items[Entry->Item].Result;
+        if ((Entry->Result!=0) && (Entry->Item<SegCount) && (Segments[Entry->Item].Entries>1) && Connected)
+            Entry->Result=TSnap7MicroClient::WriteArea(Entry->Area, Entry->DBNumber,
+                Entry->Start, Entry->Amount, Entry->WordLen, Entry->pData);
+    }
+    for (c = 0; c < SegCount; c++)
+        delete[] Segments[c].Data;
+    delete[] Items;
+    delete[] Segments;
+    delete[] Sorted;
 }
+//---------------------------------------------------------------------------
+// Every bit is a bit-transport item (Amount = 1), WritePacked fills the PDUs.
+// Returns 0 if all the bits were written, otherwise the first item error.
+int TSnap7Client::WriteBits(PS7BitItem Item, int ItemsCount)
+{
+    PS7DataItem Items;
+    byte *Values;
+    int Count = 0;
+    int Result = 0;
+    int c;
+
+    if ((Item==NULL) || (ItemsCount<1))
+        return SetError(errCliInvalidParams);
+    Items = new TS7DataItem[ItemsCount];
+    Values = new byte[ItemsCount];
+    for (c = 0; c < ItemsCount; c++)
+    {
+        if ((Item[c].Bit<0) || (Item[c].Bit>7) || (Item[c].Byte<0))
+        {
+            Item[c].Result=errCliInvalidParams;
+            continue;
+        }
+        Values[Count]=Item[c].Value ? 1 : 0;
+        Items[Count].Area=Item[c].Area;
+        Items[Count].WordLen=S7WLBit;
+        Items[Count].DBNumber=Item[c].DBNumber;
+        Items[Count].Start=Item[c].Byte*8+Item[c].Bit;
+        Items[Count].Amount=1;
+        Items[Count].pdata=&Values[Count];
+        Items[Count].Result=0;
+        Count++;
+    }
+    WritePacked(Items, Count);
 
+    Count=0;
+    for (c = 0; c < ItemsCount; c++)
+    {
+        if ((Item[c].Bit>=0) && (Item[c].Bit<=7) && (Item[c].Byte>=0))
+            Item[c].Result=Items[Count++].Result;
+        if ((Result==0) && (Item[c].Result!=0))
+            Result=Item[c].Result;
+    }
+    delete[] Values;
+    delete[] Items;
+    return Result;
+}
+//---------------------------------------------------------------------------
+// BACKGROUND RECONNECTION
+//---------------------------------------------------------------------------
+int TSnap7Client::Connect()
+{
+    int Result;
+    StopReconnect(); // the application takes over
+    if (ShareSession)
+    {
+        JobStart=SysGetTick();
+        Family=plcUnknown;
+        if (FShared==NULL)
+            Result=TSnap7Session::Attach(this, FShared);
+        else
+            Result=0;
+        if (Result==0)
+        {
+            Connected=true;
+            PDULength=FShared->PDULength();
+            SetLinkState(lsConnected, 0);
+        }
+        else
+            SetLinkState(lsDisconnected, Result);
+        Job.Time=SysGetTick()-JobStart;
+        EvtLinkUp->Set();
+        return Result;
+    }
+    Result=TSnap7MicroClient::Connect();
+    if (Result==0)
+    {
+        LinkWanted=true;
+        LastPDU=PDULength;
+        SetLinkState(lsConnected, 0);
+    }
+    else
+        SetLinkState(lsDisconnected, Result);
+    EvtLinkUp->Set();
+    return Result;
+}
+//---------------------------------------------------------------------------
+// FLEET CONNECTION
+//---------------------------------------------------------------------------
+class TFleetThread: public TSnapThread
+{
+private:
+    PS7FleetItem FItems;
+    int FCount;
+    int FTimeout;
+    volatile int *FNext;
+    PSnapCriticalSection FCS;
+    void ConnectItem(PS7FleetItem Item);
+public:
+    TFleetThread(PS7FleetItem Items, int Count, int Timeout, volatile int *Next, PSnapCriticalSection CS)
+    {
+        FItems = Items;
+        FCount = Count;
+        FTimeout = Timeout;
+        FNext = Next;
+        FCS = CS;
+    }
+    void Execute();
+};
+//---------------------------------------------------------------------------
+void TFleetThread::ConnectItem(PS7FleetItem Item)
+{
+    TSnap7Client *Client = Item->Client;
+    longword Start = SysGetTick();
+    int Ping;
+
+    if (Client==NULL)
+    {
+        Item->Result=errCliInvalidParams;
+        Item->Time=0;
+        return;
+    }
+    // The TCP connection is bounded by PingTimeout, ISO handshake and PDU
+    // negotiation by the Deadline of the socket
+    Ping=Client->PingTimeout;
+    Client->PingTimeout=FTimeout;
+    Client->Deadline=(Start+longword(FTimeout)) | 1;
+    Item->Result=Client->ConnectTo(Item->Address, Item->Rack, Item->Slot);
+    Client->Deadline=0;
+    Client->PingTimeout=Ping;
+    Item->Time=int(SysGetTick()-Start);
+}
+//---------------------------------------------------------------------------
+void TFleetThread::Execute()
+{
+    int Index;
+    while (!Terminated)
+    {
+        FCS->Enter();
+        Index=*FNext;
+        if (Index<FCount)
+            *FNext=Index+1;
+        FCS->Leave();
+        if (Index>=FCount)
+            break;
+        ConnectItem(&FItems[Index]);
+    }
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::ConnectFleet(PS7FleetItem Items, int ItemsCount, int MaxParallel, int Timeout)
+{
+    TSnapCriticalSection CS;
+    TFleetThread **Threads;
+    volatile int Next = 0;
+    longword Wait;
+    int Count, c, i;
+
+    if ((Items==NULL) || (ItemsCount<1) || (Timeout<1))
+        return errCliInvalidParams;
+    // A worker for each connection in progress
+    Count=MaxParallel;
+    if (Count>ItemsCount)
+        Count=ItemsCount;
+    if (Count>MaxFleetThreads)
+        Count=MaxFleetThreads;
+    if (Count<1)
+        Count=1;
+
+    Threads=new TFleetThread*[Count];
+    for (c = 0; c < Count; c++)
+    {
+        Threads[c]=new TFleetThread(Items, ItemsCount, Timeout, &Next, &CS);
+        Threads[c]->Start();
+    }
+    // Every item ends within its deadline (+ the send timeouts). Late workers
+    // are never canceled : they stop picking items and we wait for the end of
+    // their current connection, which is bounded by its own deadline.
+    Wait=longword((ItemsCount+Count-1)/Count)*longword(Timeout)+5000;
+    for (c = 0; c < Count; c++)
+    {
+        if (Threads[c]->WaitFor(Wait)!=WAIT_OBJECT_0)
+        {
+            for (i = 0; i < Count; i++)
+                Threads[i]->Terminate();
+            while (Threads[c]->WaitFor(Timeout+5000)!=WAIT_OBJECT_0);
+        }
+        delete Threads[c];
+    }
+    delete[] Threads;
+    // Items never started
+    for (c = Next; c < ItemsCount; c++)
+    {
+        Items[c].Result=errCliJobTimeout;
+        Items[c].Time=0;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::SetLinkCallback(pfn_CliLinkState pCallback, void * usrPtr)
+{
+    CliLinkState=pCallback;
+    FLinkUsrPtr=usrPtr;
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::GetLinkState(int &State)
+{
+    State=LinkState;
+    return 0;
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::SetLinkState(int State, int Error)
+{
+    if (State==LinkState)
+        return;
+    LinkState=State;
+    if ((CliLinkState!=NULL) && !Destroying)
+    {
+        try{
+            CliLinkState(FLinkUsrPtr, State, Error);
+        }catch (...)
+        {
+        }
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::StopReconnect()
+{
+    LinkWanted=false;
+    if (FReconnect!=NULL)
+    {
+        EvtReconnectStop->Set();
+        EvtReconnectIdle->WaitForever();
+    }
+}
+//---------------------------------------------------------------------------
+bool TSnap7Client::LinkReady()
+{
+    longword Elapsed;
+    int Timeout;
+
+    if ((ReconnectMode==rmNone) || !LinkWanted)
+        return true;
+    // Dropped between two jobs
+    if ((LinkState==lsConnected) && !Connected)
+        LinkLost(0);
+    if (LinkState==lsConnected)
+        return true;
+    if (ReconnectMode==rmFailFast)
+        return false;
+
+    // Queued up to the job deadline, or ReconnectMax
+    if (Job.Deadline!=0)
+        Timeout=int(Job.Deadline-SysGetTick());
+    else
+        Timeout=ReconnectMax;
+    Elapsed=SysGetTick();
+    while ((LinkState!=lsConnected) && LinkWanted && (CancelRequest!=JobSerial) &&
+           (int(DeltaTime(Elapsed))<Timeout))
+        EvtLinkUp->WaitFor(50); // short slices to honor CancelJob
+    return LinkState==lsConnected;
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::LinkLost(int Error)
+{
+    if ((ReconnectMode==rmNone) || !LinkWanted || (LinkState!=lsConnected))
+        return;
+    EvtLinkUp->Reset();
+    SetLinkState(lsReconnecting, Error);
+    if (FReconnect==NULL)
+    {
+        EvtReconnect = new TSnapEvent(false);
+        EvtReconnectStop = new TSnapEvent(true);
+        EvtReconnectIdle = new TSnapEvent(true);
+        EvtReconnectIdle->Set();
+        FReconnect = new TReconnectThread(this);
+        FReconnect->Start();
+    }
+    EvtReconnectStop->Reset();
+    EvtReconnectIdle->Reset();
+    EvtReconnect->Set();
+}
+//---------------------------------------------------------------------------
+void TSnap7Client::Reconnect()
+{
+    int Delay = ReconnectMin>0 ? ReconnectMin : 1;
+    int Wait, Result, Request;
+
+    while (LinkWanted)
+    {
+        // Exponential backoff, the jitter (on half the delay) prevents many
+        // clients from knocking at the same time when a PLC comes back
+        JitterSeed=JitterSeed*1103515245+12345;
+        Wait=Delay/2+int((JitterSeed>>16) % longword(Delay/2+1));
+        if (EvtReconnectStop->WaitFor(Wait)==WAIT_OBJECT_0)
+            return;
+        // Same TSAPs, and we ask for the PDU size we had
+        Request=PDURequest;
+        if (LastPDU>0)
+            PDURequest=LastPDU;
+        PeerDisconnect();
+        AddRetry();
+        Result=PeerConnect();
+        PDURequest=Request;
+        if (Result==0)
+        {
+            if (LinkWanted)
+            {
+                SetLinkState(lsConnected, 0);
+                EvtLinkUp->Set();
+            }
+            return;
+        }
+        Delay*=2;
+        if (Delay>ReconnectMax)
+            Delay=ReconnectMax;
+    }
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::GetHedgeStats(PS7HedgeStats pStats, bool DoReset)
+{
+    HedgeStats.Threshold=HedgePercentile>0 ? GetHedgeThreshold() : 0;
+    *pStats=HedgeStats;
+    if (DoReset)
+    {
+        HedgeStats.Reads=0;
+        HedgeStats.Hedged=0;
+        HedgeStats.Won=0;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::GetDemuxStats(PS7DemuxStats pStats, bool DoReset)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    if (FShared!=NULL)
+        FShared->GetDemuxStats(pStats, DoReset);
+    else
+        TIsoTcpSocket::GetDemuxStats(pStats, DoReset);
+    return 0;
+}
+//---------------------------------------------------------------------------
+// A shared connection has a single hook : the last client setting it wins
+int TSnap7Client::SetDemuxCallback(pfn_DemuxLog pCallback, void *usrPtr)
+{
+    SetDemuxLog(pCallback, usrPtr);
+    if (FShared!=NULL)
+        FShared->SetDemuxLog(pCallback, usrPtr);
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::GetMemory(PS7MemoryInfo pInfo)
+{
+    longword Lent;
+
+    if (pInfo==NULL)
+        return errCliInvalidParams;
+    pInfo->Sessions=1;
+    pInfo->Fixed=sizeof(TSnap7Client);
+    pInfo->Buffers=BuffersSize()+HedgeDataSize+DiagBufferSize;
+    if (FHedge!=NULL)
+    {
+        pInfo->Sessions++;
+        pInfo->Fixed+=sizeof(TSnap7MicroClient);
+        pInfo->Buffers+=FHedge->BuffersSize();
+    }
+    ClientDataPool()->Usage(Lent, pInfo->Pooled);
+    pInfo->PerSession=(pInfo->Fixed+pInfo->Buffers)/pInfo->Sessions;
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Client::SetDiagCallback(pfn_CliDiagEvent pCallback, void *usrPtr)
+{
+    CliDiagEvent=pCallback;
+    FDiagUsrPtr=usrPtr;
+    return 0;
+}
+//---------------------------------------------------------------------------
+// Reads the Want most recent entries of the diagnostic buffer (newest first)
+int TSnap7Client::DiagRead(int Want, int &Count)
+{
+    PSZL_HEADER Header;
+    int Size, Result;
+
+    Size=int(sizeof(SZL_HEADER))+Want*DiagEntrySize;
+    if (Size>DiagBufferSize)
+    {
+        delete[] DiagBuffer;
+        DiagBuffer=new byte[Size];
+        DiagBufferSize=Size;
+    }
+    Count=0;
+    Result=ReadSZL(0x01A0, Want, PS7SZL(DiagBuffer), Size);
+    if (Result==0)
+    {
+        Header=PSZL_HEADER(DiagBuffer);
+        Count=(Size-int(sizeof(SZL_HEADER)))/DiagEntrySize;
+        if (Header->N_DR<Count)
+            Count=Header->N_DR;
+        if ((Count>0) && (Header->LENTHDR!=DiagEntrySize))
+        {
+            Count=0;
+            Result=SetError(errCliInvalidDataSizeRecvd);
+        }
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+// Steady state costs a one entry SZL : more entries are asked (x4 each time)
+// only when the newest one changed, until the last one seen is among them or
+// the whole buffer is read (buffer wrapped or cleared : all of it is new).
+int TSnap7Client::DiagTail(int &NewEvents)
+{
+    TS7DiagEntry Entry;
+    pbyte Entries;
+    int Want, Count, Found, Result, c;
+
+    NewEvents=0;
+    Want=1;
+    Result=DiagRead(Want, Count);
+    Entries=DiagBuffer+sizeof(SZL_HEADER);
+    if ((Result!=0) || !DiagSynced)
+    {
+        // First call : only the reference
+        if (Result==0)
+        {
+            if (Count>0)
+                memcpy(DiagLast, Entries, DiagEntrySize);
+            else
+                memset(DiagLast, 0, DiagEntrySize);
+            DiagSynced=true;
+        }
+        return Result;
+    }
+
+    Found=-1;
+    while (Result==0)
+    {
+        Entries=DiagBuffer+sizeof(SZL_HEADER);
+        for (c = 0; c < Count; c++)
+            if (memcmp(Entries+c*DiagEntrySize, DiagLast, DiagEntrySize)==0)
+            {
+                Found=c;
+                break;
+            }
+        if ((Found>=0) || (Count<Want) || (Want>=DiagMaxEntries))
+            break;
+        if (Want==1)
+            Want=DiagFirstStep;
+        else
+            Want*=4;
+        if (Want>DiagMaxEntries)
+            Want=DiagMaxEntries;
+        Result=DiagRead(Want, Count);
+    }
+    if (Result!=0)
+        return Result;
+
+    // Entries before the one found are new, delivered oldest first
+    if (Found>=0)
+        NewEvents=Found;
+    else
+        NewEvents=Count;
+    for (c = NewEvents-1; c >= 0; c--)
+    {
+        if (CliDiagEvent!=NULL)
+        {
+            memcpy(&Entry, Entries+c*DiagEntrySize, DiagEntrySize);
+            Entry.EventID=SwapWord(Entry.EventID);
+            CliDiagEvent(FDiagUsrPtr, &Entry);
+        }
+    }
+    if (NewEvents>0)
+        memcpy(DiagLast, Entries, DiagEntrySize);
+    return 0;
+}
+//---------------------------------------------------------------------------
+void TClientThread::Execute()
+{
+     while (!Terminated)
+     {
+          FClient->EvtJob->WaitForever();
+          if (!Terminated)
+          {
+               // The descriptor is signaled by JobCompleted()
+               FClient->AsRunning=true;
+               FClient->PerformOperation();
+               FClient->AsRunning=false;
+               FClient->EvtComplete->Set();
+               // Notify the caller the end of job (if callback is set)
+               FClient->DoCompletion();
+          }
+     };
+}
+//---------------------------------------------------------------------------
+void TReconnectThread::Execute()
+{
+     while (!Terminated)
+     {
+          FClient->EvtReconnect->WaitForever();
+          if (!Terminated)
+               FClient->Reconnect();
+          FClient->EvtReconnectIdle->Set();
+     };
+}
+//---------------------------------------------------------------------------
+void THedgeThread::Execute()
+{
+     while (!Terminated)
+     {
+          FClient->EvtHedgeStart->WaitForever();
+          if (!Terminated)
+               FClient->PerformHedge();
+          FClient->HedgeBusy=false;
+          FClient->EvtHedgeIdle->Set();
+     };
+}
+//***************************************************************************
+// SHARED SESSIONS
+//***************************************************************************
+static TSnapCriticalSection SessionsCS;
+static TSnap7Session *Sessions = NULL;
+//---------------------------------------------------------------------------
+TSnap7SessionPeer::TSnap7SessionPeer(TSnap7Session *Session)
+{
+    FSession = Session;
+    SavedPDU = NULL;
+    SavedData = NULL;
+}
+//---------------------------------------------------------------------------
+TSnap7SessionPeer::~TSnap7SessionPeer()
+{
+    delete SavedPDU;
+    if (SavedData!=NULL)
+        ClientDataPool()->Release(SavedData);
+}
+//---------------------------------------------------------------------------
+int TSnap7SessionPeer::ThrottleExchange(int Size)
+{
+    FSession->Yield();
+    return TSnap7MicroClient::ThrottleExchange(Size);
+}
+//---------------------------------------------------------------------------
+// The job in progress is suspended before an exchange : its request is
+// already in PDU, its partial data may be in opData
+void TSnap7SessionPeer::SaveJob()
+{
+    if (SavedPDU==NULL)
+        SavedPDU = new TIsoDataPDU;
+    SavedJob=Job;
+    memcpy(SavedPDU, &PDU, sizeof(TIsoDataPDU));
+    // The buffer goes with the job, the preempting one borrows its own
+    SavedData=opData;
+    opData=NULL;
+    SavedSize=opSize;
+    SavedStart=JobStart;
+    SavedTimeout=JobTimeout;
+    SavedDeadline=Deadline;
+    // The preempting job runs as the next serial and clears the stamps
+    SavedSerial=JobSerial;
+    SavedCancel=CancelRequest;
+    SavedStamps=JobStamps;
+}
+//---------------------------------------------------------------------------
+void TSnap7SessionPeer::RestoreJob()
+{
+    Job=SavedJob;
+    memcpy(&PDU, SavedPDU, sizeof(TIsoDataPDU));
+    FreeData();
+    opData=SavedData;
+    SavedData=NULL;
+    opSize=SavedSize;
+    JobStart=SavedStart;
+    JobTimeout=SavedTimeout;
+    Deadline=SavedDeadline;
+    JobSerial=SavedSerial;
+    CancelRequest=SavedCancel;
+    JobStamps=SavedStamps;
+}
+//---------------------------------------------------------------------------
+void TSnap7SessionPeer::ExpireJob(bool Canceled)
+{
+    if (Canceled)
+        CancelRequest=JobSerial;
+    Deadline=SysGetTick() | 1;
+}
+//---------------------------------------------------------------------------
+TSnap7Session::TSnap7Session(TSnap7Client *Client)
+{
+    Peer = new TSnap7SessionPeer(this);
+    Peer->CopySettings(Client);
+    Next = NULL;
+    RefCount = 0;
+    CS = new TSnapCriticalSection();
+    Busy = false;
+    Owner = NULL;
+    QueueHead = NULL;
+    QueueTail = NULL;
+    HighHead = NULL;
+    HighTail = NULL;
+}
+//---------------------------------------------------------------------------
+TSnap7Session::~TSnap7Session()
+{
+    Peer->Disconnect();
+    delete Peer;
+    delete CS;
+}
+//---------------------------------------------------------------------------
+// Must be called inside CS
+bool TSnap7Session::Unlink(TSnap7Client *&Head, TSnap7Client *&Tail, TSnap7Client *Client)
+{
+    TSnap7Client *Prev = NULL;
+    TSnap7Client *Item = Head;
+
+    while ((Item!=NULL) && (Item!=Client))
+    {
+        Prev=Item;
+        Item=Item->ShareNext;
+    }
+    if (Item==NULL)
+        return false;
+    if (Prev==NULL)
+        Head=Item->ShareNext;
+    else
+        Prev->ShareNext=Item->ShareNext;
+    if (Tail==Item)
+        Tail=Prev;
+    return true;
+}
+//---------------------------------------------------------------------------
+// Must be called inside CS
+void TSnap7Session::Dequeue(TSnap7Client *Client)
+{
+    if (!Unlink(HighHead, HighTail, Client))
+        Unlink(QueueHead, QueueTail, Client);
+    Client->ShareQueued=false;
+}
+//---------------------------------------------------------------------------
+bool TSnap7Session::Queued(TSnap7Client *Client)
+{
+    bool Result;
+    CS->Enter();
+    Result=Client->ShareQueued;
+    CS->Leave();
+    return Result;
+}
+//---------------------------------------------------------------------------
+// Waits until the session is handed over to Client (0), its job is canceled or
+// its deadline expires. In the last two cases the client is still queued.
+int TSnap7Session::WaitTurn(TSnap7Client *Client, longword Deadline)
+{
+    int Slice;
+    while (Queued(Client))
+    {
+        if (Client->CancelRequest==Client->JobSerial)
+            return errCliJobCanceled;
+        Slice=ShareTurnSlice;
+        if (Deadline!=0)
+        {
+            if (int(Deadline-SysGetTick())<=0)
+                return errCliJobTimeout;
+            if (int(Deadline-SysGetTick())<Slice)
+                Slice=int(Deadline-SysGetTick());
+        }
+        Client->EvtTurn->WaitFor(Slice);
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Session::Acquire(TSnap7Client *Client, longword Deadline)
+{
+    int Result;
+
+    CS->Enter();
+    if (!Busy)
+    {
+        Busy=true;
+        CS->Leave();
+        return 0;
+    }
+    // Queued : Release() hands the session over to the head of the queue
+    Client->ShareNext=NULL;
+    Client->ShareQueued=true;
+    if (Client->JobPriority==jpHigh)
+    {
+        if (HighTail!=NULL)
+            HighTail->ShareNext=Client;
+        else
+            HighHead=Client;
+        HighTail=Client;
+    }
+    else
+    {
+        if (QueueTail!=NULL)
+            QueueTail->ShareNext=Client;
+        else
+            QueueHead=Client;
+        QueueTail=Client;
+    }
+    CS->Leave();
+    Result=WaitTurn(Client, Deadline);
+    if (Result!=0)
+    {
+        // Out of the queue, unless the session came to us meanwhile
+        CS->Enter();
+        if (Client->ShareQueued)
+            Dequeue(Client);
+        else
+            Result=0;
+        CS->Leave();
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+void TSnap7Session::Release()
+{
+    TSnap7Client *Client;
+    CS->Enter();
+    Owner=NULL;
+    Client=HighHead;
+    if (Client!=NULL)
+    {
+        HighHead=Client->ShareNext;
+        if (HighHead==NULL)
+            HighTail=NULL;
+    }
+    else
+    {
+        Client=QueueHead;
+        if (Client!=NULL)
+        {
+            QueueHead=Client->ShareNext;
+            if (QueueHead==NULL)
+                QueueTail=NULL;
+        }
+    }
+    if (Client!=NULL)
+    {
+        Client->ShareQueued=false;
+        Client->EvtTurn->Set(); // still Busy, now on his behalf
+    }
+    else
+        Busy=false;
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+void TSnap7Session::Yield()
+{
+    TSnap7Client *Client, *Urgent;
+    longword Deadline;
+    int Result;
+
+    CS->Enter();
+    Client=Owner;
+    if (Client==NULL)
+    {
+        CS->Leave();
+        return;
+    }
+    // Canceled by the client : the job stops here
+    if (Client->CancelRequest==Client->JobSerial)
+    {
+        CS->Leave();
+        Peer->ExpireJob(true);
+        return;
+    }
+    if ((HighHead==NULL) || (Client->JobPriority!=jpNormal))
+    {
+        CS->Leave();
+        return;
+    }
+    Urgent=HighHead;
+    HighHead=Urgent->ShareNext;
+    if (HighHead==NULL)
+        HighTail=NULL;
+    Urgent->ShareQueued=false;
+    // We resume first among the normal jobs
+    Client->ShareQueued=true;
+    Client->ShareNext=QueueHead;
+    QueueHead=Client;
+    if (QueueTail==NULL)
+        QueueTail=Client;
+    Deadline=Peer->Deadline;
+    Peer->SaveJob();
+    Owner=NULL;
+    Urgent->EvtTurn->Set();
+    CS->Leave();
+
+    Result=WaitTurn(Client, Deadline);
+    if (Result!=0)
+    {
+        // Expired or canceled while suspended : the connection still belongs to
+        // the urgent job, we take it first (before any other urgent one) to
+        // end our job at once
+        CS->Enter();
+        if (Client->ShareQueued)
+        {
+            Dequeue(Client);
+            Client->ShareQueued=true;
+            Client->ShareNext=HighHead;
+            HighHead=Client;
+            if (HighTail==NULL)
+                HighTail=Client;
+        }
+        CS->Leave();
+        while (Queued(Client))
+            Client->EvtTurn->WaitFor(ShareTurnSlice);
+    }
+    Peer->RestoreJob();
+    if (Result!=0)
+        Peer->ExpireJob(Result==errCliJobCanceled);
+    CS->Enter();
+    Owner=Client;
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+int TSnap7Session::Perform(TSnap7Client *Client, TSnap7Job &Job, longword Start, int Timeout)
+{
+    int Result = Acquire(Client, Job.Deadline);
+    if (Result!=0)
+    {
+        Job.Result=Result;
+        return Result;
+    }
+    // The connection may have been lost during a previous job
+    if (!Peer->Connected)
+        Result=Peer->Connect();
+    if ((Result==0) && (Client->CancelRequest==Client->JobSerial))
+        Result=errCliJobCanceled;
+    if (Result==0)
+    {
+        // Only a job in progress yields the connection, never a connection
+        // being established
+        CS->Enter();
+        Owner=Client;
+        CS->Leave();
+        // The data staged by the caller (Download, SetSessionPassword) goes
+        // with the job, the peer gives the buffer back at its end
+        Peer->opData=Client->opData;
+        Client->opData=NULL;
+        Result=Peer->PerformJob(Job, Start, Timeout);
+        CS->Enter();
+        Owner=NULL;
+        CS->Leave();
+    }
+    else
+        Job.Result=Result;
+    Peer->GetJobStamps(&Client->JobStamps);
+    Release();
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Session::PDULength()
+{
+    return Peer->PDULength;
+}
+//---------------------------------------------------------------------------
+void TSnap7Session::GetDemuxStats(PS7DemuxStats pStats, bool DoReset)
+{
+    Peer->GetDemuxStats(pStats, DoReset);
+}
+//---------------------------------------------------------------------------
+void TSnap7Session::SetDemuxLog(pfn_DemuxLog Log, void *usrPtr)
+{
+    Peer->SetDemuxLog(Log, usrPtr);
+}
+//---------------------------------------------------------------------------
+bool TSnap7Session::Connected()
+{
+    return Peer->Connected;
+}
+//---------------------------------------------------------------------------
+int TSnap7Session::Attach(TSnap7Client *Client, TSnap7Session *&Session)
+{
+    TSnap7Session *Item;
+    int Result = 0;
+
+    SessionsCS.Enter();
+    Item=Sessions;
+    while (Item!=NULL)
+    {
+        if ((strcmp(Item->Peer->RemoteAddress, Client->RemoteAddress)==0) &&
+            (Item->Peer->RemotePort==Client->RemotePort) &&
+            (Item->Peer->SrcTSap==Client->SrcTSap) &&
+            (Item->Peer->DstTSap==Client->DstTSap))
+            break;
+        Item=Item->Next;
+    }
+    if (Item==NULL)
+    {
+        Item=new TSnap7Session(Client);
+        Item->Next=Sessions;
+        Sessions=Item;
+    }
+    Item->RefCount++;
+    SessionsCS.Leave();
+
+    // The first client (or the first after a link loss) connects it
+    Result=Item->Acquire(Client, 0);
+    if (Result==0)
+    {
+        if (!Item->Peer->Connected)
+            Result=Item->Peer->Connect();
+        Item->Release();
+    }
+
+    if (Result==0)
+        Session=Item;
+    else
+        Detach(Item);
+    return Result;
+}
+//---------------------------------------------------------------------------
+void TSnap7Session::Detach(TSnap7Session *Session)
+{
+    TSnap7Session **Link;
+
+    SessionsCS.Enter();
+    Session->RefCount--;
+    if (Session->RefCount>0)
+    {
+        SessionsCS.Leave();
+        return;
+    }
+    Link=&Sessions;
+    while ((*Link!=NULL) && (*Link!=Session))
+        Link=&(*Link)->Next;
+    if (*Link!=NULL)
+        *Link=Session->Next;
+    SessionsCS.Leave();
+    delete Session;
+}
+//***************************************************************************
+// CLIENT POOL
+//***************************************************************************
+TSnap7Pool::TSnap7Pool()
+{
+    memset(Sessions,0,sizeof(Sessions));
+    memset(Info,0,sizeof(Info));
+    memset(ErrorsInRow,0,sizeof(ErrorsInRow));
+    memset(FailTime,0,sizeof(FailTime));
+    Count = 1;
+    PoolSize = 4;
+    PoolReserve = 2;
+    Active = false;
+    CS = new TSnapCriticalSection();
+    EvtRelease = new TSnapEvent(true);
+    // Session 0 holds the connection params for the others
+    Sessions[0] = new TSnap7Client();
+}
+//---------------------------------------------------------------------------
+TSnap7Pool::~TSnap7Pool()
+{
+    Disconnect();
+    for (int c = 0; c < MaxPoolSessions; c++)
+        if (Sessions[c]!=NULL)
+            delete Sessions[c];
+    delete EvtRelease;
+    delete CS;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::GetParam(int ParamNumber, void *pValue)
+{
+    switch (ParamNumber)
+    {
+    case p_i32_PoolSize:
+        *Pint32_t(pValue)=PoolSize;
+        break;
+    case p_i32_PoolReserve:
+        *Pint32_t(pValue)=PoolReserve;
+        break;
+    default:
+        return Sessions[0]->GetParam(ParamNumber, pValue);
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::SetParam(int ParamNumber, void *pValue)
+{
+    int Value;
+    int Result = 0;
+    switch (ParamNumber)
+    {
+    case p_i32_PoolSize:
+        Value=*Pint32_t(pValue);
+        if ((Value<1) || (Value>MaxPoolSessions))
+            return errCliInvalidParams;
+        PoolSize=Value;
+        break;
+    case p_i32_PoolReserve:
+        Value=*Pint32_t(pValue);
+        if (Value<0)
+            return errCliInvalidParams;
+        PoolReserve=Value;
+        break;
+    default:
+        // Client params go to every session
+        for (int c = 0; (c < MaxPoolSessions) && (Result==0); c++)
+            if (Sessions[c]!=NULL)
+                Result=Sessions[c]->SetParam(ParamNumber, pValue);
+        return Result;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+void TSnap7Pool::SetConnectionParams(const char *RemAddress, word LocalTSAP, word RemoteTsap)
+{
+    Sessions[0]->SetConnectionParams(RemAddress, LocalTSAP, RemoteTsap);
+}
+//---------------------------------------------------------------------------
+void TSnap7Pool::SetConnectionType(word ConnType)
+{
+    Sessions[0]->SetConnectionType(ConnType);
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::ConnectTo(const char *RemAddress, int Rack, int Slot)
+{
+    int Result;
+    Disconnect();
+    Result=Sessions[0]->ConnectTo(RemAddress, Rack, Slot);
+    if (Result==0)
+        Result=Connect();
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::Connect()
+{
+    TS7Capabilities Caps;
+    int Result = 0;
+    int Allowed = PoolSize;
+
+    if (!Sessions[0]->Connected)
+        Result=Sessions[0]->Connect();
+    if (Result!=0)
+        return Result;
+    // The PLC tells how many connections it accepts, or its family profile
+    if (Sessions[0]->GetCapabilities(&Caps)==0)
+    {
+        if (Caps.MaxConnections-PoolReserve<Allowed)
+            Allowed=Caps.MaxConnections-PoolReserve;
+    }
+    if (Allowed<1)
+        Allowed=1;
+    CS->Enter();
+    Count=Allowed;
+    Info[0].Connected=true;
+    Active=true;
+    CS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::Disconnect()
+{
+    longword Elapsed;
+    bool Busy;
+    int c;
+    int Result = 0;
+    // Waits the sessions in use (they are given back at the end of their job)
+    // up to PoolWaitTime. A session still leased then has its job canceled and
+    // is closed when it's given back.
+    CS->Enter();
+    Active=false;
+    CS->Leave();
+    Elapsed=SysGetTick();
+    for (c = 0; c < MaxPoolSessions; c++)
+        if (Sessions[c]!=NULL)
+        {
+            for (;;)
+            {
+                CS->Enter();
+                Busy=Info[c].Busy!=0;
+                if (Busy)
+                    EvtRelease->Reset();
+                CS->Leave();
+                if (!Busy || (DeltaTime(Elapsed)>=longword(PoolWaitTime)))
+                    break;
+                EvtRelease->WaitFor(PoolWaitTime-int(DeltaTime(Elapsed)));
+            }
+            if (Busy)
+            {
+                Sessions[c]->CancelJob();
+                Result=errCliJobTimeout;
+                continue;
+            }
+            Sessions[c]->Disconnect();
+            Info[c].Connected=false;
+            ErrorsInRow[c]=0;
+            FailTime[c]=0;
+        }
+    return Result;
+}
+//---------------------------------------------------------------------------
+// Must be called inside CS : returns an idle session (marked busy) or -1.
+// With CanOpen a session not connected can be returned : the caller connects it.
+int TSnap7Pool::TryAcquire(bool CanOpen)
+{
+    int c;
+    if (!Active)
+        return -1;
+    for (c = 0; c < Count; c++)
+        if (!Info[c].Busy && (Sessions[c]!=NULL) && Sessions[c]->Connected)
+        {
+            Info[c].Busy=true;
+            return c;
+        }
+    if (CanOpen)
+        for (c = 0; c < Count; c++)
+            if (!Info[c].Busy && ((FailTime[c]==0) || (DeltaTime(FailTime[c])>=longword(PoolRetryTime))))
+            {
+                if (Sessions[c]==NULL)
+                {
+                    Sessions[c]=new TSnap7Client();
+                    Sessions[c]->CopySettings(Sessions[0]);
+                }
+                Info[c].Busy=true;
+                return c;
+            }
+    return -1;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::Acquire(int &Index, int Timeout)
+{
+    longword Elapsed = SysGetTick();
+    int Result;
+    for (;;)
+    {
+        CS->Enter();
+        if (!Active)
+        {
+            CS->Leave();
+            return WSAENOTCONN; // as a TCP error
+        }
+        Index=TryAcquire(true);
+        if (Index<0)
+            EvtRelease->Reset();
+        CS->Leave();
+
+        if (Index>=0)
+        {
+            if (Sessions[Index]->Connected)
+                return 0;
+            Result=Sessions[Index]->Connect();
+            if (Result==0)
+                return 0;
+            Release(Index, Result);
+        }
+        else
+            if ((DeltaTime(Elapsed)>=longword(Timeout)) ||
+                (EvtRelease->WaitFor(Timeout-int(DeltaTime(Elapsed)))!=WAIT_OBJECT_0))
+                return errCliJobTimeout;
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7Pool::Release(int Index, int Result)
+{
+    TSnap7Client *Session = Sessions[Index];
+    bool Transport = ((Result & 0x000FFFFF)!=0) || (Result==int(errCliJobTimeout));
+
+    CS->Enter();
+    Info[Index].Jobs++;
+    Info[Index].LastTime=Session->Time();
+    if (Result!=0)
+    {
+        Info[Index].Errors++;
+        Info[Index].LastError=Result;
+    }
+    ErrorsInRow[Index]=Transport ? ErrorsInRow[Index]+1 : 0;
+    // Given back after the pool was disconnected
+    if (!Active && Session->Connected)
+        Session->Disconnect();
+    if (!Session->Connected || (ErrorsInRow[Index]>=PoolMaxErrors))
+    {
+        // Unhealthy : closed and reopened later
+        if (Session->Connected)
+            Session->Disconnect();
+        FailTime[Index]=SysGetTick();
+        ErrorsInRow[Index]=0;
+    }
+    Info[Index].Connected=Session->Connected;
+    Info[Index].Busy=false;
+    EvtRelease->Set();
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::Stripe(bool Read, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    int Index[MaxPoolSessions];
+    int Used = 1;
+    int WordSize, PDULength, MaxElements, PDUs, SliceElements, Elements, Offset, c, Result;
+    int SliceStart;
+    TSnap7Client *Session;
+
+    Result=Acquire(Index[0], PoolWaitTime);
+    if (Result!=0)
+        return Result;
+    Session=Sessions[Index[0]];
+    WordSize=Session->DataSizeByte(WordLen);
+
+    // Invalid params and bits are left to the session
+    if ((WordSize>0) && (Amount>1))
+    {
+        // One session per PDU at most, we don't wait for the busy ones
+        PDULength=Session->PDULength;
+        if (Read)
+            MaxElements=(PDULength-sizeof(TS7ResHeader23)-sizeof(TResFunReadParams)-4) / WordSize;
+        else
+            MaxElements=(PDULength-sizeof(TS7ReqHeader)-sizeof(TReqFunWriteItem)-6) / WordSize;
+        PDUs=(MaxElements>0) ? (Amount+MaxElements-1)/MaxElements : 1;
+        CS->Enter();
+        while (Used<PDUs)
+        {
+            c=TryAcquire(false);
+            if (c<0)
+                break;
+            // The negotiated PDU could be different
+            if (Sessions[c]->PDULength<PDULength)
+            {
+                PDULength=Sessions[c]->PDULength;
+                if (Read)
+                    MaxElements=(PDULength-sizeof(TS7ResHeader23)-sizeof(TResFunReadParams)-4) / WordSize;
+                else
+                    MaxElements=(PDULength-sizeof(TS7ReqHeader)-sizeof(TReqFunWriteItem)-6) / WordSize;
+            }
+            Index[Used++]=c;
+        }
+        CS->Leave();
+    }
+
+    if (Used==1)
+    {
+        if (Read)
+            Result=Session->ReadArea(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+        else
+            Result=Session->WriteArea(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+        Release(Index[0], Result);
+        return Result;
+    }
+
+    // Same number of PDUs per session
+    PDUs=(Amount+MaxElements-1)/MaxElements;
+    SliceElements=((PDUs+Used-1)/Used)*MaxElements;
+    Offset=0;
+    for (c = 0; c < Used; c++)
+    {
+        Elements=Amount-Offset;
+        if (Elements>SliceElements)
+            Elements=SliceElements;
+        Session=Sessions[Index[c]];
+        if (Elements<=0)
+        {
+            // Fewer slices than sessions
+            Release(Index[c], 0);
+            Index[c]=-1;
+            continue;
+        }
+        // Timers and counters are addressed by element, the others by byte
+        if ((WordLen==S7WLTimer) || (WordLen==S7WLCounter))
+            SliceStart=Start+Offset;
+        else
+            SliceStart=Start+Offset*WordSize;
+        if (Read)
+            Session->AsReadArea(Area, DBNumber, SliceStart, Elements, WordLen, pbyte(pUsrData)+Offset*WordSize);
+        else
+            Session->AsWriteArea(Area, DBNumber, SliceStart, Elements, WordLen, pbyte(pUsrData)+Offset*WordSize);
+        Offset+=Elements;
+    }
+    Result=0;
+    for (c = 0; c < Used; c++)
+        if (Index[c]>=0)
+        {
+            Session=Sessions[Index[c]];
+            Elements=Session->WaitAsCompletion(PoolWaitTime);
+            if (Elements==int(errCliJobTimeout))
+            {
+                // The session is given back only when the canceled job is over
+                Session->CancelJob();
+                while (!Session->CheckAsCompletion(Elements))
+                    Session->WaitAsCompletion(PoolWaitTime);
+            }
+            Release(Index[c], Elements);
+            if (Result==0)
+                Result=Elements;
+        }
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::ReadArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    return Stripe(true, Area, DBNumber, Start, Amount, WordLen, pUsrData);
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    return Stripe(false, Area, DBNumber, Start, Amount, WordLen, pUsrData);
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::ReadMultiVars(PS7DataItem Item, int ItemsCount)
+{
+    int Index, Result;
+    Result=Acquire(Index, PoolWaitTime);
+    if (Result==0)
+    {
+        Result=Sessions[Index]->ReadMultiVars(Item, ItemsCount);
+        Release(Index, Result);
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::WriteMultiVars(PS7DataItem Item, int ItemsCount)
+{
+    int Index, Result;
+    Result=Acquire(Index, PoolWaitTime);
+    if (Result==0)
+    {
+        Result=Sessions[Index]->WriteMultiVars(Item, ItemsCount);
+        Release(Index, Result);
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::AcquireSession(TSnap7Client *&Session, int Timeout)
+{
+    int Index, Result;
+    Session=NULL;
+    Result=Acquire(Index, Timeout);
+    if (Result==0)
+        Session=Sessions[Index];
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::ReleaseSession(TSnap7Client *Session)
+{
+    for (int c = 0; c < MaxPoolSessions; c++)
+        if ((Sessions[c]==Session) && (Session!=NULL) && Info[c].Busy)
+        {
+            Release(c, Session->LastError);
+            return 0;
+        }
+    return errCliInvalidParams;
+}
+//---------------------------------------------------------------------------
+int TSnap7Pool::GetSessions(PS7PoolSession pUsrData, int &ItemsCount)
+{
+    int c;
+    CS->Enter();
+    if (ItemsCount>Count)
+        ItemsCount=Count;
+    for (c = 0; c < ItemsCount; c++)
+        pUsrData[c]=Info[c];
+    CS->Leave();
+    return 0;
+}
+//***************************************************************************
+// RATE-GROUP SCHEDULER
+//***************************************************************************
+class TSchedThread: public TSnapThread
+{
+private:
+    TSnap7Scheduler *FSched;
+public:
+    TSchedThread(TSnap7Scheduler *Sched)
+    {
+        FSched = Sched;
+    }
+    void Execute()
+    {
+        int Expirations;
+        while (!Terminated)
+        {
+            Expirations=FSched->WaitTick();
+            if (!Terminated)
+                FSched->Cycle(Expirations);
+        }
+    }
+};
+//---------------------------------------------------------------------------
+static int SchedGCD(int a, int b)
+{
+    while (b!=0)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+//---------------------------------------------------------------------------
+TSnap7Scheduler::TSnap7Scheduler(TSnap7Client *AClient)
+{
+    Client = AClient;
+    memset(Groups,0,sizeof(Groups));
+    memset(&Stats,0,sizeof(Stats));
+    FThread = NULL;
+    CS = new TSnapCriticalSection();
+    EvtWake = new TSnapEvent(false);
+    EvtIdle = new TSnapEvent(true);
+    EvtIdle->Set();
+    Reading = false;
+    Generation = 0;
+    DueGroups = 0;
+    CycleRequests = 0;
+    Rearm = true;
+    T0 = 0;
+    T0us = 0;
+    NominalTick = 0;
+    AdaptTarget = 0;
+    AdaptMin = 100;
+    AdaptMax = 1000;
+    AdaptCycle = 0;
+    CycleFailed = false;
+    SZL = NULL;
+    memset(&AdaptStats,0,sizeof(AdaptStats));
+    AdaptStats.Stretch = 100;
+    PeriodStart = 0;
+    PeriodBusy = 0;
+    PeriodRequests = 0;
+    PeriodOverruns = 0;
+#ifdef __linux__
+    TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+    BatchCount = 0;
+}
+//---------------------------------------------------------------------------
+TSnap7Scheduler::~TSnap7Scheduler()
+{
+    Stop();
+#ifdef __linux__
+    if (TimerFd>=0)
+        close(TimerFd);
+#endif
+    delete SZL;
+    delete EvtIdle;
+    delete EvtWake;
+    delete CS;
+}
+//---------------------------------------------------------------------------
+// Recomputes the base tick and restarts the timer (inside CS)
+void TSnap7Scheduler::Arm()
+{
+    int Nominal = 0;
+    int c;
+
+    for (c = 0; c < MaxSchedGroups; c++)
+        if (Groups[c].Used)
+            Nominal=SchedGCD(Groups[c].Interval, Nominal);
+    if (Nominal>0)
+    {
+        for (c = 0; c < MaxSchedGroups; c++)
+            if (Groups[c].Used)
+                Groups[c].Ratio=Groups[c].Interval/Nominal;
+    }
+    NominalTick=Nominal;
+    PeriodStart=SysGetTick();
+    PeriodBusy=0;
+    PeriodRequests=0;
+    PeriodOverruns=0;
+    Stats.Ticks=0;
+    Rearm=false;
+    SetTick();
+}
+//---------------------------------------------------------------------------
+// Applies the stretch to the base tick and restarts the timer (inside CS).
+// The tick count goes on, so every group keeps its phase : the origin is
+// moved back to make the current tick the last one elapsed.
+void TSnap7Scheduler::SetTick()
+{
+    int Base = 0;
+
+    if (NominalTick>0)
+    {
+        Base=NominalTick*AdaptStats.Stretch/100;
+        if (Base<1)
+            Base=1;
+    }
+    Stats.BaseTick=Base;
+    T0=SysGetTick()-Stats.Ticks*longword(Base);
+    T0us=SysGetMicroTick()-Stats.Ticks*longword(Base)*1000;
+#ifdef __linux__
+    struct itimerspec Spec;
+    memset(&Spec,0,sizeof(Spec));
+    if (Base>0) // else disarmed : read() waits for Wake()
+    {
+        Spec.it_value.tv_sec=Base / 1000;
+        Spec.it_value.tv_nsec=(Base % 1000)*1000000;
+        Spec.it_interval=Spec.it_value;
+    }
+    timerfd_settime(TimerFd, 0, &Spec, NULL);
+#endif
+}
+//---------------------------------------------------------------------------
+void TSnap7Scheduler::Wake()
+{
+#ifdef __linux__
+    struct itimerspec Spec;
+    memset(&Spec,0,sizeof(Spec));
+    Spec.it_value.tv_nsec=1; // expires at once
+    timerfd_settime(TimerFd, 0, &Spec, NULL);
+#endif
+    EvtWake->Set();
+}
+//---------------------------------------------------------------------------
+// Waits for the next tick, returns the ticks elapsed (more than one if we
+// were late) or 0 if woken up
+int TSnap7Scheduler::WaitTick()
+{
+    longword Base, Start, Ticks;
+    int Left;
+#ifdef __linux__
+    uint64_t Expirations;
+    if (TimerFd>=0)
+    {
+        if (read(TimerFd, &Expirations, sizeof(Expirations))!=sizeof(Expirations))
+            return 0;
+        return int(Expirations);
+    }
+#endif
+    // Timed wait on EvtWake (no timerfd)
+    CS->Enter();
+    Base=Stats.BaseTick;
+    Start=T0;
+    Ticks=Stats.Ticks;
+    CS->Leave();
+    if (Base==0)
+    {
+        EvtWake->WaitForever();
+        return 0;
+    }
+    Left=int(Start+(Ticks+1)*Base-SysGetTick());
+    if ((Left>0) && (EvtWake->WaitFor(Left)==WAIT_OBJECT_0))
+        return 0;
+    return int((SysGetTick()-Start)/Base-Ticks);
+}
+//---------------------------------------------------------------------------
+void TSnap7Scheduler::FlushBatch()
+{
+    int Result, c;
+    if (BatchCount==0)
+        return;
+    Result=Client->ReadMultiVars(Batch, BatchCount);
+    CycleRequests++;
+    for (c = 0; c < BatchCount; c++)
+    {
+        if (Result!=0)
+            Source[c]->Result=Result;
+        else
+            Source[c]->Result=Batch[c].Result;
+    }
+    BatchCount=0;
+}
+//---------------------------------------------------------------------------
+// Packs the item into the current ReadMultiVars, which is sent when either
+// the request or the answer would not fit the PDU
+void TSnap7Scheduler::AddToBatch(PS7DataItem Item)
+{
+    const int ReqItemSize = sizeof(TReqFunReadItem);
+    int PDU = Client->PDULength;
+    int Size, WordSize;
+
+    if ((Item->Area==S7AreaTM) || (Item->Area==S7AreaCT))
+        WordSize=2;
+    else
+        WordSize=Client->DataSizeByte(Item->WordLen);
+    Size=Item->Amount*WordSize;
+    if (Size & 1)
+        Size++; // items are word aligned into the answer
+    Size+=4;    // item header
+
+    // Too big to share a PDU : ReadArea splits it
+    if (ReqHeaderSize+2+ReqItemSize>PDU || ResHeaderSize23+2+Size>PDU)
+    {
+        Item->Result=Client->ReadArea(Item->Area, Item->DBNumber, Item->Start,
+            Item->Amount, Item->WordLen, Item->pdata);
+        CycleRequests++;
+        return;
+    }
+    if ((BatchCount==MaxVars) || (BatchReq+ReqItemSize>PDU) || (BatchRes+Size>PDU))
+        FlushBatch();
+    if (BatchCount==0)
+    {
+        BatchReq=ReqHeaderSize+2;
+        BatchRes=ResHeaderSize23+2;
+    }
+    Batch[BatchCount]=*Item;
+    Source[BatchCount]=Item;
+    BatchCount++;
+    BatchReq+=ReqItemSize;
+    BatchRes+=Size;
+}
+//---------------------------------------------------------------------------
+void TSnap7Scheduler::Cycle(int Expirations)
+{
+    longword Ideal, Begin, Jitter, Elapsed;
+    int Base, Result, c, i;
+    PS7DataItem Item;
+    TSchedDue *Due;
+    TSchedGroup *Group;
+    bool Valid;
+
+    CS->Enter();
+    if (Rearm)
+    {
+        Arm();
+        CS->Leave();
+        return;
+    }
+    Base=Stats.BaseTick;
+    if ((Expirations<1) || (Base==0))
+    {
+        CS->Leave();
+        return;
+    }
+    // Groups due in the ticks elapsed : only the last occurrence is read,
+    // the others are overruns
+    for (i = 0; i < Expirations; i++)
+    {
+        Stats.Ticks++;
+        for (c = 0; c < MaxSchedGroups; c++)
+            if (Groups[c].Used && (Stats.Ticks % longword(Groups[c].Ratio)==0))
+                Groups[c].DueCount++;
+    }
+    // The due groups are taken out : the PLC is read and the callbacks run
+    // outside CS, RemoveGroup waits only for the reading
+    DueGroups=0;
+    for (c = 0; c < MaxSchedGroups; c++)
+        if (Groups[c].DueCount>0)
+        {
+            Due=&DueList[DueGroups++];
+            Due->Group=c;
+            Due->Gen=Groups[c].Gen;
+            Due->Items=Groups[c].Items;
+            Due->ItemsCount=Groups[c].ItemsCount;
+            Due->Overruns=Groups[c].DueCount-1;
+            Due->Callback=Groups[c].Callback;
+            Due->usrPtr=Groups[c].usrPtr;
+            Groups[c].DueCount=0;
+        }
+    if (DueGroups==0)
+    {
+        CS->Leave();
+        return;
+    }
+    Ideal=T0us+Stats.Ticks*longword(Base)*1000;
+    Reading=true;
+    EvtIdle->Reset();
+    CS->Leave();
+
+    Begin=SysGetMicroTick();
+    if (int(Begin-Ideal)>0)
+        Jitter=Begin-Ideal;
+    else
+        Jitter=0;
+
+    // All the due groups in the same PDUs
+    CycleRequests=0;
+    BatchCount=0;
+    for (c = 0; c < DueGroups; c++)
+    {
+        Item=DueList[c].Items;
+        for (i = 0; i < DueList[c].ItemsCount; i++)
+        {
+            AddToBatch(Item);
+            Item++;
+        }
+    }
+    FlushBatch();
+    Elapsed=SysGetMicroTick()-Begin;
+    for (c = 0; c < DueGroups; c++)
+    {
+        Due=&DueList[c];
+        Result=0;
+        for (i = 0; (i < Due->ItemsCount) && (Result==0); i++)
+            Result=Due->Items[i].Result;
+        Due->Result=Result;
+    }
+
+    // Stats merged into the groups still there
+    CS->Enter();
+    Reading=false;
+    EvtIdle->Set();
+    Stats.Requests+=CycleRequests;
+    PeriodRequests+=CycleRequests;
+    PeriodBusy+=Elapsed;
+    for (c = 0; c < DueGroups; c++)
+    {
+        Due=&DueList[c];
+        Stats.Items+=Due->ItemsCount;
+        PeriodOverruns+=Due->Overruns;
+        Group=&Groups[Due->Group];
+        if (!Group->Used || (Group->Gen!=Due->Gen))
+            continue;
+        Group->Stats.Overruns+=Due->Overruns;
+        Group->Stats.Cycles++;
+        Group->Stats.JitterLast=Jitter;
+        if (Jitter>Group->Stats.JitterMax)
+            Group->Stats.JitterMax=Jitter;
+        Group->JitterSum+=Jitter;
+        Group->Stats.JitterAvg=longword(Group->JitterSum/Group->Stats.Cycles);
+        Group->Stats.TimeLast=Elapsed;
+        if (Elapsed>Group->Stats.TimeMax)
+            Group->Stats.TimeMax=Elapsed;
+        if (Due->Result!=0)
+        {
+            Group->Stats.Errors++;
+            Group->Stats.LastError=Due->Result;
+        }
+    }
+    CS->Leave();
+
+    for (c = 0; c < DueGroups; c++)
+    {
+        Due=&DueList[c];
+        if (Due->Callback==NULL)
+            continue;
+        // Not for a group removed meanwhile (maybe by a previous callback)
+        CS->Enter();
+        Group=&Groups[Due->Group];
+        Valid=Group->Used && (Group->Gen==Due->Gen);
+        CS->Leave();
+        if (Valid)
+        {
+            try {
+                Due->Callback(Due->usrPtr, Due->Group, Due->Result);
+            }
+            catch (...) {
+            }
+        }
+    }
+    if (AdaptTarget>0)
+        Adapt();
+}
+//---------------------------------------------------------------------------
+// OB1 previous cycle time (ms) from the start info of SZL 0x0222, 0 if not
+// available
+int TSnap7Scheduler::ReadPlcCycle()
+{
+    int Size = sizeof(TS7SZL);
+    if (CycleFailed)
+        return 0;
+    if (SZL==NULL)
+        SZL = new TS7SZL;
+    CS->Enter();
+    Stats.Requests++;
+    PeriodRequests++;
+    CS->Leave();
+    if ((Client->ReadSZL(0x0222, 0x0001, SZL, Size)!=0) || (Size<int(sizeof(SZL_HEADER))+8))
+    {
+        // Only the transport errors are worth a retry
+        CycleFailed=Client->Connected;
+        return 0;
+    }
+    return (SZL->Data[6] << 8) | SZL->Data[7];
+}
+//---------------------------------------------------------------------------
+// Feedback on the intervals, once per AdaptPeriod (the PLC cycle is read
+// outside CS)
+void TSnap7Scheduler::Adapt()
+{
+    longword Elapsed;
+    int Stretch, Reason, Load;
+    int Cycle = 0;
+
+    CS->Enter();
+    Elapsed=SysGetTick()-PeriodStart;
+    CS->Leave();
+    if (Elapsed<longword(AdaptPeriod))
+        return;
+    if (AdaptCycle>0)
+        Cycle=ReadPlcCycle();
+
+    CS->Enter();
+    Elapsed=SysGetTick()-PeriodStart;
+    if (Elapsed==0)
+        Elapsed=1;
+    Load=int(PeriodBusy/(int64_t(Elapsed)*10));
+    AdaptStats.Load=Load;
+    if (PeriodRequests>0)
+        AdaptStats.RTT=int(PeriodBusy/PeriodRequests);
+    Reason=arNone;
+    if (AdaptCycle>0)
+    {
+        AdaptStats.PlcCycle=Cycle;
+        if (Cycle>0)
+        {
+            if ((AdaptStats.PlcCycleMin==0) || (Cycle<AdaptStats.PlcCycleMin))
+                AdaptStats.PlcCycleMin=Cycle;
+            if (Cycle*100>AdaptStats.PlcCycleMin*(100+AdaptCycle))
+                Reason=arPlcCycle;
+        }
+    }
+    if (PeriodOverruns>0)
+        Reason=arOverrun;
+    else if (Load>AdaptTarget)
+        Reason=arLoad;
+
+    Stretch=AdaptStats.Stretch;
+    if (Reason!=arNone)
+        Stretch=Stretch+(Stretch+3)/4;
+    else if (Load*4<AdaptTarget*3)
+    {
+        Stretch=Stretch-Stretch/10;
+        Reason=arIdle;
+    }
+    if (Stretch>AdaptMax)
+        Stretch=AdaptMax;
+    if (Stretch<AdaptMin)
+        Stretch=AdaptMin;
+
+    if (Stretch!=AdaptStats.Stretch)
+    {
+        if (Stretch>AdaptStats.Stretch)
+            AdaptStats.SlowDowns++;
+        else
+            AdaptStats.SpeedUps++;
+        AdaptStats.Adjustments++;
+        AdaptStats.LastReason=Reason;
+        AdaptStats.Stretch=Stretch;
+        SetTick(); // new base tick, same phase
+    }
+    PeriodStart=SysGetTick();
+    PeriodBusy=0;
+    PeriodRequests=0;
+    PeriodOverruns=0;
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::AddGroup(int Interval, PS7DataItem Items, int ItemsCount, pfn_SchedGroupDone Callback, void *usrPtr, int &GroupId)
+{
+    int c;
+    if ((Interval<1) || (Items==NULL) || (ItemsCount<1))
+        return errCliInvalidParams;
+    CS->Enter();
+    for (c = 0; c < MaxSchedGroups; c++)
+        if (!Groups[c].Used)
+            break;
+    if (c==MaxSchedGroups)
+    {
+        CS->Leave();
+        return errCliTooManyItems;
+    }
+    memset(&Groups[c],0,sizeof(TSchedGroup));
+    Groups[c].Interval=Interval;
+    Groups[c].Items=Items;
+    Groups[c].ItemsCount=ItemsCount;
+    Groups[c].Callback=Callback;
+    Groups[c].usrPtr=usrPtr;
+    Groups[c].Gen=++Generation;
+    Groups[c].Used=true;
+    GroupId=c;
+    Rearm=true;
+    CS->Leave();
+    if (FThread!=NULL)
+        Wake();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::RemoveGroup(int GroupId)
+{
+    bool Wait;
+    if ((GroupId<0) || (GroupId>=MaxSchedGroups))
+        return errCliInvalidParams;
+    // Waits for the reading in progress (the items are free after the return)
+    // and no callback starts after it. Callbacks are called after the reading,
+    // so they can remove groups too.
+    CS->Enter();
+    Groups[GroupId].Used=false;
+    Groups[GroupId].DueCount=0;
+    Rearm=true;
+    Wait=Reading;
+    CS->Leave();
+    if (FThread!=NULL)
+        Wake();
+    if (Wait)
+        EvtIdle->WaitForever();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::Start()
+{
+    if (FThread!=NULL)
+        return 0;
+    CS->Enter();
+    Arm();
+    CS->Leave();
+    EvtWake->Reset();
+    FThread = new TSchedThread(this);
+    FThread->Start();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::Stop()
+{
+    if (FThread==NULL)
+        return 0;
+    FThread->Terminate();
+    Wake();
+    if (FThread->WaitFor(3000)!=WAIT_OBJECT_0)
+        FThread->Kill();
+    try {
+        delete FThread;
+    }
+    catch (...){
+    }
+    FThread=NULL;
+#ifdef __linux__
+    struct itimerspec Spec;
+    memset(&Spec,0,sizeof(Spec));
+    timerfd_settime(TimerFd, 0, &Spec, NULL);
+#endif
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::GetGroupStats(int GroupId, PS7GroupStats pStats, bool DoReset)
+{
+    if ((GroupId<0) || (GroupId>=MaxSchedGroups) || (pStats==NULL))
+        return errCliInvalidParams;
+    CS->Enter();
+    *pStats=Groups[GroupId].Stats;
+    if (DoReset)
+    {
+        memset(&Groups[GroupId].Stats,0,sizeof(TS7GroupStats));
+        Groups[GroupId].JitterSum=0;
+    }
+    CS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::GetStats(PS7SchedStats pStats)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    CS->Enter();
+    *pStats=Stats;
+    CS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::GetParam(int ParamNumber, void * pValue)
+{
+    switch (ParamNumber)
+    {
+    case p_i32_AdaptTarget:
+        *Pint32_t(pValue)=AdaptTarget;
+        break;
+    case p_i32_AdaptMin:
+        *Pint32_t(pValue)=AdaptMin;
+        break;
+    case p_i32_AdaptMax:
+        *Pint32_t(pValue)=AdaptMax;
+        break;
+    case p_i32_AdaptCycle:
+        *Pint32_t(pValue)=AdaptCycle;
+        break;
+    default:
+        return errCliInvalidParamNumber;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::SetParam(int ParamNumber, void * pValue)
+{
+    int Value = *Pint32_t(pValue);
+    int Result = 0;
+
+    CS->Enter();
+    switch (ParamNumber)
+    {
+    case p_i32_AdaptTarget:
+        if ((Value<0) || (Value>100))
+            Result=errCliInvalidParams;
+        else
+        {
+            AdaptTarget=Value;
+            if ((Value==0) && (AdaptStats.Stretch!=100)) // back to the nominal rates
+            {
+                AdaptStats.Stretch=100;
+                if (FThread!=NULL)
+                    SetTick();
+            }
+        }
+        break;
+    case p_i32_AdaptMin:
+        if ((Value<1) || (Value>AdaptMax))
+            Result=errCliInvalidParams;
+        else
+            AdaptMin=Value;
+        break;
+    case p_i32_AdaptMax:
+        if (Value<AdaptMin)
+            Result=errCliInvalidParams;
+        else
+            AdaptMax=Value;
+        break;
+    case p_i32_AdaptCycle:
+        if (Value<0)
+            Result=errCliInvalidParams;
+        else
+        {
+            AdaptCycle=Value;
+            CycleFailed=false;
+        }
+        break;
+    default:
+        Result=errCliInvalidParamNumber;
+    }
+    CS->Leave();
+    if (Rearm && (FThread!=NULL))
+        Wake();
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Scheduler::GetAdaptStats(PS7AdaptStats pStats, bool DoReset)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    CS->Enter();
+    *pStats=AdaptStats;
+    if (DoReset)
+    {
+        AdaptStats.Adjustments=0;
+        AdaptStats.SlowDowns=0;
+        AdaptStats.SpeedUps=0;
+        AdaptStats.LastReason=arNone;
+        AdaptStats.PlcCycleMin=0;
+    }
+    CS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+// PLC CLOCK ESTIMATOR
+//---------------------------------------------------------------------------
+class TClockThread: public TSnapThread
+{
+private:
+    TSnap7ClockSync *FClock;
+public:
+    TClockThread(TSnap7ClockSync *Clock)
+    {
+        FClock = Clock;
+    }
+    void Execute()
+    {
+        while (!Terminated)
+        {
+            FClock->Sample();
+            if (!Terminated)
+                FClock->EvtWake->WaitFor(FClock->Interval);
+        }
+    }
+};
+//---------------------------------------------------------------------------
+TSnap7ClockSync::TSnap7ClockSync(TSnap7Client *AClient)
+{
+    Client = AClient;
+    FThread = NULL;
+    CS = new TSnapCriticalSection();
+    EvtWake = new TSnapEvent(false);
+    Interval = ClockIntervalDef;
+    memset(&Stats,0,sizeof(Stats));
+    RawCount = 0;
+    RawIdx = 0;
+    FitCount = 0;
+    FitIdx = 0;
+    LastFit = 0;
+    StepSamples = 0;
+    Ref = 0;
+    Base = 0;
+    Drift = 0.0;
+}
+//---------------------------------------------------------------------------
+TSnap7ClockSync::~TSnap7ClockSync()
+{
+    Stop();
+    delete EvtWake;
+    delete CS;
+}
+//---------------------------------------------------------------------------
+int TSnap7ClockSync::Start(int AInterval)
+{
+    if (AInterval<0)
+        return errCliInvalidParams;
+    Interval = AInterval>0 ? AInterval : ClockIntervalDef;
+    if (FThread!=NULL)
+    {
+        EvtWake->Set(); // the new interval starts now
+        return 0;
+    }
+    EvtWake->Reset();
+    FThread = new TClockThread(this);
+    FThread->Start();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7ClockSync::Stop()
+{
+    if (FThread==NULL)
+        return 0;
+    FThread->Terminate();
+    EvtWake->Set();
+    if (FThread->WaitFor(3000)!=WAIT_OBJECT_0)
+        FThread->Kill();
+    try {
+        delete FThread;
+    }
+    catch (...){
+    }
+    FThread=NULL;
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7ClockSync::Sample()
+{
+    TS7JobStamps Stamps;
+    int64_t Sent, Received, PlcTime;
+    bool Kernel = false;
+    int Result;
+
+    Sent=int64_t(SysGetRealTime());
+    Result=Client->GetPlcClock(PlcTime);
+    Received=int64_t(SysGetRealTime());
+    // The wire stamps exclude the job overhead (and the wait for a shared session)
+    if ((Result==0) && (Client->GetJobStamps(&Stamps)==0) && (Stamps.PDUs==1))
+    {
+        Sent=int64_t(Stamps.Sent);
+        Received=int64_t(Stamps.Received);
+        Kernel=Stamps.Kernel!=0;
+    }
+    CS->Enter();
+    if (Result==0)
+        AddSample(Sent, Received, PlcTime, Kernel);
+    else
+        Stats.Errors++;
+    CS->Leave();
+    return Result;
+}
+//---------------------------------------------------------------------------
+// Inside CS
+void TSnap7ClockSync::AddSample(int64_t Sent, int64_t Received, int64_t PlcTime, bool Kernel)
+{
+    TClockSample Sample;
+    int64_t Predicted;
+    int Best, c;
+
+    Stats.Samples++;
+    Stats.Kernel=Kernel;
+    Stats.LastSample=Received;
+    Sample.RTT=Received>Sent ? Received-Sent : 0;
+    Sample.Mid=Sent+Sample.RTT/2;
+    // The PLC clock is truncated to the ms : the middle of it is the best guess
+    Sample.Offset=PlcTime+500000-Sample.Mid;
+    // A sample far from the model is a step of the PLC clock if the next ones agree
+    if (Stats.Valid)
+    {
+        Predicted=Base+int64_t(Drift*double(Sample.Mid-Ref));
+        if (llabs(Sample.Offset-Predicted)>ClockStepLimit+Sample.RTT)
+        {
+            StepSamples++;
+            if (StepSamples<ClockStepCount)
+                return;
+            Stats.Steps++;
+            RawCount=0;
+            RawIdx=0;
+            FitCount=0;
+            FitIdx=0;
+        }
+    }
+    StepSamples=0;
+    Raw[RawIdx]=Sample;
+    RawIdx=(RawIdx+1) % ClockFilterSize;
+    if (RawCount<ClockFilterSize)
+        RawCount++;
+    // Clock filter : the shortest round trip has the smallest error
+    Best=0;
+    for (c = 1; c < RawCount; c++)
+        if (Raw[c].RTT<Raw[Best].RTT)
+            Best=c;
+    Stats.RTT=int(Raw[Best].RTT/1000);
+    if ((FitCount>0) && (Raw[Best].Mid<=LastFit))
+        return; // already fitted
+    LastFit=Raw[Best].Mid;
+    Fit[FitIdx]=Raw[Best];
+    FitIdx=(FitIdx+1) % ClockFitSize;
+    if (FitCount<ClockFitSize)
+        FitCount++;
+    Refit();
+}
+//---------------------------------------------------------------------------
+// Least squares line through the fitted samples (inside CS)
+void TSnap7ClockSync::Refit()
+{
+    double Sx = 0, Sy = 0, Sxx = 0, Sxy = 0, Sr = 0;
+    double x, y, n, Slope, Intercept, Den;
+    int64_t Oldest, Offset0;
+    int Last, c;
+
+    Last=(FitIdx+ClockFitSize-1) % ClockFitSize;
+    Ref=Fit[Last].Mid;
+    // Relative to the last sample to keep the ns in the doubles
+    Offset0=Fit[Last].Offset;
+    Oldest=Ref;
+    for (c = 0; c < FitCount; c++)
+    {
+        x=double(Fit[c].Mid-Ref);
+        y=double(Fit[c].Offset-Offset0);
+        Sx+=x;
+        Sy+=y;
+        Sxx+=x*x;
+        Sxy+=x*y;
+        if (Fit[c].Mid<Oldest)
+            Oldest=Fit[c].Mid;
+    }
+    n=double(FitCount);
+    Den=n*Sxx-Sx*Sx;
+    // The drift is meaningless over a short span (1 ms of noise in 1 s = 1000 ppm)
+    if ((FitCount>=3) && (Ref-Oldest>=ClockFitSpan) && (Den>0))
+    {
+        Slope=(n*Sxy-Sx*Sy)/Den;
+        if (Slope>ClockMaxDrift*1e-9)
+            Slope=ClockMaxDrift*1e-9;
+        if (Slope<-ClockMaxDrift*1e-9)
+            Slope=-ClockMaxDrift*1e-9;
+    }
+    else
+        Slope=0.0;
+    Intercept=(Sy-Slope*Sx)/n;
+    for (c = 0; c < FitCount; c++)
+    {
+        y=double(Fit[c].Offset-Offset0)-(Intercept+Slope*double(Fit[c].Mid-Ref));
+        Sr+=y*y;
+    }
+    Base=Offset0+int64_t(Intercept>=0 ? Intercept+0.5 : Intercept-0.5);
+    Drift=Slope;
+    Stats.Valid=1;
+    Stats.Drift=int(Slope*1e9);
+    Stats.Jitter=int(sqrt(Sr/n)/1000);
+}
+//---------------------------------------------------------------------------
+int TSnap7ClockSync::GetStats(PS7ClockStats pStats)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    CS->Enter();
+    *pStats=Stats;
+    if (Stats.Valid)
+        pStats->Offset=Base+int64_t(Drift*double(int64_t(SysGetRealTime())-Ref));
+    CS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+// PlcTime = HostTime + Base + Drift * (HostTime - Ref), solved for HostTime
+int TSnap7ClockSync::PlcToHost(int64_t PlcTime, int64_t &HostTime)
+{
+    int Result = 0;
+    CS->Enter();
+    if (Stats.Valid)
+        HostTime=Ref+int64_t(double(PlcTime-Ref-Base)/(1.0+Drift));
+    else
+        Result=errCliClockNotSynced;
+    CS->Leave();
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7ClockSync::HostToPlc(int64_t HostTime, int64_t &PlcTime)
+{
+    int Result = 0;
+    CS->Enter();
+    if (Stats.Valid)
+        PlcTime=HostTime+Base+int64_t(Drift*double(HostTime-Ref));
+    else
+        Result=errCliClockNotSynced;
+    CS->Leave();
+    return Result;
+}
+//***************************************************************************
+// BLOCK BACKUP
+//***************************************************************************
+static const int BackupTypes[] = {Block_OB, Block_FB, Block_FC, Block_DB, Block_SDB};
+
+class TBackupThread: public TSnapThread
+{
+private:
+    TSnap7Backup *FBackup;
+public:
+    TBackupThread(TSnap7Backup *Backup)
+    {
+        FBackup = Backup;
+    }
+    void Execute()
+    {
+        FBackup->UploadNext();
+    }
+};
+//---------------------------------------------------------------------------
+static uint64_t BlockHash(pbyte Data, int Size)
+{
+    uint64_t Hash = 0xCBF29CE484222325ULL; // FNV-1a 64
+    for (int c = 0; c < Size; c++)
+    {
+        Hash^=Data[c];
+        Hash*=0x100000001B3ULL;
+    }
+    return Hash;
+}
+//---------------------------------------------------------------------------
+// False if the name doesn't fit in Size
+static bool BlockFileName(char *Path, int Size, const char *Folder, uint64_t Hash)
+{
+    int Len = snprintf(Path, Size, "%s/%08X%08X.mc7", Folder, unsigned(Hash >> 32), unsigned(Hash & 0xFFFFFFFF));
+    return (Len>0) && (Len<Size);
+}
+//---------------------------------------------------------------------------
+static int CompareEntries(const void *A, const void *B)
+{
+    PS7BackupEntry EA = PS7BackupEntry(A);
+    PS7BackupEntry EB = PS7BackupEntry(B);
+    if (EA->BlkType!=EB->BlkType)
+        return EA->BlkType-EB->BlkType;
+    return EA->BlkNumber-EB->BlkNumber;
+}
+//---------------------------------------------------------------------------
+TSnap7Backup::TSnap7Backup(TSnap7Pool *APool)
+{
+    Pool = APool;
+    CS = new TSnapCriticalSection();
+    Entries = NULL;
+    EntriesCount = 0;
+    memset(&Stats,0,sizeof(Stats));
+    Folder[0] = '\0';
+    Queue = NULL;
+    QueueCount = 0;
+    Next = 0;
+}
+//---------------------------------------------------------------------------
+TSnap7Backup::~TSnap7Backup()
+{
+    delete[] Entries;
+    delete CS;
+}
+//---------------------------------------------------------------------------
+// Lists the blocks and reads their infos (the failed ones are marked)
+int TSnap7Backup::ListBlocks(TSnap7Client *Session)
+{
+    PS7BlocksOfType List;
+    PS7BlockInfoItem Items;
+    int Count[5];
+    int Total, ItemsCount, Result, c, i, n;
+
+    List=PS7BlocksOfType(new TS7BlocksOfType[5]);
+    Total=0;
+    Result=0;
+    for (c = 0; (c < 5) && (Result==0); c++)
+    {
+        Count[c]=0x2000;
+        Result=Session->ListBlocksOfType(BackupTypes[c], &List[c], Count[c]);
+        // No blocks of this type
+        if (Result==int(errCliItemNotAvailable))
+        {
+            Count[c]=0;
+            Result=0;
+        }
+        Total+=Count[c];
+    }
+    if ((Result==0) && (Total>0))
+    {
+        Entries=new TS7BackupEntry[Total];
+        Items=new TS7BlockInfoItem[Total];
+        memset(Entries,0,Total*sizeof(TS7BackupEntry));
+        n=0;
+        for (c = 0; c < 5; c++)
+            for (i = 0; i < Count[c]; i++)
+            {
+                Items[n].BlkType=BackupTypes[c];
+                Items[n].BlkNumber=List[c][i];
+                n++;
+            }
+        ItemsCount=n;
+        Result=Session->GetAgBlockInfoMulti(Items, ItemsCount);
+        if (Result==0)
+        {
+            for (n = 0; n < ItemsCount; n++)
+            {
+                Entries[n].BlkType=Items[n].BlkType;
+                Entries[n].BlkNumber=Items[n].BlkNumber;
+                Entries[n].Result=Items[n].Result;
+                if (Items[n].Result==0)
+                {
+                    Entries[n].CheckSum=Items[n].Info.CheckSum;
+                    Entries[n].Version=Items[n].Info.Version;
+                    Entries[n].LoadSize=Items[n].Info.LoadSize;
+                }
+                else
+                    Entries[n].Status=bsFailed;
+            }
+            EntriesCount=ItemsCount;
+        }
+        else
+        {
+            delete[] Entries;
+            Entries=NULL;
+        }
+        delete[] Items;
+    }
+    delete[] List;
+    return Result;
+}
+//---------------------------------------------------------------------------
+// A missing or unreadable index is an empty one : everything is uploaded
+void TSnap7Backup::ReadIndex(const char *Path, PS7BackupEntry &Index, int &IndexCount)
+{
+    FILE *F;
+    char Line[128];
+    unsigned Type, CheckSum, HashHi, HashLo;
+    int Number, Version, LoadSize, Size, Room;
+    PS7BackupEntry Grown;
+
+    Index=NULL;
+    IndexCount=0;
+    Room=0;
+    F=fopen(Path, "r");
+    if (F==NULL)
+        return;
+    if ((fgets(Line, sizeof(Line), F)!=NULL) && (strncmp(Line, "S7BACKUP 1", 10)==0))
+        while (fgets(Line, sizeof(Line), F)!=NULL)
+        {
+            if (sscanf(Line, "%x %d %x %d %d %d %8x%8x", &Type, &Number, &CheckSum,
+                &Version, &LoadSize, &Size, &HashHi, &HashLo)!=8)
+                continue;
+            if (IndexCount==Room)
+            {
+                Room=(Room==0) ? 256 : Room*2;
+                Grown=new TS7BackupEntry[Room];
+                if (IndexCount>0)
+                    memcpy(Grown, Index, IndexCount*sizeof(TS7BackupEntry));
+                delete[] Index;
+                Index=Grown;
+            }
+            memset(&Index[IndexCount],0,sizeof(TS7BackupEntry));
+            Index[IndexCount].BlkType=int(Type);
+            Index[IndexCount].BlkNumber=Number;
+            Index[IndexCount].CheckSum=int(CheckSum);
+            Index[IndexCount].Version=Version;
+            Index[IndexCount].LoadSize=LoadSize;
+            Index[IndexCount].Size=Size;
+            Index[IndexCount].Hash=(uint64_t(HashHi) << 32) | HashLo;
+            IndexCount++;
+        }
+    fclose(F);
+    if (IndexCount>1)
+        qsort(Index, IndexCount, sizeof(TS7BackupEntry), CompareEntries);
+}
+//---------------------------------------------------------------------------
+// The blocks failed are left out, the next run will upload them.
+// Written aside and renamed, so a broken run leaves the previous index.
+int TSnap7Backup::WriteIndex(const char *Path)
+{
+    char Temp[BackupMaxPath+8];
+    FILE *F;
+    bool Ok;
+    int c;
+
+    snprintf(Temp, sizeof(Temp), "%s.tmp", Path);
+    F=fopen(Temp, "w");
+    if (F==NULL)
+        return errCliBackupFile;
+    Ok=fprintf(F, "S7BACKUP 1\n")>0;
+    for (c = 0; (c < EntriesCount) && Ok; c++)
+        if (Entries[c].Status!=bsFailed)
+            Ok=fprintf(F, "%02X %d %04X %d %d %d %08X%08X\n", Entries[c].BlkType, Entries[c].BlkNumber,
+                Entries[c].CheckSum & 0xFFFF, Entries[c].Version, Entries[c].LoadSize, Entries[c].Size,
+                unsigned(Entries[c].Hash >> 32), unsigned(Entries[c].Hash & 0xFFFFFFFF))>0;
+    Ok=(fclose(F)==0) && Ok;
+    if (Ok)
+    {
+        remove(Path); // rename doesn't replace under Windows
+        Ok=rename(Temp, Path)==0;
+    }
+    if (!Ok)
+    {
+        remove(Temp);
+        return errCliBackupFile;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+bool TSnap7Backup::Stored(uint64_t Hash)
+{
+    char Path[BackupMaxPath];
+    FILE *F;
+
+    if (!BlockFileName(Path, sizeof(Path), Folder, Hash))
+        return false;
+    F=fopen(Path, "rb");
+    if (F==NULL)
+        return false;
+    fclose(F);
+    return true;
+}
+//---------------------------------------------------------------------------
+// An image already in the folder is not written again. Tag makes the
+// temporary name unique among the workers; the image is written outside the
+// lock, but checked and renamed under it, so that only the worker which
+// actually stored it counts it when two of them upload the same image.
+int TSnap7Backup::Store(uint64_t Hash, pbyte Data, int Size, int Tag)
+{
+    char Path[BackupMaxPath];
+    char Temp[BackupMaxPath+16];
+    FILE *F;
+    bool Ok, Written;
+
+    if (Stored(Hash))
+        return 0;
+    if (!BlockFileName(Path, sizeof(Path), Folder, Hash))
+        return errCliBackupFile;
+    snprintf(Temp, sizeof(Temp), "%s.%d.tmp", Path, Tag);
+    F=fopen(Temp, "wb");
+    if (F==NULL)
+        return errCliBackupFile;
+    Ok=fwrite(Data, 1, Size, F)==size_t(Size);
+    Ok=(fclose(F)==0) && Ok;
+    Written=false;
+    if (Ok)
+    {
+        CS->Enter();
+        if (!Stored(Hash)) // Not stored meanwhile by another worker
+        {
+            Ok=rename(Temp, Path)==0;
+            Written=Ok;
+            if (Written)
+                Stats.Stored++;
+        }
+        CS->Leave();
+    }
+    if (!Written)
+        remove(Temp);
+    if (!Ok)
+        return errCliBackupFile;
+    return 0;
+}
+//---------------------------------------------------------------------------
+// Buffer (Room bytes) is the one of the worker : it's grown to the load size
+// of the block and, if the image doesn't fit anyway, to BackupMaxBlock (the
+// most a PDU buffer can stage) for a second attempt.
+void TSnap7Backup::Upload(PS7BackupEntry Entry, pbyte &Buffer, int &Room, int Tag)
+{
+    TSnap7Client *Session;
+    int Need, Size;
+    int Result;
+
+    Need=Entry->LoadSize;
+    if ((Need<=0) || (Need>BackupMaxBlock))
+        Need=BackupMaxBlock;
+    Result=Pool->AcquireSession(Session, PoolWaitTime);
+    if (Result==0)
+    {
+        do
+        {
+            if (Room<Need)
+            {
+                delete[] Buffer;
+                Buffer=new byte[Need];
+                Room=Need;
+            }
+            Size=Room;
+            Result=Session->FullUpload(Entry->BlkType, Entry->BlkNumber, Buffer, Size);
+            if ((Result==errCliPartialDataRead) && (Room<BackupMaxBlock))
+                Need=BackupMaxBlock;
+            else
+                break;
+        } while (true);
+        Pool->ReleaseSession(Session);
+    }
+    if (Result==0)
+    {
+        CS->Enter();
+        Stats.Bytes+=Size;
+        CS->Leave();
+        Entry->Hash=BlockHash(Buffer, Size);
+        Entry->Size=Size;
+        Result=Store(Entry->Hash, Buffer, Size, Tag);
+    }
+    Entry->Result=Result;
+    Entry->Status=(Result==0) ? bsUploaded : bsFailed;
+}
+//---------------------------------------------------------------------------
+// Worker : uploads the queued blocks until none is left
+void TSnap7Backup::UploadNext()
+{
+    pbyte Buffer = NULL;
+    int Room = 0;
+    int Index;
+
+    for (;;)
+    {
+        CS->Enter();
+        Index=Next;
+        if (Index<QueueCount)
+            Next=Index+1;
+        CS->Leave();
+        if (Index>=QueueCount)
+            break;
+        Upload(&Entries[Queue[Index]], Buffer, Room, Queue[Index]);
+    }
+    delete[] Buffer;
+}
+//---------------------------------------------------------------------------
+int TSnap7Backup::Run(const char *AFolder, const char *IndexName)
+{
+    TBackupThread **Threads;
+    TSnap7Client *Session;
+    PS7BackupEntry Index, Old;
+    char Path[BackupMaxPath];
+    longword Start = SysGetTick();
+    int IndexCount, Workers, Result, c;
+
+    // Room for <folder>/<hash>.mc7.<tag>.tmp
+    if ((AFolder==NULL) || (IndexName==NULL) || (*IndexName=='\0') ||
+        (strlen(AFolder)+40>sizeof(Folder)) ||
+        (strlen(AFolder)+strlen(IndexName)+2>sizeof(Path)))
+        return errCliInvalidParams;
+    strcpy(Folder, AFolder);
+    snprintf(Path, sizeof(Path), "%s/%s", Folder, IndexName);
+    memset(&Stats,0,sizeof(Stats));
+    delete[] Entries;
+    Entries=NULL;
+    EntriesCount=0;
+
+    Result=Pool->AcquireSession(Session, PoolWaitTime);
+    if (Result==0)
+    {
+        Result=ListBlocks(Session);
+        Pool->ReleaseSession(Session);
+    }
+    if (Result!=0)
+    {
+        Stats.Time=int(SysGetTick()-Start);
+        return Result;
+    }
+
+    // The blocks not changed since the previous run are not uploaded
+    ReadIndex(Path, Index, IndexCount);
+    Queue=new int[EntriesCount+1];
+    QueueCount=0;
+    for (c = 0; c < EntriesCount; c++)
+    {
+        if (Entries[c].Status==bsFailed)
+            continue;
+        Old=NULL;
+        if (IndexCount>0)
+            Old=PS7BackupEntry(bsearch(&Entries[c], Index, IndexCount, sizeof(TS7BackupEntry), CompareEntries));
+        if ((Old!=NULL) && (Old->CheckSum==(Entries[c].CheckSum & 0xFFFF)) &&
+            (Old->Version==Entries[c].Version) && (Old->LoadSize==Entries[c].LoadSize) &&
+            Stored(Old->Hash))
+        {
+            Entries[c].Status=bsUnchanged;
+            Entries[c].Size=Old->Size;
+            Entries[c].Hash=Old->Hash;
+        }
+        else
+            Queue[QueueCount++]=c;
+    }
+    delete[] Index;
+
+    // The uploads are spread over the sessions of the pool
+    if (QueueCount>0)
+    {
+        Workers=1;
+        Pool->GetParam(p_i32_PoolSize, &Workers);
+        if (Workers>QueueCount)
+            Workers=QueueCount;
+        if (Workers<1)
+            Workers=1;
+        Next=0;
+        Threads=new TBackupThread*[Workers];
+        for (c = 0; c < Workers; c++)
+        {
+            Threads[c]=new TBackupThread(this);
+            Threads[c]->Start();
+        }
+        for (c = 0; c < Workers; c++)
+        {
+            Threads[c]->WaitFor(INFINITE);
+            delete Threads[c];
+        }
+        delete[] Threads;
+    }
+    delete[] Queue;
+    Queue=NULL;
+    QueueCount=0;
+
+    Result=WriteIndex(Path);
+    Stats.Blocks=EntriesCount;
+    for (c = 0; c < EntriesCount; c++)
+        switch (Entries[c].Status)
+        {
+            case bsUnchanged : Stats.Unchanged++; break;
+            case bsUploaded  : Stats.Uploaded++; break;
+            default          : Stats.Failed++;
+        }
+    Stats.Time=int(SysGetTick()-Start);
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7Backup::GetEntries(PS7BackupEntry pUsrData, int &ItemsCount)
+{
+    if ((pUsrData==NULL) || (ItemsCount<0))
+        return errCliInvalidParams;
+    if (ItemsCount>EntriesCount)
+        ItemsCount=EntriesCount;
+    if (ItemsCount>0)
+        memcpy(pUsrData, Entries, ItemsCount*sizeof(TS7BackupEntry));
+    return (ItemsCount<EntriesCount) ? errCliBufferTooSmall : 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7Backup::GetStats(PS7BackupStats pStats)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    *pStats=Stats;
+    return 0;
+}
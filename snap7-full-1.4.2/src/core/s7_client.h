@@ -30,11 +30,136 @@
 #include "s7_micro_client.h"
 //---------------------------------------------------------------------------
 
+// Diagnostic buffer tail (DiagTail) : the entries are read with SZL 0x01A0,
+// whose index is the number of most recent entries wanted
+const int DiagEntrySize  = 20;
+const int DiagMaxEntries = 3200; // Largest diagnostic buffer (S7-400)
+const int DiagFirstStep  = 16;   // Entries read once the newest one changed
+
+typedef struct{
+   word EventID;    // Host order
+   byte Info[10];   // Event dependent info (priority class, OB number ...)
+   byte Time[8];    // DATE_AND_TIME (BCD) as sent by the CPU
+} TS7DiagEntry, *PS7DiagEntry;
+
 extern "C" {
 typedef void (S7API *pfn_CliCompletion) (void * usrPtr, int opCode, int opResult);
+typedef void (S7API *pfn_CliLinkState) (void * usrPtr, int State, int Error);
+typedef void (S7API *pfn_CliDiagEvent) (void * usrPtr, PS7DiagEntry Entry);
+typedef void (S7API *pfn_SchedGroupDone) (void * usrPtr, int GroupId, int Result);
 }
 class TSnap7Client;
 
+// Background reconnection (p_i32_ReconnectMode)
+const int rmNone     = 0; // The application reconnects (default)
+const int rmFailFast = 1; // Jobs fail with errCliLinkDown while reconnecting
+const int rmQueue    = 2; // Jobs wait for the reconnection (up to their deadline)
+
+// Link states
+const int lsDisconnected = 0;
+const int lsConnected    = 1;
+const int lsReconnecting = 2;
+
+// Fleet connection : a batch of clients connected in parallel, each one with
+// its own deadline (TCP connection, ISO handshake and PDU negotiation).
+const int MaxFleetThreads = 1024;
+
+typedef struct {
+    TSnap7Client *Client; // Created by the caller
+    char  Address[16];    // PLC Address
+    int   Rack;
+    int   Slot;
+    int   Result;         // Output : connection result
+    int   Time;           // Output : connection time (ms)
+} TS7FleetItem, *PS7FleetItem;
+
+// Session sharing (p_i32_ShareSession) : clients with the same address, port and
+// TSAPs (i.e. rack, slot and connection type) are multiplexed over a single
+// physical connection. The jobs are served in arrival order, within two lanes
+// (p_i32_JobPriority) : a normal job yields the connection to the waiting high
+// priority jobs before each of its PDUs, so they wait at most one round trip
+// behind a bulk transfer. The preempted job resumes before the other normal
+// ones. A job waits for its turn up to its deadline and can be canceled
+// meanwhile (the wait runs in ShareTurnSlice steps to honor CancelJob).
+const int jpNormal = 0;
+const int jpHigh   = 1;
+const int ShareTurnSlice = 50; // ms
+
+class TSnap7Session;
+
+// The physical connection of a shared session
+class TSnap7SessionPeer: public TSnap7MicroClient
+{
+private:
+    TSnap7Session *FSession;
+    // State of the preempted job
+    TSnap7Job SavedJob;
+    TIsoDataPDU *SavedPDU;
+    pbyte SavedData;
+    int SavedSize;
+    longword SavedStart;
+    int SavedTimeout;
+    longword SavedDeadline;
+    longword SavedSerial;
+    longword SavedCancel;
+    TS7JobStamps SavedStamps;
+protected:
+    int ThrottleExchange(int Size);
+public:
+    TSnap7SessionPeer(TSnap7Session *Session);
+    ~TSnap7SessionPeer();
+    void SaveJob();
+    void RestoreJob();
+    // Ends the job in progress before its next PDU (called by its own thread)
+    void ExpireJob(bool Canceled);
+};
+
+class TSnap7Session
+{
+private:
+    TSnap7SessionPeer *Peer;
+    TSnap7Session *Next;     // Registry list
+    int RefCount;
+    PSnapCriticalSection CS;
+    bool Busy;
+    TSnap7Client *Owner;     // Client whose job is running
+    TSnap7Client *QueueHead; // Clients waiting for their turn (normal lane)
+    TSnap7Client *QueueTail;
+    TSnap7Client *HighHead;  // High priority lane
+    TSnap7Client *HighTail;
+    bool Unlink(TSnap7Client *&Head, TSnap7Client *&Tail, TSnap7Client *Client);
+    void Dequeue(TSnap7Client *Client);
+    bool Queued(TSnap7Client *Client);
+    int WaitTurn(TSnap7Client *Client, longword Deadline);
+    // 0, errCliJobTimeout or errCliJobCanceled (Deadline=0 : no limit)
+    int Acquire(TSnap7Client *Client, longword Deadline);
+    void Release();
+public:
+    // Called by the peer before each PDU of a job
+    void Yield();
+    TSnap7Session(TSnap7Client *Client);
+    ~TSnap7Session();
+    int Perform(TSnap7Client *Client, TSnap7Job &Job, longword Start, int Timeout);
+    int PDULength();
+    bool Connected();
+    void GetDemuxStats(PS7DemuxStats pStats, bool DoReset);
+    void SetDemuxLog(pfn_DemuxLog Log, void *usrPtr);
+    static int Attach(TSnap7Client *Client, TSnap7Session *&Session);
+    static void Detach(TSnap7Session *Session);
+};
+
+class TReconnectThread: public TSnapThread
+{
+private:
+	TSnap7Client * FClient;
+public:
+     TReconnectThread(TSnap7Client *Client)
+     {
+           FClient = Client;
+     }
+	void Execute();
+};
+
 class TClientThread: public TSnapThread
 {
 private:
@@ -47,6 +172,65 @@ public:
 	void Execute();
 };
 //---------------------------------------------------------------------------
+// Hedged reads
+//
+// When enabled (p_i32_HedgePercentile>0) the client holds a second ISO connection
+// to the same PLC. A read (ReadArea or ReadMultiVars, the only idempotent jobs)
+// still pending after the hedge threshold is repeated on the second connection
+// and the first answer wins, the other one is canceled.
+// The threshold is the given percentile of the last HedgeWindow read times of
+// the main connection (never less than p_i32_HedgeDelay), so only the slowest
+// reads are doubled.
+//---------------------------------------------------------------------------
+const int HedgeWindow     = 64; // Read time samples
+const int HedgeMinSamples = 16; // Below that p_i32_HedgeDelay is used
+const int HedgeMaxData    = 65536; // Bigger reads are not hedged
+const int HedgeRetryTime  = 5000;  // Min time between two connection attempts (ms)
+
+typedef struct {
+    longword Reads;     // Reads performed with hedging enabled
+    longword Hedged;    // Reads repeated on the second connection
+    longword Won;       // Reads answered first by the second connection
+    longword Threshold; // Current hedge threshold (ms)
+} TS7HedgeStats, *PS7HedgeStats;
+
+// Write coalescing (p_i32_WriteWindow > 0) : WriteArea calls (and DBWrite,
+// MBWrite...) coming from any thread are held for the window, or until
+// p_i32_WriteMaxItems are pending. Then the byte ranges of the same area that
+// overlap or touch are merged (the latest call wins on every byte, a bit
+// falling inside a segment is folded into it) and the segments are packed
+// into WriteMultiVars PDUs. Every caller gets the result
+// of the segment holding its data; a merged segment refused by the PLC is
+// written again entry by entry, so only the bad entries fail. A caller waits
+// up to p_i32_JobTimeout, unless its data are already being sent.
+const int WriteMaxItemsDef = 20;
+
+typedef struct TWriteEntry {
+    int Area;
+    int DBNumber;
+    int Start;
+    int Amount;
+    int WordLen;
+    void *pData;
+    int Result;
+    int Item;            // Item of the flush that carries it
+    TWriteEntry *Next;
+} *PWriteEntry;
+
+class TWriteBatch;
+
+class THedgeThread: public TSnapThread
+{
+private:
+	TSnap7Client * FClient;
+public:
+     THedgeThread(TSnap7Client *Client)
+     {
+           FClient = Client;
+     }
+	void Execute();
+};
+//---------------------------------------------------------------------------
 class TSnap7Client: public TSnap7MicroClient
 {
 private:
@@ -55,25 +239,137 @@ private:
     void CloseThread();
     void OpenThread();
     void StartAsyncJob();
+    // Hedging
+    THedgeThread *FHedgeThread;
+    TSnap7MicroClient *FHedge;  // Second connection
+    PSnapEvent EvtHedgeStart;   // Main -> hedge thread : a read started
+    PSnapEvent EvtHedgeStop;    // Main -> hedge thread : the read is over
+    PSnapEvent EvtHedgeIdle;    // Hedge thread -> main : nothing in progress
+    PSnapCriticalSection HedgeCS;
+    int HedgePercentile;
+    int HedgeDelay;
+    longword HedgeSamples[HedgeWindow];
+    int HedgeSamplesCount;
+    int HedgeSamplesIdx;
+    TS7HedgeStats HedgeStats;
+    longword HedgeThreshold;
+    volatile bool HedgeBusy;    // The hedge thread is working
+    volatile bool MainRunning;  // The read on the main connection is in progress
+    volatile bool HedgeRunning; // The read on the second connection is in progress
+    volatile bool HedgeWon;
+    bool HedgeDropped;          // Main connection lost canceling its read
+    longword HedgeLastTry;      // Last connection attempt of the second connection
+    pbyte HedgeData;
+    int HedgeDataSize;
+    TS7DataItem HedgeItems[MaxVars];
+    // Background reconnection
+    TReconnectThread *FReconnect;
+    PSnapEvent EvtReconnect;      // Job thread -> reconnect thread : link lost
+    PSnapEvent EvtReconnectStop;  // Stop reconnecting (disconnection/destruction)
+    PSnapEvent EvtReconnectIdle;  // Reconnect thread not working
+    PSnapEvent EvtLinkUp;         // Set while the link is up (or not wanted)
+    int ReconnectMode;
+    int ReconnectMin;             // First retry delay (ms)
+    int ReconnectMax;             // Max retry delay (ms)
+    volatile int LinkState;
+    volatile bool LinkWanted;     // Connected by the user and not disconnected
+    int LastPDU;                  // Last PDU size negotiated
+    longword JitterSeed;
+    pfn_CliLinkState CliLinkState;
+    void *FLinkUsrPtr;
+    // Diagnostic buffer tail
+    pfn_CliDiagEvent CliDiagEvent;
+    void *FDiagUsrPtr;
+    byte DiagLast[DiagEntrySize]; // Newest entry seen (as sent by the CPU)
+    bool DiagSynced;              // DiagLast is valid (all 0 : buffer empty)
+    pbyte DiagBuffer;
+    int DiagBufferSize;
+    int DiagRead(int Want, int &Count);
+    // Session sharing
+    bool ShareSession;
+    int JobPriority;
+    TSnap7Session *FShared;
+    PSnapEvent EvtTurn;            // Our turn on the shared session
+    TSnap7Client *ShareNext;       // Next in the shared session queue
+    bool ShareQueued;              // Waiting in the queue (inside the session CS)
+    // Write coalescing
+    int WriteWindow;
+    int WriteMaxItems;
+    TWriteBatch *WriteBatch;       // Batch collecting the writes
+    PSnapCriticalSection WriteCS;
+    PSnapCriticalSection FlushCS;
+    int CoalesceWrite(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+    void FlushWrites(TWriteBatch *Batch);
+    void SendWrites(PS7DataItem Pack, int *Index, int Count, PS7DataItem Items);
+    void WritePacked(PS7DataItem Items, int ItemsCount);
+    void OpenHedge();
+    void CloseHedge();
+    void ConnectHedge();
+    void PerformHedge();
+    void AddHedgeSample(longword Time);
+    longword GetHedgeThreshold();
+    int HedgeItemSize(PS7DataItem Item);
+    bool PrepareHedgeData();
+    void TakeHedgeData();
+    void RunHedged(int Operation);
+    void StopReconnect();
+    void Reconnect();
+    bool LinkReady();
+    void LinkLost(int Error);
+    void SetLinkState(int State, int Error);
 protected:
     PSnapEvent EvtJob;
     PSnapEvent EvtComplete;
     pfn_CliCompletion CliCompletion;
+    PMsgNotifier FNotifier;
+    PSnapCriticalSection NotifierCS; // FNotifier creation vs completion
+    bool AsDone;                     // Async job completed and not yet seen
+    bool AsRunning;                  // The job is performed by the worker thread
     void *FUsrPtr;
+    void ClearAsDone();
+    void JobCompleted();
     void DoCompletion();
+    void RunOperation(int Operation);
 public:
     friend class TClientThread;
+    friend class THedgeThread;
+    friend class TReconnectThread;
+    friend class TSnap7Session;
     TSnap7Client();
     ~TSnap7Client();
     int Reset(bool DoReconnect);
+    int Connect();
+    int Disconnect();
+    // Connects many clients (ItemsCount entries) in parallel, see TS7FleetItem
+    static int ConnectFleet(PS7FleetItem Items, int ItemsCount, int MaxParallel, int Timeout);
+    int SetLinkCallback(pfn_CliLinkState pCallback, void * usrPtr);
+    int GetLinkState(int &State);
+    // Diagnostic buffer entries newer than the last call, oldest first, through
+    // the callback. The first call only takes the newest entry as reference.
+    int SetDiagCallback(pfn_CliDiagEvent pCallback, void *usrPtr);
+    int DiagTail(int &NewEvents);
+    int GetHedgeStats(PS7HedgeStats pStats, bool DoReset);
+    // Response demultiplexer of the connection (the shared one if any)
+    int GetDemuxStats(PS7DemuxStats pStats, bool DoReset);
+    int SetDemuxCallback(pfn_DemuxLog pCallback, void *usrPtr);
+    // Memory taken by the client (and by its second connection if any)
+    int GetMemory(PS7MemoryInfo pInfo);
     int SetAsCallback(pfn_CliCompletion pCompletion, void * usrPtr);
+    int GetAsCallback(pfn_CliCompletion &pCompletion, void * &usrPtr);
     int GetParam(int ParamNumber, void *pValue);
     int SetParam(int ParamNumber, void *pValue);
     // Async functions
     bool CheckAsCompletion( int & opResult);
     int WaitAsCompletion(unsigned long Timeout);
+    // Descriptor that becomes readable when an async job completes
+    int GetAsCompletionFd(int &Fd);
+    int WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+    // Writes many bits in as few WriteMultiVars PDUs as possible
+    int WriteBits(PS7BitItem Item, int ItemsCount);
     int AsReadArea(int Area, int DBNumber, int Start, int Amount, int WordLen,  void * pUsrData);
     int AsWriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen,  void * pUsrData);
+    int AsReadMultiVars(PS7DataItem Item, int ItemsCount);
+    int AsWriteMultiVars(PS7DataItem Item, int ItemsCount);
     int AsListBlocksOfType(int BlockType,  PS7BlocksOfType pUsrData,   int & ItemsCount);
     int AsReadSZL(int ID, int Index,  PS7SZL pUsrData, int & Size);
     int AsReadSZLList(PS7SZLList pUsrData, int &ItemsCount);
@@ -100,5 +396,388 @@ public:
 
 typedef TSnap7Client *PSnap7Client;
 
+//---------------------------------------------------------------------------
+// Client pool
+//
+// Up to p_i32_PoolSize sessions (TCP/ISO connections) to the same PLC.
+// Independent jobs run on any idle session (AcquireSession/ReleaseSession),
+// a big ReadArea/WriteArea is sliced on PDU boundaries and the slices run in
+// parallel on the idle sessions.
+// The sessions are opened on demand and never exceed MaxConnections (from the
+// CP info of the PLC, else from its family profile) minus p_i32_PoolReserve :
+// the reserve is left to the HMI/engineering connections.
+// A session which loses the connection, or fails PoolMaxErrors jobs in a row
+// because of the transport, is closed and reopened after PoolRetryTime.
+//---------------------------------------------------------------------------
+const int MaxPoolSessions = 16;
+const int PoolRetryTime   = 2000;  // ms before reopening a failed session
+const int PoolMaxErrors   = 3;     // Transport errors in a row that close a session
+const int PoolWaitTime    = 10000; // Max wait for an idle session (ms)
+
+typedef struct {
+    int      Connected; // Session connected
+    int      Busy;      // Session in use
+    longword Jobs;      // Jobs performed
+    longword Errors;    // Jobs failed
+    int      LastError; // Last job error
+    int      LastTime;  // Last job execution time (ms)
+} TS7PoolSession, *PS7PoolSession;
+
+class TSnap7Pool
+{
+private:
+    TSnap7Client *Sessions[MaxPoolSessions];
+    TS7PoolSession Info[MaxPoolSessions];
+    int ErrorsInRow[MaxPoolSessions];
+    longword FailTime[MaxPoolSessions];
+    int Count;       // Sessions allowed, set on connection
+    int PoolSize;
+    int PoolReserve;
+    bool Active;     // Connected by the user
+    PSnapCriticalSection CS;
+    PSnapEvent EvtRelease;
+    int TryAcquire(bool CanOpen);
+    int Acquire(int &Index, int Timeout);
+    void Release(int Index, int Result);
+    int Stripe(bool Read, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+public:
+    TSnap7Pool();
+    ~TSnap7Pool();
+    int GetParam(int ParamNumber, void *pValue);
+    int SetParam(int ParamNumber, void *pValue);
+    void SetConnectionParams(const char *RemAddress, word LocalTSAP, word RemoteTsap);
+    void SetConnectionType(word ConnType);
+    int ConnectTo(const char *RemAddress, int Rack, int Slot);
+    int Connect();
+    int Disconnect();
+    int ReadArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+    int WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+    int ReadMultiVars(PS7DataItem Item, int ItemsCount);
+    int WriteMultiVars(PS7DataItem Item, int ItemsCount);
+    // Leases an idle session for any other job, it must be given back
+    int AcquireSession(TSnap7Client *&Session, int Timeout);
+    int ReleaseSession(TSnap7Client *Session);
+    int GetSessions(PS7PoolSession pUsrData, int &ItemsCount);
+};
+
+typedef TSnap7Pool *PSnap7Pool;
+
+//---------------------------------------------------------------------------
+// Rate-group scheduler
+//
+// Tag groups (arrays of TS7DataItem owned by the caller) are read every
+// Interval ms by a dedicated thread. All the cycles are aligned to a common
+// base tick (the GCD of the intervals, timerfd on Linux, a timed wait
+// elsewhere), so the groups due on the same tick are merged and packed into
+// as few ReadMultiVars PDUs as possible.
+// The client belongs to the scheduler while it runs : use a shared session
+// (p_i32_ShareSession) to keep another handle on the same PLC.
+// The callback runs in the scheduler thread at the end of each cycle, outside
+// the scheduler lock : it may query the stats and add or remove groups.
+//
+// Adaptive rates (p_i32_AdaptTarget > 0) : every AdaptPeriod the intervals
+// are stretched (x 5/4) if the link was busy more than the target, if cycles
+// were lost or if the OB1 cycle time of the CPU (SZL 0x0222, p_i32_AdaptCycle)
+// rose too much over the lowest one seen; they are shortened (- 1/10) when
+// the load is below 3/4 of the target. The base tick is scaled, so the ratios
+// between the groups (and the merging) are preserved; the tick count goes on,
+// so each group keeps its phase.
+//---------------------------------------------------------------------------
+const int MaxSchedGroups = 32;
+const int AdaptPeriod    = 1000; // ms
+
+// Reasons of the last adjustment
+const int arNone     = 0;
+const int arLoad     = 1; // Link load over the target
+const int arOverrun  = 2; // Cycles lost
+const int arPlcCycle = 3; // OB1 cycle time rise
+const int arIdle     = 4; // Load under the target : faster
+
+typedef struct {
+    longword Cycles;     // Cycles performed
+    longword Overruns;   // Cycles skipped because the scheduler was late
+    longword Errors;     // Cycles with at least an item failed
+    int      LastError;  // Last error (job or item)
+    longword JitterLast; // Delay of the cycle start vs. the ideal tick (us)
+    longword JitterMax;
+    longword JitterAvg;
+    longword TimeLast;   // Execution time of the (merged) cycle (us)
+    longword TimeMax;
+} TS7GroupStats, *PS7GroupStats;
+
+typedef struct {
+    int      BaseTick;   // Current base tick (ms)
+    longword Ticks;      // Ticks elapsed
+    longword Requests;   // PDUs sent
+    longword Items;      // Items read
+} TS7SchedStats, *PS7SchedStats;
+
+typedef struct {
+    int      Stretch;     // Current intervals (% of the nominal ones)
+    int      Load;        // Link load of the last period (%)
+    int      RTT;         // Average request time of the last period (us)
+    int      PlcCycle;    // Last OB1 cycle time (ms), 0 = not available
+    int      PlcCycleMin; // Lowest OB1 cycle time seen (ms)
+    longword Adjustments; // Changes of the intervals
+    longword SlowDowns;
+    longword SpeedUps;
+    int      LastReason;  // arXXX
+} TS7AdaptStats, *PS7AdaptStats;
+
+typedef struct {
+    bool Used;
+    int Interval;
+    int Ratio;           // Interval / nominal base tick
+    PS7DataItem Items;
+    int ItemsCount;
+    pfn_SchedGroupDone Callback;
+    void *usrPtr;
+    int DueCount;        // Times due in the current batch of ticks
+    TS7GroupStats Stats;
+    int64_t JitterSum;
+    longword Gen;        // Tells a group from a later one in the same slot
+} TSchedGroup;
+
+// A group taken out for the cycle in progress
+typedef struct {
+    int Group;
+    longword Gen;
+    PS7DataItem Items;
+    int ItemsCount;
+    int Overruns;
+    int Result;
+    pfn_SchedGroupDone Callback;
+    void *usrPtr;
+} TSchedDue;
+
+class TSchedThread;
+
+class TSnap7Scheduler
+{
+private:
+    TSnap7Client *Client;
+    TSchedGroup Groups[MaxSchedGroups];
+    TS7SchedStats Stats;
+    TSchedThread *FThread;
+    PSnapCriticalSection CS;
+    PSnapEvent EvtWake;
+    PSnapEvent EvtIdle;  // Set when no group is being read
+    bool Reading;        // The items of the due groups are being read
+    longword Generation;
+    bool Rearm;          // Groups changed : recompute the base tick
+    longword T0;         // Timer start (ms)
+    longword T0us;       // Timer start (us)
+    int NominalTick;     // GCD of the intervals (ms)
+    // Adaptive rates
+    int AdaptTarget;
+    int AdaptMin;
+    int AdaptMax;
+    int AdaptCycle;
+    bool CycleFailed;    // SZL 0x0222 not available
+    PS7SZL SZL;
+    TS7AdaptStats AdaptStats;
+    longword PeriodStart;
+    int64_t PeriodBusy;  // us
+    longword PeriodRequests;
+    longword PeriodOverruns;
+#ifdef __linux__
+    int TimerFd;
+#endif
+    // Cycle in progress (scheduler thread only)
+    TSchedDue DueList[MaxSchedGroups];
+    int DueGroups;
+    longword CycleRequests;
+    // Merged batch
+    TS7DataItem Batch[MaxVars];
+    PS7DataItem Source[MaxVars];
+    int BatchCount;
+    int BatchReq;
+    int BatchRes;
+    void Arm();
+    void SetTick();
+    void Wake();
+    int WaitTick();
+    void Cycle(int Expirations);
+    void AddToBatch(PS7DataItem Item);
+    void FlushBatch();
+    int ReadPlcCycle();
+    void Adapt();
+    friend class TSchedThread;
+public:
+    TSnap7Scheduler(TSnap7Client *AClient);
+    ~TSnap7Scheduler();
+    int AddGroup(int Interval, PS7DataItem Items, int ItemsCount, pfn_SchedGroupDone Callback, void *usrPtr, int &GroupId);
+    int RemoveGroup(int GroupId);
+    int Start();
+    int Stop();
+    int GetGroupStats(int GroupId, PS7GroupStats pStats, bool DoReset);
+    int GetStats(PS7SchedStats pStats);
+    int GetParam(int ParamNumber, void *pValue);
+    int SetParam(int ParamNumber, void *pValue);
+    int GetAdaptStats(PS7AdaptStats pStats, bool DoReset);
+};
+
+typedef TSnap7Scheduler *PSnap7Scheduler;
+
+//---------------------------------------------------------------------------
+// PLC clock estimator
+//
+// A thread reads the PLC clock every Interval ms (NTP-style) : the PLC time
+// is compared with the midpoint of the request round trip (kernel stamps when
+// p_i32_RecvStamps is set on the client). Of the last ClockFilterSize samples
+// only the one with the shortest round trip is kept, the kept ones feed a
+// least squares fit of offset and drift. The model maps PLC timestamps (DT,
+// DTL read as UTC, see S7_DATE_AND_TIMEToNs in s7.h) to host time and back.
+// A PLC clock step (set by the user or NTP on the PLC) restarts the fit
+// after ClockStepCount consistent samples.
+// As the scheduler, the estimator owns the client while it runs : use a shared
+// session (p_i32_ShareSession) to keep another handle on the same PLC.
+//---------------------------------------------------------------------------
+const int ClockFilterSize  = 8;
+const int ClockFitSize     = 32;
+const int ClockIntervalDef = 2000;      // ms
+const int64_t ClockStepLimit = 128000000; // ns of disagreement with the model
+const int ClockStepCount   = 3;
+const int ClockMaxDrift    = 1000000;   // ppb, larger fits are clamped
+const int64_t ClockFitSpan = 10000000000LL; // ns of samples needed to fit the drift
+
+typedef struct {
+    longword Samples;    // Clock reads performed
+    longword Errors;     // Clock reads failed
+    longword Steps;      // PLC clock steps detected
+    int      Valid;      // The model is usable
+    int      Kernel;     // The last sample used kernel receive stamps
+    int64_t  Offset;     // PLC - host time now (ns), the time zone of the PLC included
+    int      Drift;      // PLC clock rate vs host (ppb, > 0 : the PLC runs faster)
+    int      RTT;        // Round trip of the best recent sample (us)
+    int      Jitter;     // RMS residual of the fit (us)
+    int64_t  LastSample; // Host time of the last sample (ns since the epoch)
+} TS7ClockStats, *PS7ClockStats;
+
+typedef struct {
+    int64_t Mid;    // Host time of the round trip midpoint
+    int64_t Offset; // PLC - host
+    int64_t RTT;
+} TClockSample;
+
+class TClockThread;
+
+class TSnap7ClockSync
+{
+private:
+    TSnap7Client *Client;
+    TClockThread *FThread;
+    PSnapCriticalSection CS;
+    PSnapEvent EvtWake;
+    int Interval;
+    TS7ClockStats Stats;
+    TClockSample Raw[ClockFilterSize];
+    int RawCount;
+    int RawIdx;
+    TClockSample Fit[ClockFitSize];
+    int FitCount;
+    int FitIdx;
+    int64_t LastFit;     // Mid of the last sample fitted
+    int StepSamples;     // Consecutive samples far from the model
+    // Model (inside CS) : Offset(t) = Base + Drift * (t - Ref)
+    int64_t Ref;
+    int64_t Base;
+    double Drift;        // ns/ns
+    void AddSample(int64_t Sent, int64_t Received, int64_t PlcTime, bool Kernel);
+    void Refit();
+    friend class TClockThread;
+public:
+    TSnap7ClockSync(TSnap7Client *AClient);
+    ~TSnap7ClockSync();
+    int Start(int AInterval);
+    int Stop();
+    // Reads the PLC clock once (in the caller thread)
+    int Sample();
+    int GetStats(PS7ClockStats pStats);
+    int PlcToHost(int64_t PlcTime, int64_t &HostTime);
+    int HostToPlc(int64_t HostTime, int64_t &PlcTime);
+};
+
+typedef TSnap7ClockSync *PSnap7ClockSync;
+
+//---------------------------------------------------------------------------
+// Block backup
+//
+// Backs up the program blocks (OB, FB, FC, DB and SDB) of a PLC through a
+// pool. The blocks are listed and their infos read (pipelined) on a single
+// session; a block whose checksum, version and load size match the index of
+// the previous backup is not uploaded again. The others are fully uploaded
+// in parallel by up to p_i32_PoolSize workers, each one leasing a session of
+// the pool.
+// The images are stored in Folder by content, <hash>.mc7 (FNV-1a 64), so a
+// block is stored once whatever the PLCs (sharing the folder) and the
+// backups holding it; the index (IndexName in Folder, one per PLC) maps each
+// block to its image.
+// Note that the checksum of a DB covers its structure and initial values :
+// a DB whose actual values only changed is not uploaded again.
+//---------------------------------------------------------------------------
+const int BackupMaxPath  = 512;
+const int BackupMaxBlock = 65536;
+
+// Entry status
+const int bsUnchanged = 0; // As in the index, not uploaded
+const int bsUploaded  = 1; // Uploaded and stored
+const int bsFailed    = 2; // Block info or upload failed (Result)
+
+typedef struct {
+    int      BlkType;   // Block_OB, Block_DB ...
+    int      BlkNumber;
+    int      CheckSum;
+    int      Version;
+    int      LoadSize;  // From the block info
+    int      Size;      // Bytes of the image
+    int      Status;
+    int      Result;
+    uint64_t Hash;      // Key of the image in the folder
+} TS7BackupEntry, *PS7BackupEntry;
+
+typedef struct {
+    int      Blocks;
+    int      Unchanged;
+    int      Uploaded;
+    int      Failed;
+    int      Stored;    // Images new to the folder
+    longword Bytes;     // Bytes uploaded
+    int      Time;      // ms
+} TS7BackupStats, *PS7BackupStats;
+
+class TBackupThread;
+
+class TSnap7Backup
+{
+private:
+    TSnap7Pool *Pool;
+    PSnapCriticalSection CS;
+    PS7BackupEntry Entries;
+    int EntriesCount;
+    TS7BackupStats Stats;
+    char Folder[BackupMaxPath];
+    int *Queue;          // Entries to upload
+    int QueueCount;
+    volatile int Next;   // Next of Queue to upload
+    int ListBlocks(TSnap7Client *Session);
+    void ReadIndex(const char *Path, PS7BackupEntry &Index, int &IndexCount);
+    int WriteIndex(const char *Path);
+    bool Stored(uint64_t Hash);
+    int Store(uint64_t Hash, pbyte Data, int Size, int Tag);
+    void Upload(PS7BackupEntry Entry, pbyte &Buffer, int &Room, int Tag);
+    void UploadNext();
+    friend class TBackupThread;
+public:
+    TSnap7Backup(TSnap7Pool *APool);
+    ~TSnap7Backup();
+    int Run(const char *AFolder, const char *IndexName);
+    // Result of the last run
+    int GetEntries(PS7BackupEntry pUsrData, int &ItemsCount);
+    int GetStats(PS7BackupStats pStats);
+};
+
+typedef TSnap7Backup *PSnap7Backup;
+
 //---------------------------------------------------------------------------
 #endif // s7_client_h
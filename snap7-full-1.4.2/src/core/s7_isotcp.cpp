@@ -25,7 +25,12 @@
 |=============================================================================*/
 #include "s7_isotcp.h"
 #include "s7_types.h"  // Added on 7/5/2024
-#include <iostream>    // Added on 7/5/2024
+
+// Demux slot states
+const int dsFree    = 0;
+const int dsWaiting = 1; // Exchange in flight
+const int dsParked  = 2; // Answer received, not yet taken
+const int dsGivenUp = 3; // Exchange failed, its answer would be late
 //---------------------------------------------------------------------------
 TIsoTcpSocket::TIsoTcpSocket()
 {
@@ -39,10 +44,23 @@ TIsoTcpSocket::TIsoTcpSocket()
 	IsoPDUSize =1024;
     IsoMaxFragments=MaxIsoFragments;
     LastIsoError=0;
+    memset(Slots, 0, sizeof(Slots));
+    DemuxNext=0;
+    memset(&DemuxStats, 0, sizeof(DemuxStats));
+    memset(&IsoCounters, 0, sizeof(IsoCounters));
+    OnDemuxLog=NULL;
+    DemuxLogPtr=NULL;
+    LogWindow=0;
+    LogCount=0;
+    LogSuppressed=0;
+    ExchSent=0;
+    ExchRecv=0;
+    ExchKernel=false;
 }
 //---------------------------------------------------------------------------
 TIsoTcpSocket::~TIsoTcpSocket()
 {
+    DemuxReset();
 }
 //---------------------------------------------------------------------------
 int TIsoTcpSocket::CheckPDU(void *pPDU, u_char PduTypeExpected)
@@ -186,6 +204,8 @@ int TIsoTcpSocket::isoConnect()
 	u_int Length;
 	int Result;
 
+	// Sequences restart with the connection
+	DemuxReset();
 	// Build the default connection telegram
 	BuildControlPDU();
     ControlPDU =&FControlPDU;
@@ -299,62 +319,242 @@ int TIsoTcpSocket::isoRecvBuffer(void *Data, int & Size)
 	return Result;
 }
 //---------------------------------------------------------------------------
-// int TIsoTcpSocket::isoExchangeBuffer(void *Data, int &Size)
-// {
-// 	int Result;
-
-//     ClrIsoError();
-// 	Result =isoSendBuffer(Data, Size);
-// 	if (Result==0)
-// 		Result =isoRecvBuffer(Data, Size);
-// 	return Result;
-// }
 int TIsoTcpSocket::isoExchangeBuffer(void *Data, int &Size)
 {
-	/*int Result;
+	int Result, Slot;
 
-    ClrIsoError();
-	Result =isoSendBuffer(Data, Size);
-	if (Result==0)
-		Result =isoRecvBuffer(Data, Size);
-	return Result; */
-	
-	// Improved based on the solution: https://sourceforge.net/p/snap7/discussion/bugfix/thread/de352e4cc2/
-  	// Provided by 	Stéphane Rousseau 
-	// Changed on 7/5/2024 by Reyan Valdes
+	Result = isoSendRequest(Data, Size, Slot);
+	if (Result == 0)
+		Result = isoWaitAnswer(Slot, Size);
+	if ((Result == 0) && (Data != NULL))
+		memcpy(Data, &PDU.Payload, Size);
+	return Result;
+}
+//---------------------------------------------------------------------------
+int TIsoTcpSocket::isoSendRequest(void *Data, int Size, int &Slot)
+{
+	PS7ReqHeader Header;
 	int Result;
 
 	ClrIsoError();
-	PS7ReqHeader pduheader = (PS7ReqHeader)&PDU.Payload;
-	int PDUTypeSend = pduheader->PDUType;
-	int PDUTypeSequence = pduheader->Sequence;
+	Slot = -1;
+	// Job deadline already expired (or job aborted) : don't start a new exchange
+	if (DeadlineExpired())
+	{
+		LastTcpError=WSAETIMEDOUT;
+		return SetIsoError(errIsoSendPacket);
+	}
+	Result = ThrottleExchange(Size);
+	if (Result != 0)
+		return Result;
+	Header = PS7ReqHeader(Data != NULL ? Data : &PDU.Payload);
+	Slot = DemuxOpen(Header->Sequence);
+	if (Slot < 0)
+		return SetIsoError(errIsoNoSlot);
+	if (RecvStamps)
+		Slots[Slot].Sent = SysGetRealTime();
 	Result = isoSendBuffer(Data, Size);
 	if (Result == 0)
 	{
-		bool SequenceMatch = false;
-		while (!SequenceMatch && Result == 0)
+		IsoCounters.PDUsSent++;
+		IsoCounters.BytesSent += Size;
+	}
+	else
+	{
+		DemuxFree(Slot);
+		Slot = -1;
+	}
+	return Result;
+}
+//---------------------------------------------------------------------------
+int TIsoTcpSocket::isoWaitAnswer(int Slot, int &Size)
+{
+	int Result;
+
+	ExchSent = Slots[Slot].Sent;
+	Result = DemuxWait(Slot, Size);
+	if (Result == 0)
+		ExchangeReceived(Size);
+	return Result;
+}
+//---------------------------------------------------------------------------
+// The answer will be dropped as late when it comes
+void TIsoTcpSocket::isoDropAnswer(int Slot)
+{
+	if ((Slot < 0) || (Slot >= DemuxSlots))
+		return;
+	if (Slots[Slot].State == dsWaiting)
+		Slots[Slot].State = dsGivenUp;
+	else if (Slots[Slot].State == dsParked)
+		DemuxFree(Slot);
+}
+//---------------------------------------------------------------------------
+// A free slot, else the slots of the exchanges given up are recycled in turn
+// (forgetting the oldest ones). -1 if every slot is in flight or parked.
+int TIsoTcpSocket::DemuxOpen(word Sequence)
+{
+	int Slot = -1;
+	int c;
+
+	for (c = 0; (c < DemuxSlots) && (Slot < 0); c++)
+		if (Slots[c].State == dsFree)
+			Slot = c;
+	for (c = 0; (c < DemuxSlots) && (Slot < 0); c++)
+	{
+		if (Slots[DemuxNext].State == dsGivenUp)
 		{
-			Result = isoRecvBuffer(Data, Size);
-			if (Result == 0)
-			{
-				if (pduheader->PDUType == PduType_response &&
-					pduheader->Sequence == PDUTypeSequence)
-				{
-					SequenceMatch = true;
-				}
-				else
-				{
-					std::cout << "[PROFINET] PDU Rejected didn't match response with request" << std::endl;
-				
-				  	// TRACE("PDU Rejected ! : pduheader->PDUType %d pduheader->Sequence %d waiting for sequence %d for PDUType %d\r\n", pduheader->PDUType, pduheader->Sequence, PDUTypeSequence, PDUTypeSend);
-				}
-			}
+			Slot = DemuxNext;
+			DemuxFree(Slot);
 		}
+		DemuxNext = (DemuxNext + 1) % DemuxSlots;
 	}
-	return Result;
+	if (Slot < 0)
+		return -1;
+	Slots[Slot].State = dsWaiting;
+	Slots[Slot].Sequence = Sequence;
+	return Slot;
 }
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::DemuxFree(int Slot)
+{
+	if (Slots[Slot].Data != NULL)
+		delete[] Slots[Slot].Data;
+	Slots[Slot].Data = NULL;
+	Slots[Slot].Size = 0;
+	Slots[Slot].State = dsFree;
+}
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::DemuxReset()
+{
+	int c;
+	for (c = 0; c < DemuxSlots; c++)
+		DemuxFree(c);
+	DemuxNext = 0;
+}
+//---------------------------------------------------------------------------
+// Receives until the answer of Slot arrives (or was parked before), the
+// frames of the other exchanges are dispatched
+int TIsoTcpSocket::DemuxWait(int Slot, int &Size)
+{
+	PS7ReqHeader Header;
+	int Result, Owner, c;
 
+	for (;;)
+	{
+		if (Slots[Slot].State == dsParked)
+		{
+			memcpy(&PDU, Slots[Slot].Data, Slots[Slot].Size);
+			Size = Slots[Slot].Size - DataHeaderSize;
+			ExchRecv = Slots[Slot].Stamp;
+			ExchKernel = Slots[Slot].Kernel;
+			DemuxFree(Slot);
+			DemuxStats.Matched++;
+			return 0;
+		}
+		if (RecvStamps)
+			ArmRecvStamp();
+		Result = isoRecvBuffer(NULL, Size);
+		if (Result != 0)
+		{
+			Slots[Slot].State = dsGivenUp;
+			return Result;
+		}
+		IsoCounters.PDUsRecv++;
+		IsoCounters.BytesRecv += Size;
+		Header = PS7ReqHeader(&PDU.Payload);
+		Owner = -1;
+		// Userdata requests (SZL, clock, block info...) are answered by userdata
+		if ((Header->PDUType == PduType_response) || (Header->PDUType == PduType_userdata))
+			for (c = 0; (c < DemuxSlots) && (Owner < 0); c++)
+				if (((Slots[c].State == dsWaiting) || (Slots[c].State == dsGivenUp)) &&
+					(Slots[c].Sequence == Header->Sequence))
+					Owner = c;
+		if (Owner == Slot)
+		{
+			ExchRecv = RecvStamp;
+			ExchKernel = RecvStampKernel;
+			Slots[Slot].State = dsFree;
+			DemuxStats.Matched++;
+			return 0;
+		}
+		if (Owner < 0)
+		{
+			DemuxStats.Stray++;
+			DemuxEvent(deStray, Header->Sequence, Header->PDUType);
+		}
+		else if (Slots[Owner].State == dsGivenUp)
+		{
+			DemuxFree(Owner);
+			DemuxStats.Late++;
+			DemuxEvent(deLate, Header->Sequence, Header->PDUType);
+		}
+		else
+		{
+			Slots[Owner].Size = Size + DataHeaderSize;
+			Slots[Owner].Data = new byte[Slots[Owner].Size];
+			memcpy(Slots[Owner].Data, &PDU, Slots[Owner].Size);
+			Slots[Owner].Stamp = RecvStamp;
+			Slots[Owner].Kernel = RecvStampKernel;
+			Slots[Owner].State = dsParked;
+			DemuxStats.Parked++;
+			DemuxEvent(deParked, Header->Sequence, Header->PDUType);
+		}
+	}
+}
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::DemuxEvent(int Event, word Sequence, int PDUType)
+{
+	longword Now;
 
+	if (OnDemuxLog == NULL)
+		return;
+	Now = SysGetTick();
+	if (DeltaTime(LogWindow) >= 1000)
+	{
+		LogWindow = Now;
+		LogCount = 0;
+	}
+	if (LogCount < DemuxLogRate)
+	{
+		LogCount++;
+		OnDemuxLog(DemuxLogPtr, Event, SwapWord(Sequence), PDUType, LogSuppressed);
+		LogSuppressed = 0;
+	}
+	else
+		LogSuppressed++;
+}
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::GetDemuxStats(PS7DemuxStats pStats, bool DoReset)
+{
+	*pStats = DemuxStats;
+	if (DoReset)
+		memset(&DemuxStats, 0, sizeof(DemuxStats));
+}
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::SetDemuxLog(pfn_DemuxLog Log, void *usrPtr)
+{
+	DemuxLogPtr = usrPtr;
+	OnDemuxLog = Log;
+}
+//---------------------------------------------------------------------------
+longword TIsoTcpSocket::ParkedBytes()
+{
+	longword Result = 0;
+	int c;
+	for (c = 0; c < DemuxSlots; c++)
+		if (Slots[c].Data != NULL)
+			Result += Slots[c].Size;
+	return Result;
+}
+//---------------------------------------------------------------------------
+int TIsoTcpSocket::ThrottleExchange(int /*Size*/)
+{
+	return 0;
+}
+//---------------------------------------------------------------------------
+void TIsoTcpSocket::ExchangeReceived(int /*Size*/)
+{
+}
 //---------------------------------------------------------------------------
 bool TIsoTcpSocket::IsoPDUReady()
 {
@@ -370,6 +570,7 @@ int TIsoTcpSocket::isoDisconnect(bool OnlyTCP)
 	if (Connected)
 		Purge(); // Flush pending
 	LastIsoError=0;
+	DemuxReset();
 	// OnlyTCP true -> Disconnect Request telegram is not required : only TCP disconnection
 	if (!OnlyTCP)
 	{
@@ -450,7 +651,16 @@ int TIsoTcpSocket::isoRecvFragment(void *From, int Max, int &Size, bool &EoT)
 			{
 				RecvPacket(From, DataLength);
 				if (LastTcpError!=0)
+				{
+					// The header is gone : a late payload would be taken for a new telegram
+					if ((LastTcpError==WSAETIMEDOUT) && Connected)
+					{
+						ForceClose();
+						Connected=false;
+						LastTcpError=WSAETIMEDOUT;
+					}
 					return SetIsoError(errIsoRecvPacket);
+				}
 				else
 					Size =DataLength;
 			}
@@ -584,6 +794,64 @@ void TIsoTcpSocket::IsoPeek(void *pPDU, TPDUKind &PduKind)
             PduKind=pkUnrecognizedType;
     };
 }
-
-
-
+//==============================================================================
+// WORKING BUFFERS POOL
+//==============================================================================
+TS7BufferPool::TS7BufferPool(int Size)
+{
+	CS = new TSnapCriticalSection();
+	FreeCount = 0;
+	FSize = Size;
+	FLent = 0;
+}
+//---------------------------------------------------------------------------
+TS7BufferPool::~TS7BufferPool()
+{
+	int c;
+	for (c = 0; c < FreeCount; c++)
+		delete[] Free[c];
+	delete CS;
+}
+//---------------------------------------------------------------------------
+pbyte TS7BufferPool::Borrow()
+{
+	pbyte Result = NULL;
+
+	CS->Enter();
+	if (FreeCount > 0)
+		Result = Free[--FreeCount];
+	FLent++;
+	CS->Leave();
+	if (Result == NULL)
+		Result = new byte[FSize];
+	return Result;
+}
+//---------------------------------------------------------------------------
+void TS7BufferPool::Release(pbyte Buffer)
+{
+	if (Buffer == NULL)
+		return;
+	CS->Enter();
+	FLent--;
+	if (FreeCount < BufferPoolKeep)
+	{
+		Free[FreeCount++] = Buffer;
+		Buffer = NULL;
+	}
+	CS->Leave();
+	if (Buffer != NULL)
+		delete[] Buffer;
+}
+//---------------------------------------------------------------------------
+int TS7BufferPool::Size()
+{
+	return FSize;
+}
+//---------------------------------------------------------------------------
+void TS7BufferPool::Usage(longword &Lent, longword &Pooled)
+{
+	CS->Enter();
+	Lent = FLent * FSize;
+	Pooled = FreeCount * FSize;
+	CS->Leave();
+}
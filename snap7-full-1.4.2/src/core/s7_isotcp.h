@@ -27,6 +27,7 @@
 #define s7_isotcp_h
 //---------------------------------------------------------------------------
 #include "snap_msgsock.h"
+#include "snap_threads.h"
 //---------------------------------------------------------------------------
 #pragma pack(1)
 
@@ -53,7 +54,7 @@ const longword errIsoPduOverflow    	= 0x00080000; // The sum of fragments data
 const longword errIsoSendPacket         = 0x00090000; // An error occurred during send
 const longword errIsoRecvPacket         = 0x000A0000; // An error occurred during recv
 const longword errIsoInvalidParams    	= 0x000B0000; // Invalid TSAP params
-const longword errIsoResvd_1    	    = 0x000C0000; // Unassigned
+const longword errIsoNoSlot      	    = 0x000C0000; // All the demux slots in use
 const longword errIsoResvd_2    	    = 0x000D0000; // Unassigned
 const longword errIsoResvd_3    	    = 0x000E0000; // Unassigned
 const longword errIsoResvd_4    	    = 0x000F0000; // Unassigned
@@ -210,6 +211,83 @@ typedef enum {
 
 void ErrIsoText(int Error, char *Msg, int len);
 
+//---------------------------------------------------------------------------
+// Working buffers pool : the big buffers that only some operations need are
+// borrowed for the job and given back, up to BufferPoolKeep of them are kept
+// for the next borrowers, the others are freed.
+//---------------------------------------------------------------------------
+const int BufferPoolKeep = 8;
+
+// Memory taken by a client or by the sessions of a server (bytes)
+typedef struct {
+	int Sessions;         // Connections
+	longword Fixed;       // Objects, whatever the traffic
+	longword Buffers;     // Working buffers held now
+	longword Pooled;      // Free buffers kept by the pool (shared by the process)
+	longword PerSession;  // (Fixed+Buffers)/Sessions, or the cost of a new session
+} TS7MemoryInfo, *PS7MemoryInfo;
+
+class TS7BufferPool
+{
+private:
+	PSnapCriticalSection CS;
+	pbyte Free[BufferPoolKeep];
+	int FreeCount;
+	int FSize;
+	longword FLent;
+public:
+	TS7BufferPool(int Size);
+	~TS7BufferPool();
+	pbyte Borrow();
+	void Release(pbyte Buffer);
+	int Size();
+	// Bytes borrowed now and bytes kept for the next borrowers
+	void Usage(longword &Lent, longword &Pooled);
+};
+
+//---------------------------------------------------------------------------
+// Response demultiplexer : every exchange in flight is keyed by the sequence
+// of its S7 request. A frame answering another exchange in flight is parked
+// until that exchange waits for it, a frame answering an exchange given up
+// (receive error) is dropped as late, any other frame is dropped as stray.
+// The events are counted and passed to the log hook, at most DemuxLogRate
+// times per second : the events skipped meanwhile are given in Suppressed.
+//---------------------------------------------------------------------------
+const int DemuxSlots   = 8;
+const int DemuxLogRate = 10;
+
+// Demux events
+const int deParked = 1;
+const int deLate   = 2;
+const int deStray  = 3;
+
+typedef struct {
+    longword Matched; // Answers delivered to their exchange
+    longword Parked;  // Answers received while waiting for another one
+    longword Late;    // Answers of exchanges given up, dropped
+    longword Stray;   // Frames of no exchange, dropped
+} TS7DemuxStats, *PS7DemuxStats;
+
+// Exchange counters
+typedef struct {
+    longword PDUsSent;
+    longword PDUsRecv; // Frames received, out of sequence ones too
+    longword BytesSent;
+    longword BytesRecv;
+} TIsoCounters;
+
+typedef void (S7API *pfn_DemuxLog)(void *usrPtr, int Event, int Sequence, int PDUType, int Suppressed);
+
+typedef struct {
+    int State;     // dsXXX
+    word Sequence; // As in the request header
+    int Size;      // Parked frame size
+    pbyte Data;    // Parked frame
+    uint64_t Stamp; // Arrival of the parked frame
+    bool Kernel;
+    uint64_t Sent;  // Request sent (RecvStamps)
+} TDemuxSlot;
+
 class TIsoTcpSocket : public TMsgSocket
 {
 private:
@@ -220,6 +298,20 @@ private:
 	int CheckPDU(void *pPDU, u_char PduTypeExpected);
 	// Receives the next fragment
 	int isoRecvFragment(void *From, int Max, int &Size, bool &EoT);
+	// Response demultiplexer
+	TDemuxSlot Slots[DemuxSlots];
+	int DemuxNext;
+	TS7DemuxStats DemuxStats;
+	pfn_DemuxLog OnDemuxLog;
+	void *DemuxLogPtr;
+	longword LogWindow;
+	int LogCount;
+	int LogSuppressed;
+	int DemuxOpen(word Sequence);
+	void DemuxFree(int Slot);
+	void DemuxReset();
+	int DemuxWait(int Slot, int &Size);
+	void DemuxEvent(int Event, word Sequence, int PDUType);
 protected:
 	TIsoDataPDU PDU;
 	int SetIsoError(int Error);
@@ -234,6 +326,20 @@ protected:
 	int IsoConfirmConnection(u_char PDUType);
     void ClrIsoError();
 	virtual void FragmentSkipped(int Size);
+	// Called before sending a request (rate limiting), a nonzero result aborts the exchange
+	virtual int ThrottleExchange(int Size);
+	// Called when the answer of a request has been received
+	virtual void ExchangeReceived(int Size);
+	// Wall clock stamps of the last exchange (only with RecvStamps)
+	uint64_t ExchSent;
+	uint64_t ExchRecv;
+	bool ExchKernel; // ExchRecv comes from the kernel
+	// Pipelined exchanges : isoSendRequest sends a request and returns its demux
+	// slot, the answer is taken later (into PDU) with isoWaitAnswer, in any order,
+	// or given up with isoDropAnswer. isoExchangeBuffer is the two in a row.
+	int isoSendRequest(void *Data, int Size, int &Slot);
+	int isoWaitAnswer(int Slot, int &Size);
+	void isoDropAnswer(int Slot);
 public:
 	word SrcTSap;  // Source TSAP
 	word DstTSap;  // Destination TSAP
@@ -241,6 +347,7 @@ public:
 	word DstRef;   // Destination Reference
 	int IsoPDUSize;
 	int LastIsoError;
+	TIsoCounters IsoCounters;
 	//--------------------------------------------------------------------------
 	TIsoTcpSocket();
 	~TIsoTcpSocket();
@@ -266,6 +373,11 @@ public:
 	int isoExchangePDU(PIsoDataPDU Data);
 	// Peeks an header info to know which kind of telegram is incoming
 	void IsoPeek(void *pPDU, TPDUKind &PduKind);
+	// Demultiplexer counters and log hook
+	void GetDemuxStats(PS7DemuxStats pStats, bool DoReset);
+	void SetDemuxLog(pfn_DemuxLog Log, void *usrPtr);
+	// Bytes held by the parked answers
+	longword ParkedBytes();
 };
 
 #endif // s7_isotcp_h
@@ -25,6 +25,13 @@
 |=============================================================================*/
 #include "s7_micro_client.h"
 //---------------------------------------------------------------------------
+TS7BufferPool *ClientDataPool()
+{
+    // Never destroyed : clients may outlive the static objects at exit
+    static TS7BufferPool *Pool = new TS7BufferPool(sizeof(TS7Buffer));
+    return Pool;
+}
+//---------------------------------------------------------------------------
 
 TSnap7MicroClient::TSnap7MicroClient()
 {
@@ -41,11 +48,76 @@ TSnap7MicroClient::TSnap7MicroClient()
 	DstTSap =0x0000; // It's filled by connection functions
     ConnectionType = CONNTYPE_PG; // Default connection type
 	memset(&Job,0,sizeof(TSnap7Job));
+    FBucket = NULL;
+    RateLimitPDU = 0;
+    RateLimitBytes = 0;
+    RateLimitMode = rlBlock;
+    JobTimeout = 0;
+    JobSerial = 1;
+    CancelRequest = 0;
+    Family = plcUnknown;
+    memset(Hists, 0, sizeof(Hists));
+    memset(HistsBase, 0, sizeof(HistsBase));
+    memset(&JobCounters, 0, sizeof(JobCounters));
+    memset(&JobBase, 0, sizeof(JobBase));
+    memset(&IsoBase, 0, sizeof(IsoBase));
+    RetriesBase = 0;
+    MismatchesBase = 0;
+    StatsCS = new TSnapCriticalSection();
+    JobCS = new TSnapCriticalSection();
+    memset(&JobStamps, 0, sizeof(JobStamps));
+    opData = NULL;
+    DBLengths = NULL;
+    DBLengthsCount = 0;
+    DBLengthsSize = 0;
 }
 //---------------------------------------------------------------------------
 TSnap7MicroClient::~TSnap7MicroClient()
 {
+    int c;
     Destroying = true;
+    DetachBucket();
+    for (c = 0; c < MaxStatOps; c++)
+    {
+        delete Hists[c];
+        delete HistsBase[c];
+    }
+    delete StatsCS;
+    delete JobCS;
+    FreeData();
+    ClearDBLengths();
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::NeedData()
+{
+    if (opData==NULL)
+        opData=ClientDataPool()->Borrow();
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::FreeData()
+{
+    if (opData!=NULL)
+    {
+        ClientDataPool()->Release(opData);
+        opData=NULL;
+    }
+}
+//---------------------------------------------------------------------------
+longword TSnap7MicroClient::BuffersSize()
+{
+    longword Result = ParkedBytes();
+    int c;
+    if (opData!=NULL)
+        Result+=sizeof(TS7Buffer);
+    Result+=DBLengthsSize*sizeof(TDBLength);
+    for (c = 0; c < MaxStatOps; c++)
+    {
+        if (Hists[c]!=NULL)
+            Result+=sizeof(TOpHistogram);
+        if (HistsBase[c]!=NULL)
+            Result+=sizeof(TOpHistogram);
+    }
+    return Result;
 }
 //---------------------------------------------------------------------------
 int TSnap7MicroClient::opReadArea()
@@ -686,7 +758,7 @@ int TSnap7MicroClient::opListBlocksOfType()
 	bool                RoomError = false;
 
     BlockType=Job.Area;
-    List=(word*)(&opData);
+    List=(word*)(opData);
     // Setup pointers (note : PDUH_out and PDU.Payload are the same pointer)
     ReqParams=PReqFunGetBlockInfo(pbyte(PDUH_out)+sizeof(TS7ReqHeader));
     Answer   =PS7ResHeader17(&PDU.Payload);
@@ -805,7 +877,7 @@ int TSnap7MicroClient::opListBlocksOfType()
 			Count=Job.Amount;
 			RoomError=true;
 		}
-		memcpy(Job.pData, &opData, Count*2);
+		memcpy(Job.pData, opData, Count*2);
 		*Job.pAmount=Count;
 
 		if (RoomError) // Result==0 -> override if romerror
@@ -828,27 +900,14 @@ void TSnap7MicroClient::FillTime(word SiemensTime, char *PTime)
         *PTime='\0';
 }
 //---------------------------------------------------------------------------
-int TSnap7MicroClient::opAgBlockInfo()
+int TSnap7MicroClient::BlockInfoRequest(int BlockType, int BlockNum)
 {
-    PS7BlockInfo BlockInfo;
     PReqFunGetBlockInfo ReqParams;
     PReqDataBlockInfo ReqData;
-    PS7ResHeader17 Answer;
-    PResFunGetBlockInfo ResParams;
-    PResDataBlockInfo ResData;
-    byte BlockType;
-    int BlockNum, IsoSize, Result;
 
-    BlockType=Job.Area;
-    BlockNum =Job.Number;
-    BlockInfo=PS7BlockInfo(Job.pData);
-    memset(BlockInfo,0,sizeof(TS7BlockInfo));
     // Setup pointers (note : PDUH_out and PDU.Payload are the same pointer)
     ReqParams=PReqFunGetBlockInfo(pbyte(PDUH_out)+sizeof(TS7ReqHeader));
     ReqData  =PReqDataBlockInfo(pbyte(ReqParams)+sizeof(TReqFunGetBlockInfo));
-    Answer   =PS7ResHeader17(&PDU.Payload);
-    ResParams=PResFunGetBlockInfo(pbyte(Answer)+ResHeaderSize17);
-    ResData  =PResDataBlockInfo(pbyte(ResParams)+sizeof(TResFunGetBlockInfo));
     // Fill Header
     PDUH_out->P=0x32;                    // Always 0x32
     PDUH_out->PDUType=PduType_userdata;  // 0x07
@@ -883,114 +942,531 @@ int TSnap7MicroClient::opAgBlockInfo()
     BlockNum=BlockNum % 10;
     ReqData->AsciiBlk[4]=(BlockNum / 1)+0x30;
 
-    IsoSize=sizeof(TS7ReqHeader)+sizeof(TReqFunGetBlockInfo)+sizeof(TReqDataBlockInfo);
-    Result=isoExchangeBuffer(0,IsoSize);
+    return sizeof(TS7ReqHeader)+sizeof(TReqFunGetBlockInfo)+sizeof(TReqDataBlockInfo);
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::BlockInfoAnswer(PS7BlockInfo BlockInfo)
+{
+    PS7ResHeader17 Answer;
+    PResFunGetBlockInfo ResParams;
+    PResDataBlockInfo ResData;
+    int Result = 0;
+
+    memset(BlockInfo,0,sizeof(TS7BlockInfo));
+    Answer   =PS7ResHeader17(&PDU.Payload);
+    ResParams=PResFunGetBlockInfo(pbyte(Answer)+ResHeaderSize17);
+    ResData  =PResDataBlockInfo(pbyte(ResParams)+sizeof(TResFunGetBlockInfo));
+    if (ResParams->ErrNo==0)
+    {
+        if (SwapWord(ResData->Length)<40) // 78
+            return errCliInvalidPlcAnswer;
+        if (ResData->RetVal==0xFF) // <-- 0xFF means Result OK
+        {
+           //<----------------------------------------------Fill block info
+             BlockInfo->BlkType=ResData->SubBlkType;
+             BlockInfo->BlkNumber=SwapWord(ResData->BlkNumber);
+             BlockInfo->BlkLang=ResData->BlkLang;
+             BlockInfo->BlkFlags=ResData->BlkFlags;
+             BlockInfo->MC7Size=SwapWord(ResData->MC7Len);
+             BlockInfo->LoadSize=SwapDWord(ResData->LenLoadMem);
+             BlockInfo->LocalData=SwapWord(ResData->LocDataLen);
+             BlockInfo->SBBLength=SwapWord(ResData->SbbLen);
+             BlockInfo->CheckSum=SwapWord(ResData->BlkChksum);
+             BlockInfo->Version=ResData->Version;
+             memcpy(BlockInfo->Author, ResData->Author, 8);
+             memcpy(BlockInfo->Family,ResData->Family,8);
+             memcpy(BlockInfo->Header,ResData->Header,8);
+             FillTime(SwapWord(ResData->CodeTime_dy),BlockInfo->CodeDate);
+             FillTime(SwapWord(ResData->IntfTime_dy),BlockInfo->IntfDate);
+           //---------------------------------------------->Fill block info
+        }
+        else
+            Result=CpuError(ResData->RetVal);
+    }
+    else
+        Result=CpuError(SwapWord(ResParams->ErrNo));
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::opAgBlockInfo()
+{
+    PS7BlockInfo BlockInfo;
+    int IsoSize, Result;
 
+    BlockInfo=PS7BlockInfo(Job.pData);
+    memset(BlockInfo,0,sizeof(TS7BlockInfo));
+    IsoSize=BlockInfoRequest(Job.Area, Job.Number);
+    Result=isoExchangeBuffer(0,IsoSize);
     // Get Data
     if (Result==0)
+        Result=BlockInfoAnswer(BlockInfo);
+    // Any block info of a DB refreshes its cached length
+    if (Job.Area==Block_DB)
     {
-        if (ResParams->ErrNo==0)
+        if (Result==0)
+            SetDBLength(Job.Number, BlockInfo->MC7Size, BlockInfo->CheckSum);
+        else
+            DropDBLength(Job.Number);
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+// The requests are pipelined (the answers come in order)
+int TSnap7MicroClient::opAgBlockInfoMulti()
+{
+    PS7BlockInfoItem Items = PS7BlockInfoItem(Job.pData);
+    int ItemsCount = Job.Amount;
+    int Slots[AmqRequestMax];
+    int Queue[AmqRequestMax]; // Items in flight
+    int Window, Head, Count, Next, IsoSize, Size, Slot, Result, c;
+
+    if ((Items==NULL) || (ItemsCount<1))
+        return errCliInvalidParams;
+    for (c = 0; c < ItemsCount; c++)
+    {
+        memset(&Items[c].Info,0,sizeof(TS7BlockInfo));
+        if ((Items[c].BlkNumber<0) || (Items[c].BlkNumber>65535))
+            Items[c].Result=errCliInvalidParams;
+        else
+            Items[c].Result=0;
+    }
+    Window=PipeWindow();
+    Head  =0;
+    Count =0;
+    Next  =0;
+    Result=0;
+    for (;;)
+    {
+        while ((Count<Window) && (Next<ItemsCount))
         {
-            if (SwapWord(ResData->Length)<40) // 78
-                return errCliInvalidPlcAnswer;
-            if (ResData->RetVal==0xFF) // <-- 0xFF means Result OK
+            if (Items[Next].Result!=0)
             {
-               //<----------------------------------------------Fill block info
-                 BlockInfo->BlkType=ResData->SubBlkType;
-                 BlockInfo->BlkNumber=SwapWord(ResData->BlkNumber);
-                 BlockInfo->BlkLang=ResData->BlkLang;
-                 BlockInfo->BlkFlags=ResData->BlkFlags;
-                 BlockInfo->MC7Size=SwapWord(ResData->MC7Len);
-                 BlockInfo->LoadSize=SwapDWord(ResData->LenLoadMem);
-                 BlockInfo->LocalData=SwapWord(ResData->LocDataLen);
-                 BlockInfo->SBBLength=SwapWord(ResData->SbbLen);
-                 BlockInfo->CheckSum=SwapWord(ResData->BlkChksum);
-                 BlockInfo->Version=ResData->Version;
-                 memcpy(BlockInfo->Author, ResData->Author, 8);
-                 memcpy(BlockInfo->Family,ResData->Family,8);
-                 memcpy(BlockInfo->Header,ResData->Header,8);
-                 FillTime(SwapWord(ResData->CodeTime_dy),BlockInfo->CodeDate);
-                 FillTime(SwapWord(ResData->IntfTime_dy),BlockInfo->IntfDate);
-               //---------------------------------------------->Fill block info
+                Next++;
+                continue;
             }
+            IsoSize=BlockInfoRequest(Items[Next].BlkType, Items[Next].BlkNumber);
+            Result=isoSendRequest(NULL, IsoSize, Slot);
+            if (Result!=0)
+                break;
+            Slots[(Head+Count) % AmqRequestMax]=Slot;
+            Queue[(Head+Count) % AmqRequestMax]=Next++;
+            Count++;
+        }
+        if ((Result!=0) || (Count==0))
+            break;
+        c=Queue[Head];
+        Result=isoWaitAnswer(Slots[Head], Size);
+        if (Result!=0)
+            break;
+        Head=(Head+1) % AmqRequestMax;
+        Count--;
+        Items[c].Result=BlockInfoAnswer(&Items[c].Info);
+        if (Items[c].BlkType==Block_DB)
+        {
+            if (Items[c].Result==0)
+                SetDBLength(Items[c].BlkNumber, Items[c].Info.MC7Size, Items[c].Info.CheckSum);
             else
-                Result=CpuError(ResData->RetVal);
+                DropDBLength(Items[c].BlkNumber);
         }
-        else
-            Result=CpuError(SwapWord(ResParams->ErrNo));
-    };
+    }
+    if (Result!=0)
+    {
+        // The items not answered get the error of the connection
+        for (c = 0; c < Count; c++)
+        {
+            isoDropAnswer(Slots[(Head+c) % AmqRequestMax]);
+            Items[Queue[(Head+c) % AmqRequestMax]].Result=Result;
+        }
+        for (c = Next; c < ItemsCount; c++)
+            if (Items[c].Result==0)
+                Items[c].Result=Result;
+    }
     return Result;
 }
 //---------------------------------------------------------------------------
 int TSnap7MicroClient::opDBGet()
 {
-    TS7BlockInfo BI;
-    void * usrPData;
-    int * usrPSize;
-    int Result, Room;
-    bool RoomError = false;
-
-    // Stores user pointer
-    usrPData=Job.pData;
-    usrPSize=Job.pAmount;
-    Room    =Job.Amount;
+    TS7DBItem Item;
+    int Result;
 
-    // 1 Pass : Get block info
-    Job.Area=Block_DB;
-    Job.pData=&BI;
-    Result=opAgBlockInfo();
+    Item.DBNumber=Job.Number;
+    Item.pdata   =Job.pData;
+    Item.Size    =Job.Amount;
+    Result=PipeDBTransfer(&Item, 1, false, 0);
+    if (Result==0)
+        Result=Item.Result;
+    // The data is read even if the buffer is small (the error is reported).
+    // Imagine that we want to read only a small amount of data at the
+    // beginning of a DB regardless it's size....
+    if ((Result==0) || (Result==int(errCliBufferTooSmall)))
+        *Job.pAmount=Item.Size;
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::opDBFill()
+{
+    TS7DBItem Item;
+    int Result;
 
-    // 2 Pass : Read the whole (MC7Size bytes) DB.
+    // The slices are filled directly into the PDU
+    Item.DBNumber=Job.Number;
+    Item.pdata   =NULL;
+    Item.Size    =0;
+    Result=PipeDBTransfer(&Item, 1, true, byte(Job.IParam));
     if (Result==0)
+        Result=Item.Result;
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::opDBGetMulti()
+{
+    if ((Job.pData==NULL) || (Job.Amount<1))
+        return errCliInvalidParams;
+    return PipeDBTransfer(PS7DBItem(Job.pData), Job.Amount, false, 0);
+}
+//---------------------------------------------------------------------------
+// PIPELINED DB TRANSFERS
+//---------------------------------------------------------------------------
+PDBLength TSnap7MicroClient::FindDBLength(int Number)
+{
+    int Lo = 0;
+    int Hi = DBLengthsCount-1;
+    int Mid;
+
+    while (Lo<=Hi)
     {
-        // Check user space
-        if (BI.MC7Size>Room)
+        Mid=(Lo+Hi)/2;
+        if (DBLengths[Mid].Number==Number)
+            return &DBLengths[Mid];
+        if (DBLengths[Mid].Number<Number)
+            Lo=Mid+1;
+        else
+            Hi=Mid-1;
+    }
+    return NULL;
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::SetDBLength(int Number, int Size, int CheckSum)
+{
+    PDBLength Entry = FindDBLength(Number);
+    PDBLength List;
+    int c;
+
+    if (Entry==NULL)
+    {
+        if (DBLengthsCount==DBLengthsSize)
         {
-           Job.Amount=Room;
-           RoomError=true;
+            DBLengthsSize=(DBLengthsSize==0) ? 16 : DBLengthsSize*2;
+            List=new TDBLength[DBLengthsSize];
+            if (DBLengthsCount>0)
+                memcpy(List, DBLengths, DBLengthsCount*sizeof(TDBLength));
+            delete[] DBLengths;
+            DBLengths=List;
         }
-        else
-            Job.Amount =BI.MC7Size;
-        // The data is read even if the buffer is small (the error is reported).
-        // Imagine that we want to read only a small amount of data at the
-        // beginning of a DB regardless it's size....
-        Job.Area   =S7AreaDB;
-        Job.WordLen=S7WLByte;
-        Job.Start  =0;
-        Job.pData  =usrPData;
-        Result     =opReadArea();
-        if (Result==0)
-           *usrPSize=Job.Amount;
+        // Sorted insertion
+        c=DBLengthsCount;
+        while ((c>0) && (DBLengths[c-1].Number>Number))
+        {
+            DBLengths[c]=DBLengths[c-1];
+            c--;
+        }
+        Entry=&DBLengths[c];
+        Entry->Number=word(Number);
+        DBLengthsCount++;
     }
+    Entry->Size=Size;
+    Entry->CheckSum=word(CheckSum);
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::DropDBLength(int Number)
+{
+    PDBLength Entry = FindDBLength(Number);
+    int c;
 
-    if ((Result==0) && RoomError)
-        return errCliBufferTooSmall;
+    if (Entry!=NULL)
+    {
+        c=int(Entry-DBLengths);
+        memmove(Entry, Entry+1, (DBLengthsCount-c-1)*sizeof(TDBLength));
+        DBLengthsCount--;
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::ClearDBLengths()
+{
+    delete[] DBLengths;
+    DBLengths=NULL;
+    DBLengthsCount=0;
+    DBLengthsSize=0;
+}
+//---------------------------------------------------------------------------
+// Bytes to transfer once the DB size is known
+static void PipeSizing(PS7DBItem Item, PDBPipeItem Pipe, bool Fill)
+{
+    Pipe->Known=true;
+    Pipe->Size=Pipe->DBSize;
+    Pipe->RoomError=false;
+    if (!Fill && (Pipe->Size>Item->Size))
+    {
+        Pipe->Size=Item->Size;
+        Pipe->RoomError=true;
+    }
+    Pipe->Next=0;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::DBSliceMax(bool Fill)
+{
+    if (Fill)
+        return PDULength-(sizeof(TS7ReqHeader)+2+sizeof(TReqFunWriteItem)+4);
     else
+        return PDULength-sizeof(TS7ResHeader23)-sizeof(TResFunReadParams)-4;
+}
+//---------------------------------------------------------------------------
+// Builds the request of a DB slice : a read, or a write of Size bytes FillChar
+int TSnap7MicroClient::DBSliceRequest(int DBNumber, int Start, int Size, bool Fill, byte FillChar)
+{
+    PReqFunReadParams ReqParams;
+    PReqFunWriteDataItem ReqData;
+    word RPSize;
+    int Address;
+
+    // Read and write share the item layout
+    ReqParams=PReqFunReadParams(pbyte(PDUH_out)+sizeof(TS7ReqHeader));
+    RPSize   =sizeof(TReqFunReadItem)+2; // 1 item + Fun + ItemsCount
+
+    PDUH_out->P=0x32;                    // Always 0x32
+    PDUH_out->PDUType=PduType_request;   // 0x01
+    PDUH_out->AB_EX=0x0000;              // Always 0x0000
+    PDUH_out->Sequence=GetNextWord();    // AutoInc
+    PDUH_out->ParLen=SwapWord(RPSize);   // 14 bytes params
+
+    ReqParams->FunRead=Fill ? pduFuncWrite : pduFuncRead;
+    ReqParams->ItemsCount=1;
+    ReqParams->Items[0].ItemHead[0]=0x12;
+    ReqParams->Items[0].ItemHead[1]=0x0A;
+    ReqParams->Items[0].ItemHead[2]=0x10;
+    ReqParams->Items[0].TransportSize=S7WLByte;
+    ReqParams->Items[0].Length=SwapWord(Size);
+    ReqParams->Items[0].Area=S7AreaDB;
+    ReqParams->Items[0].DBNumber=SwapWord(DBNumber);
+    Address=Start*8;
+    ReqParams->Items[0].Address[2]=Address & 0x000000FF;
+    Address=Address >> 8;
+    ReqParams->Items[0].Address[1]=Address & 0x000000FF;
+    Address=Address >> 8;
+    ReqParams->Items[0].Address[0]=Address & 0x000000FF;
+
+    if (!Fill)
+    {
+        PDUH_out->DataLen=0x0000;        // No data
+        return sizeof(TS7ReqHeader)+RPSize;
+    }
+    ReqData=PReqFunWriteDataItem(pbyte(ReqParams)+RPSize);
+    PDUH_out->DataLen=SwapWord(Size+4);
+    ReqData->ReturnCode=0x00;
+    ReqData->TransportSize=TS_ResByte;
+    ReqData->DataLength=SwapWord(Size*8);
+    memset(pbyte(ReqData)+4, FillChar, Size);
+    return sizeof(TS7ReqHeader)+RPSize+4+Size;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::DBSliceAnswer(pbyte Target, int Start, int Size, int IsoSize, bool Fill)
+{
+    PS7ResHeader23 Answer;
+    PResFunReadParams ResParams;
+    PResFunReadItem ResData;
+    PResFunWrite ResWrite;
+    int Result, Len;
+
+    Answer=PS7ResHeader23(&PDU.Payload);
+    Result=CpuError(SwapWord(Answer->Error));
+    if (Result!=0)
         return Result;
+    if (Fill)
+    {
+        ResWrite=PResFunWrite(pbyte(Answer)+ResHeaderSize23);
+        if (ResWrite->Data[0]==0xFF) // <-- 0xFF means Result OK
+            return 0;
+        // The first slice reports the cpu error, the others that some data were written
+        return (Start==0) ? CpuError(ResWrite->Data[0]) : errCliPartialDataWritten;
+    }
+    ResParams=PResFunReadParams(pbyte(Answer)+ResHeaderSize23);
+    ResData  =PResFunReadItem(pbyte(ResParams)+sizeof(TResFunReadParams));
+    if (ResData->ReturnCode!=0xFF) // <-- 0xFF means Result OK
+        return CpuError(ResData->ReturnCode);
+    Len=SwapWord(ResData->DataLength);
+    if ((ResData->TransportSize != TS_ResOctet) && (ResData->TransportSize != TS_ResReal) && (ResData->TransportSize != TS_ResBit))
+        Len=Len >> 3;
+    if (Len+int(ResHeaderSize23+sizeof(TResFunReadParams)+4)>IsoSize)
+        return errCliInvalidPlcAnswer;
+    if (Len!=Size)
+        return errCliPartialDataRead;
+    memcpy(Target+Start, &ResData->Data[0], Len);
+    return 0;
 }
 //---------------------------------------------------------------------------
-int TSnap7MicroClient::opDBFill()
+// Sends the next request of the batch, Req.Item<0 if there's nothing to send
+// now. The items are served in order : the block info first, then the slices
+// as soon as the size is known. While an item waits for its block info the
+// block infos of the next ones are sent.
+int TSnap7MicroClient::PipeSend(PS7DBItem Items, PDBPipeItem Pipe, int ItemsCount, int &First, TPipeRequest &Req, bool Fill, byte FillChar)
+{
+    int IsoSize = 0;
+    int c;
+
+    Req.Item=-1;
+    while ((First<ItemsCount) && ((Items[First].Result!=0) ||
+        (Pipe[First].InfoDone && (Pipe[First].Next>=Pipe[First].Size))))
+        First++;
+    for (c = First; (c < ItemsCount) && (Req.Item<0); c++)
+    {
+        if (Items[c].Result!=0)
+            continue;
+        if (!Pipe[c].InfoSent)
+        {
+            Req.Item =c;
+            Req.Gen  =-1;
+            Req.Start=0;
+            Req.Size =0;
+            IsoSize=BlockInfoRequest(Block_DB, Items[c].DBNumber);
+            Pipe[c].InfoSent=true;
+        }
+        else
+            if (Pipe[c].Known && (Pipe[c].Next<Pipe[c].Size))
+            {
+                Req.Item =c;
+                Req.Gen  =Pipe[c].Gen;
+                Req.Start=Pipe[c].Next;
+                Req.Size =Pipe[c].Size-Pipe[c].Next;
+                if (Req.Size>DBSliceMax(Fill))
+                    Req.Size=DBSliceMax(Fill);
+                IsoSize=DBSliceRequest(Items[c].DBNumber, Req.Start, Req.Size, Fill, FillChar);
+                Pipe[c].Next+=Req.Size;
+            }
+    }
+    if (Req.Item<0)
+        return 0;
+    Pipe[Req.Item].InFlight++;
+    return isoSendRequest(NULL, IsoSize, Req.Slot);
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::PipeAnswer(PS7DBItem Items, PDBPipeItem Pipe, TPipeRequest &Req, int Size, bool Fill)
 {
+    PS7DBItem Item = &Items[Req.Item];
+    PDBPipeItem P = &Pipe[Req.Item];
     TS7BlockInfo BI;
     int Result;
-    // new op : get block info
-    Job.Op   =s7opAgBlockInfo;
-    Job.Area =Block_DB;
-    Job.pData=&BI;
-    Result   =opAgBlockInfo();
-    // Restore original op
-    Job.Op   =s7opDBFill;
-    // Fill internal buffer then write it
-    if (Result==0)
+
+    P->InFlight--;
+    // A failed item ignores the answers still coming
+    if (Item->Result!=0)
+        return;
+    if (Req.Gen<0)
+    {
+        P->InfoDone=true;
+        Result=BlockInfoAnswer(&BI);
+        if (Result==0)
+        {
+            SetDBLength(Item->DBNumber, BI.MC7Size, BI.CheckSum);
+            // The cached size was right : the slices already sent are good
+            if (P->Known && (P->DBSize==BI.MC7Size) && (P->CheckSum==word(BI.CheckSum)))
+                return;
+            // Unknown or changed : (re)starts, the answers of the old slices will be ignored
+            P->Gen++;
+            P->DBSize=BI.MC7Size;
+            P->CheckSum=word(BI.CheckSum);
+            PipeSizing(Item, P, Fill);
+            return;
+        }
+    }
+    else
+    {
+        if (Req.Gen!=P->Gen)
+            return;
+        Result=DBSliceAnswer(pbyte(Item->pdata), Req.Start, Req.Size, Size, Fill);
+    }
+    if (Result!=0)
+    {
+        Item->Result=Result;
+        DropDBLength(Item->DBNumber);
+    }
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::PipeDBTransfer(PS7DBItem Items, int ItemsCount, bool Fill, byte FillChar)
+{
+    PDBPipeItem Pipe;
+    PDBLength Entry;
+    TPipeRequest Flight[AmqRequestMax];
+    TPipeRequest Req;
+    int Window, Head, Count, First, Size, Result, c;
+
+    Pipe=new TDBPipeItem[ItemsCount];
+    memset(Pipe, 0, ItemsCount*sizeof(TDBPipeItem));
+    for (c = 0; c < ItemsCount; c++)
+    {
+        Items[c].Result=0;
+        if ((Items[c].DBNumber<1) || (Items[c].DBNumber>65535) ||
+            (!Fill && ((Items[c].pdata==NULL) || (Items[c].Size<1))))
+        {
+            Items[c].Result=errCliInvalidParams;
+            continue;
+        }
+        Entry=FindDBLength(Items[c].DBNumber);
+        if (Entry!=NULL)
+        {
+            Pipe[c].DBSize=Entry->Size;
+            Pipe[c].CheckSum=Entry->CheckSum;
+            PipeSizing(&Items[c], &Pipe[c], Fill);
+        }
+    }
+
+    Window=PipeWindow();
+    Head  =0;
+    Count =0;
+    First =0;
+    Result=0;
+    for (;;)
     {
-        Job.Amount =BI.MC7Size;
-        Job.Area   =S7AreaDB;
-        Job.WordLen=S7WLByte;
-        Job.Start  =0;
-        memset(&opData, byte(Job.IParam), Job.Amount);
-        Job.pData  =&opData;
-        Result     =opWriteArea();
+        // Fills the window
+        while (Count<Window)
+        {
+            Result=PipeSend(Items, Pipe, ItemsCount, First, Req, Fill, FillChar);
+            if ((Result!=0) || (Req.Item<0))
+                break;
+            Flight[(Head+Count) % AmqRequestMax]=Req;
+            Count++;
+        }
+        if ((Result!=0) || (Count==0))
+            break;
+        // Takes the oldest answer (the CPU answers in order)
+        Req=Flight[Head];
+        Head=(Head+1) % AmqRequestMax;
+        Count--;
+        Result=isoWaitAnswer(Req.Slot, Size);
+        if (Result!=0)
+            break;
+        PipeAnswer(Items, Pipe, Req, Size, Fill);
     }
+    // The answers still in flight will be dropped as late
+    for (c = 0; c < Count; c++)
+        isoDropAnswer(Flight[(Head+c) % AmqRequestMax].Slot);
+
+    for (c = 0; c < ItemsCount; c++)
+    {
+        if (Items[c].Result!=0)
+            continue;
+        if ((Result!=0) && !(Pipe[c].InfoDone && (Pipe[c].Next>=Pipe[c].Size) && (Pipe[c].InFlight==0)))
+        {
+            Items[c].Result=Result;
+            DropDBLength(Items[c].DBNumber);
+        }
+        else
+        {
+            Items[c].Size=Pipe[c].Size;
+            if (Pipe[c].RoomError)
+                Items[c].Result=errCliBufferTooSmall;
+        }
+    }
+    delete[] Pipe;
     return Result;
 }
 //---------------------------------------------------------------------------
@@ -1112,7 +1588,7 @@ int TSnap7MicroClient::opUpload()
                 Size=SwapWord(Answer->DataLen)-sizeof(TResFunUploadDataHeaderFirst); // Size of this data slice
 
             BlockLength=SwapWord(ResDataHeader->MC7Len); // Full block size in byte
-            Target=pbyte(&opData)+Offset;
+            Target=pbyte(opData)+Offset;
             memcpy(Target, Source, Size);
             Offset+=Size;
           }
@@ -1162,7 +1638,7 @@ int TSnap7MicroClient::opUpload()
                 {
                     Done=ResParams->EoU==0;
                     Size=SwapWord(Answer->DataLen)-sizeof(TResFunUploadDataHeaderNext); // Size of this data slice
-                    Target=pbyte(&opData)+Offset;
+                    Target=pbyte(opData)+Offset;
                     memcpy(Target, Source, Size);
                     Offset+=Size;
                 }
@@ -1232,7 +1708,7 @@ int TSnap7MicroClient::opUpload()
                  opSize=Job.Amount;
 				 RoomError = true;
 			 };
-			 memcpy(Job.pData, &opData, opSize);
+			 memcpy(Job.pData, opData, opSize);
 			 *Job.pAmount=opSize;
 			 if (RoomError) // Result==0 -> override if romerror
 				Result=errCliPartialDataRead;
@@ -1254,10 +1730,10 @@ int TSnap7MicroClient::opDownload()
 
     BlockAmount=Job.Amount;
     BlockNum   =Job.Number;
-    Result=CheckBlock(-1,-1,&opData,BlockAmount);
+    Result=CheckBlock(-1,-1,opData,BlockAmount);
     if (Result==0)
     {
-        Info=PS7CompactBlockInfo(&opData);
+        Info=PS7CompactBlockInfo(opData);
         // Gets blocktype
         BlockType=SubBlockToBlock(Info->SubBlkType);
 
@@ -1268,7 +1744,7 @@ int TSnap7MicroClient::opDownload()
 
         BlockSizeLd=BlockAmount; // load mem needed for this block
         BlockSize  =SwapWord(Info->MC7Len); // net size
-        Footer=PS7BlockFooter(pbyte(&opData)+BlockSizeLd-sizeof(TS7BlockFooter));
+        Footer=PS7BlockFooter(pbyte(opData)+BlockSizeLd-sizeof(TS7BlockFooter));
         Footer->Chksum=0x0000;
 
         Offset=0;
@@ -1375,7 +1851,7 @@ int TSnap7MicroClient::opDownload()
                 ResParams=PResDownloadParams(pbyte(Answer)+ResHeaderSize23);
                 ResData  =PResDownloadDataHeader(pbyte(ResParams)+sizeof(TResDownloadParams));
                 Target   =pbyte(ResData)+sizeof(TResDownloadDataHeader);
-                Source   =pbyte(&opData)+Offset;
+                Source   =pbyte(opData)+Offset;
 
                 Result=isoRecvBuffer(0,Size);
                 if (Result==0)
@@ -1628,7 +2104,7 @@ int TSnap7MicroClient::opReadSZL()
     ResDataNext   =PS7ResSZLDataNext(pbyte(ResParams)+sizeof(TS7Params7));
     PDataFirst    =pbyte(ResDataFirst)+8; // skip header
     PDataNext     =pbyte(ResDataNext)+4;  // skip header
-    Header        =PSZL_HEADER(&opData);
+    Header        =PSZL_HEADER(opData);
     First=true;
     Done =false;
     do
@@ -1711,7 +2187,7 @@ int TSnap7MicroClient::opReadSZL()
                         Done=(ResParams->resvd & 0xFF00) == 0; // Low order byte = 0x00 => the sequence is done
                         // Gets Unit's function sequence
                         Seq_in=ResParams->Seq;
-                        Target=PS7SZLList(pbyte(&opData)+Offset);
+                        Target=PS7SZLList(pbyte(opData)+Offset);
                         memcpy(Target, PDataFirst, DataSZL);
                         Offset+=DataSZL;
                     }
@@ -1735,7 +2211,7 @@ int TSnap7MicroClient::opReadSZL()
                         Done=(ResParams->resvd & 0xFF00) == 0; // Low order byte = 0x00 => the sequence is done
                         // Gets Unit's function sequence
                         Seq_in=ResParams->Seq;
-                        Target=PS7SZLList(pbyte(&opData)+Offset);
+                        Target=PS7SZLList(pbyte(opData)+Offset);
                         memcpy(Target, PDataNext, DataSZL);
                         Offset+=DataSZL;
                     }
@@ -1768,7 +2244,7 @@ int TSnap7MicroClient::opReadSZL()
                  opSize=Job.Amount;
                  NoRoom=true;
               }
-              memcpy(Job.pData, &opData, opSize);
+              memcpy(Job.pData, opData, opSize);
               *Job.pAmount=opSize;
         };
     };
@@ -1788,12 +2264,12 @@ int TSnap7MicroClient::opReadSZLList()
     Job.Index    =0x0000;
     Job.IParam   =0;
     ItemsCount_in=Job.Amount;     // stores the room
-    Job.Amount   =sizeof(opData); // read into the internal buffer
+    Job.Amount   =sizeof(TS7Buffer); // read into the internal buffer
 
     Result =opReadSZL();
     if (Result==0)
     {
-        opDataList=PS7SZLList(&opData); // Source
+        opDataList=PS7SZLList(opData); // Source
         usrSZLList=PS7SZLList(Job.pData);  // Target
 
         ItemsCount=(opSize-sizeof(SZL_HEADER)) / 2;
@@ -1884,6 +2360,9 @@ int TSnap7MicroClient::opGetDateTime()
                 DateTime->tm_min =BCDtoByte(ResData->Time[4]);
                 DateTime->tm_sec =BCDtoByte(ResData->Time[5]);
                 DateTime->tm_wday=(ResData->Time[7] & 0x0F)-1;
+                // Milliseconds, asked only by GetPlcClock
+                if (Job.pAmount!=NULL)
+                    *Job.pAmount=BCDtoByte(ResData->Time[6])*10+(ResData->Time[7] >> 4);
             }
             else
                 Result=CpuError(ResData->RetVal);
@@ -2330,7 +2809,7 @@ int TSnap7MicroClient::opGetProtection()
     Result    =opReadSZL();
     if (Result==0)
     {
-        Info=PS7Protection(pbyte(&opData)+6);
+        Info=PS7Protection(pbyte(opData)+6);
         usrInfo->sch_schal=SwapWord(Info->sch_schal);
         usrInfo->sch_par  =SwapWord(Info->sch_par);
         usrInfo->sch_rel  =SwapWord(Info->sch_rel);
@@ -2535,10 +3014,25 @@ int TSnap7MicroClient::SubBlockToBlock(int SBB)
   };
 }
 //---------------------------------------------------------------------------
-int TSnap7MicroClient::PerformOperation()
+void TSnap7MicroClient::RunOperation(int Operation)
 {
-    ClrError();
-    int Operation=Job.Op;
+    // Operations working into opData
+    switch(Operation)
+    {
+        case s7opUpload:
+        case s7opDownload:
+        case s7opListBlocksOfType:
+        case s7opReadSzlList:
+        case s7opReadSZL:
+        case s7opGetOrderCode:
+        case s7opGetCpuInfo:
+        case s7opGetCpInfo:
+        case s7opGetPlcStatus:
+        case s7opGetProtection:
+        case s7opSetPassword:
+             NeedData();
+             break;
+    }
     switch(Operation)
     {
         case s7opNone:
@@ -2562,6 +3056,12 @@ int TSnap7MicroClient::PerformOperation()
         case s7opDBFill:
              Job.Result=opDBFill();
              break;
+        case s7opDBGetMulti:
+             Job.Result=opDBGetMulti();
+             break;
+        case s7opAgBlockInfoMulti:
+             Job.Result=opAgBlockInfoMulti();
+             break;
         case s7opUpload:
              Job.Result=opUpload();
              break;
@@ -2629,15 +3129,612 @@ int TSnap7MicroClient::PerformOperation()
              Job.Result=opClearPassword();
              break;
     }
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::PerformOperation()
+{
+    longword Begin = SysGetMicroTick();
+    longword Sent = IsoCounters.PDUsSent;
+    ClrError();
+    // The deadline covers the whole job (for async jobs the time in queue too)
+    if (JobTimeout>0)
+        Job.Deadline=(JobStart+longword(JobTimeout)) | 1; // 0 means "none"
+    else
+        Job.Deadline=0;
+    JobCS->Enter();
+    // A CancelJob() of the queued job already expired it
+    if (CancelRequest!=JobSerial)
+        Deadline=Job.Deadline;
+    JobCS->Leave();
+    memset(&JobStamps, 0, sizeof(JobStamps));
+    // A job canceled before its start is not performed
+    RunOperation((CancelRequest==JobSerial) ? int(s7opNone) : Job.Op);
+   // A job completed anyway is not reported as canceled or expired
+   if (Job.Result!=0)
+   {
+       if (CancelRequest==JobSerial)
+           Job.Result=errCliJobCanceled;
+       else
+           if (DeadlineExpired())
+               Job.Result=errCliJobTimeout;
+   }
    Job.Time =SysGetTick()-JobStart;
+   RecordJob(Job.Op, SysGetMicroTick()-Begin, IsoCounters.PDUsSent-Sent, Job.Result);
+   FreeData();
+   JobCompleted();
+   // Together, so that a CancelJob() never expires the next job
+   JobCS->Enter();
+   Deadline=0;
    Job.Pending=false;
+   JobSerial++;
+   JobCS->Leave();
    return SetError(Job.Result);
 }
 //---------------------------------------------------------------------------
+int TSnap7MicroClient::PerformJob(TSnap7Job &Source, longword Start, int Timeout)
+{
+    int SavedTimeout = JobTimeout;
+    Job=Source;
+    Job.Pending=true;
+    JobStart=Start; // the deadline of the caller
+    JobTimeout=Timeout;
+    PerformOperation();
+    JobTimeout=SavedTimeout;
+    Source.Result=Job.Result;
+    return Job.Result;
+}
+//---------------------------------------------------------------------------
+// STATISTICS
+//---------------------------------------------------------------------------
+static int HistIndex(longword Time)
+{
+    int Mag = 0;
+    if (Time < longword(2*HistSubBuckets))
+        return int(Time);
+    while ((Time >> Mag) >= longword(2*HistSubBuckets))
+        Mag++;
+    return Mag*HistSubBuckets + int(Time >> Mag);
+}
+//---------------------------------------------------------------------------
+static longword HistLow(int Index)
+{
+    if (Index < 2*HistSubBuckets)
+        return longword(Index);
+    return longword(Index % HistSubBuckets + HistSubBuckets) << (Index / HistSubBuckets - 1);
+}
+//---------------------------------------------------------------------------
+static longword HistHigh(int Index)
+{
+    if (Index == HistBuckets-1)
+        return 0xFFFFFFFF;
+    return HistLow(Index+1)-1;
+}
+//---------------------------------------------------------------------------
+// Upper bound of the bucket holding the Percent-th value
+static longword HistPercentile(POpHistogram H, longword Total, int Percent)
+{
+    longword Rank = longword((double(Total)*Percent+99)/100);
+    longword Sum = 0;
+    int c;
+    if (Rank < 1)
+        Rank = 1;
+    for (c = 0; c < HistBuckets; c++)
+    {
+        Sum += H->Buckets[c];
+        if (Sum >= Rank)
+            return HistHigh(c);
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::RecordJob(int Op, longword Time, longword Slices, int Result)
+{
+    POpHistogram H;
+
+    if ((Op <= s7opNone) || (Op >= MaxStatOps))
+        return;
+    H = Hists[Op];
+    if (H == NULL)
+    {
+        H = new TOpHistogram;
+        memset(H, 0, sizeof(TOpHistogram));
+        // Published under the lock of the readers
+        StatsCS->Enter();
+        Hists[Op] = H;
+        StatsCS->Leave();
+    }
+    H->Count++;
+    if (Result != 0)
+        H->Errors++;
+    H->SumUs += Time;
+    H->Buckets[HistIndex(Time)]++;
+    JobCounters.Jobs++;
+    JobCounters.Slices += Slices;
+    if ((Result == int(errCliJobTimeout)) || ((Result & 0x0000FFFF) == WSAETIMEDOUT))
+        JobCounters.Timeouts++;
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::AddRetry()
+{
+    StatsCS->Enter();
+    Retries++;
+    StatsCS->Leave();
+}
+//---------------------------------------------------------------------------
+// Must be called inside StatsCS : the histogram of Op since the reset
+static void HistDelta(POpHistogram Current, POpHistogram Base, POpHistogram Delta)
+{
+    int c;
+    *Delta = *Current;
+    if (Base == NULL)
+        return;
+    Delta->Count -= Base->Count;
+    Delta->Errors -= Base->Errors;
+    Delta->SumUs -= Base->SumUs;
+    for (c = 0; c < HistBuckets; c++)
+        Delta->Buckets[c] -= Base->Buckets[c];
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetStats(PS7ClientStats pStats, bool DoReset)
+{
+    TOpHistogram Raw, Delta;
+    TJobCounters Jobs;
+    TIsoCounters Iso;
+    TS7DemuxStats Demux;
+    longword Retried, Mismatches, Total;
+    int Op, c;
+
+    if (pStats == NULL)
+        return errCliInvalidParams;
+    memset(pStats, 0, sizeof(TS7ClientStats));
+    StatsCS->Enter();
+    Jobs = JobCounters;
+    Iso = IsoCounters;
+    Retried = Retries;
+    TIsoTcpSocket::GetDemuxStats(&Demux, false);
+    Mismatches = Demux.Parked + Demux.Late + Demux.Stray;
+    pStats->Jobs       = Jobs.Jobs - JobBase.Jobs;
+    pStats->PDUsSent   = Iso.PDUsSent - IsoBase.PDUsSent;
+    pStats->PDUsRecv   = Iso.PDUsRecv - IsoBase.PDUsRecv;
+    pStats->BytesSent  = Iso.BytesSent - IsoBase.BytesSent;
+    pStats->BytesRecv  = Iso.BytesRecv - IsoBase.BytesRecv;
+    pStats->Slices     = Jobs.Slices - JobBase.Slices;
+    pStats->Retries    = Retried - RetriesBase;
+    pStats->Mismatches = Mismatches - MismatchesBase;
+    pStats->Timeouts   = Jobs.Timeouts - JobBase.Timeouts;
+    for (Op = 0; Op < MaxStatOps; Op++)
+    {
+        if (Hists[Op] == NULL)
+            continue;
+        Raw = *Hists[Op];
+        HistDelta(&Raw, HistsBase[Op], &Delta);
+        // The count of the buckets, a job may be in progress on the other side
+        Total = 0;
+        for (c = 0; c < HistBuckets; c++)
+            Total += Delta.Buckets[c];
+        if (Total > 0)
+        {
+            pStats->Ops[Op].Count  = Delta.Count;
+            pStats->Ops[Op].Errors = Delta.Errors;
+            pStats->Ops[Op].MeanUs = Delta.Count > 0 ? longword(Delta.SumUs / Delta.Count) : 0;
+            for (c = 0; Delta.Buckets[c] == 0; c++);
+            pStats->Ops[Op].MinUs  = HistLow(c);
+            pStats->Ops[Op].P50Us  = HistPercentile(&Delta, Total, 50);
+            pStats->Ops[Op].P90Us  = HistPercentile(&Delta, Total, 90);
+            pStats->Ops[Op].P99Us  = HistPercentile(&Delta, Total, 99);
+            pStats->Ops[Op].MaxUs  = HistPercentile(&Delta, Total, 100);
+        }
+        if (DoReset)
+        {
+            if (HistsBase[Op] == NULL)
+                HistsBase[Op] = new TOpHistogram;
+            *HistsBase[Op] = Raw;
+        }
+    }
+    if (DoReset)
+    {
+        JobBase = Jobs;
+        IsoBase = Iso;
+        RetriesBase = Retried;
+        MismatchesBase = Mismatches;
+    }
+    StatsCS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetHistogram(int Op, PS7Histogram pHist)
+{
+    TOpHistogram Raw, Delta;
+    int c;
+
+    if ((pHist == NULL) || (Op <= s7opNone) || (Op >= MaxStatOps))
+        return errCliInvalidParams;
+    memset(&Delta, 0, sizeof(Delta));
+    StatsCS->Enter();
+    if (Hists[Op] != NULL)
+    {
+        Raw = *Hists[Op];
+        HistDelta(&Raw, HistsBase[Op], &Delta);
+    }
+    StatsCS->Leave();
+    for (c = 0; c < HistBuckets; c++)
+    {
+        pHist->Low[c] = HistLow(c);
+        pHist->Counts[c] = Delta.Buckets[c];
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------
+// RATE LIMIT
+//---------------------------------------------------------------------------
+static TSnapCriticalSection BucketsCS;
+static TSnap7Bucket *Buckets = NULL;
+//---------------------------------------------------------------------------
+TSnap7Bucket::TSnap7Bucket(const char *PlcAddress)
+{
+    strncpy(Address, PlcAddress, 16);
+    Address[15]='\0';
+    Next = NULL;
+    RefCount = 0;
+    CS = new TSnapCriticalSection();
+    PDURate = 0;
+    ByteRate = 0;
+    PDUTokens = 0;
+    ByteTokens = 0;
+    Last = SysGetTick();
+    memset(&Stats,0,sizeof(Stats));
+}
+//---------------------------------------------------------------------------
+TSnap7Bucket::~TSnap7Bucket()
+{
+    delete CS;
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::Refill()
+{
+    longword Now = SysGetTick();
+    double Elapsed = double(Now-Last)/1000.0;
+    double Max;
+
+    Last=Now;
+    if (PDURate>0)
+    {
+        Max=double(PDURate)/10.0;
+        if (Max<1.0)
+            Max=1.0;
+        PDUTokens+=Elapsed*PDURate;
+        if (PDUTokens>Max)
+            PDUTokens=Max;
+    }
+    if (ByteRate>0)
+    {
+        Max=double(ByteRate)/10.0;
+        ByteTokens+=Elapsed*ByteRate;
+        if (ByteTokens>Max)
+            ByteTokens=Max;
+    }
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::SetRates(int PDUsPerSec, int BytesPerSec)
+{
+    CS->Enter();
+    Refill();
+    if (PDUsPerSec!=PDURate)
+        PDUTokens=1.0;
+    if (BytesPerSec!=ByteRate)
+        ByteTokens=0.0;
+    PDURate=PDUsPerSec;
+    ByteRate=BytesPerSec;
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+int TSnap7Bucket::Take(int Size)
+{
+    double Wait = 0;
+    CS->Enter();
+    Refill();
+    if ((PDURate>0) && (PDUTokens<1.0))
+        Wait=(1.0-PDUTokens)*1000.0/PDURate;
+    // The bytes may be in debt (answers charged later) : the request only
+    // waits for the debt to be paid
+    if ((ByteRate>0) && (ByteTokens<0.0) && (-ByteTokens*1000.0/ByteRate>Wait))
+        Wait=-ByteTokens*1000.0/ByteRate;
+    if (Wait==0)
+    {
+        if (PDURate>0)
+            PDUTokens-=1.0;
+        if (ByteRate>0)
+            ByteTokens-=Size;
+        Stats.PDUs++;
+        Stats.Bytes+=Size;
+    }
+    CS->Leave();
+    if (Wait==0)
+        return 0;
+    else
+        return int(Wait)+1;
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::Charge(int Size)
+{
+    CS->Enter();
+    if (ByteRate>0)
+        ByteTokens-=Size;
+    Stats.Bytes+=Size;
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::Throttled(longword Time, bool Rejected)
+{
+    CS->Enter();
+    if (Rejected)
+        Stats.Rejected++;
+    else
+    {
+        Stats.Throttled++;
+        Stats.ThrottledTime+=Time;
+    }
+    CS->Leave();
+}
+//---------------------------------------------------------------------------
+TSnap7Bucket *TSnap7Bucket::Attach(const char *PlcAddress)
+{
+    TSnap7Bucket *Bucket;
+    BucketsCS.Enter();
+    Bucket=Buckets;
+    while ((Bucket!=NULL) && (strcmp(Bucket->Address, PlcAddress)!=0))
+        Bucket=Bucket->Next;
+    if (Bucket==NULL)
+    {
+        Bucket=new TSnap7Bucket(PlcAddress);
+        Bucket->Next=Buckets;
+        Buckets=Bucket;
+    }
+    Bucket->RefCount++;
+    BucketsCS.Leave();
+    return Bucket;
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::Detach(TSnap7Bucket *Bucket)
+{
+    TSnap7Bucket **Link;
+    BucketsCS.Enter();
+    Bucket->RefCount--;
+    if (Bucket->RefCount>0)
+    {
+        BucketsCS.Leave();
+        return;
+    }
+    Link=&Buckets;
+    while ((*Link!=NULL) && (*Link!=Bucket))
+        Link=&(*Link)->Next;
+    if (*Link!=NULL)
+        *Link=Bucket->Next;
+    BucketsCS.Leave();
+    delete Bucket;
+}
+//---------------------------------------------------------------------------
+void TSnap7Bucket::GetStats(const char *PlcAddress, PS7RateStats pStats, bool DoReset)
+{
+    TSnap7Bucket *Bucket;
+    memset(pStats,0,sizeof(TS7RateStats));
+    BucketsCS.Enter();
+    Bucket=Buckets;
+    while ((Bucket!=NULL) && (strcmp(Bucket->Address, PlcAddress)!=0))
+        Bucket=Bucket->Next;
+    if (Bucket!=NULL)
+    {
+        Bucket->CS->Enter();
+        *pStats=Bucket->Stats;
+        if (DoReset)
+            memset(&Bucket->Stats,0,sizeof(TS7RateStats));
+        Bucket->CS->Leave();
+    }
+    BucketsCS.Leave();
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::AttachBucket()
+{
+    DetachBucket();
+    FBucket=TSnap7Bucket::Attach(RemoteAddress);
+    if ((RateLimitPDU>0) || (RateLimitBytes>0))
+        FBucket->SetRates(RateLimitPDU, RateLimitBytes);
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::DetachBucket()
+{
+    if (FBucket!=NULL)
+    {
+        TSnap7Bucket::Detach(FBucket);
+        FBucket=NULL;
+    }
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::ThrottleExchange(int Size)
+{
+    longword Start;
+    int Wait;
+
+    if (FBucket==NULL)
+        return 0;
+    Wait=FBucket->Take(Size);
+    if (Wait==0)
+        return 0;
+    if (RateLimitMode==rlFailFast)
+    {
+        FBucket->Throttled(0, true);
+        return errCliThrottled;
+    }
+    // Waits for the tokens in short naps, to honor the deadline (and CancelJob)
+    Start=SysGetTick();
+    do {
+        if (Wait>20)
+            Wait=20;
+        SysSleep(Wait);
+        if (DeadlineExpired())
+        {
+            FBucket->Throttled(SysGetTick()-Start, false);
+            LastTcpError=WSAETIMEDOUT;
+            return SetIsoError(errIsoSendPacket);
+        }
+        Wait=FBucket->Take(Size);
+    } while (Wait!=0);
+    FBucket->Throttled(SysGetTick()-Start, false);
+    return 0;
+}
+//---------------------------------------------------------------------------
+void TSnap7MicroClient::ExchangeReceived(int Size)
+{
+    if (FBucket!=NULL)
+        FBucket->Charge(Size);
+    if (RecvStamps)
+    {
+        if (JobStamps.PDUs==0)
+            JobStamps.Sent=ExchSent;
+        JobStamps.Received=ExchRecv;
+        JobStamps.Kernel=ExchKernel;
+        JobStamps.PDUs++;
+    }
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetRateStats(PS7RateStats pStats, bool DoReset)
+{
+    if (pStats==NULL)
+        return errCliInvalidParams;
+    TSnap7Bucket::GetStats(RemoteAddress, pStats, DoReset);
+    return 0;
+}
+//---------------------------------------------------------------------------
+typedef struct {
+    const char *Prefix;  // Order code, '?' matches any character
+    int Family;
+} TFamilyCode;
+
+// The S7-1200 CPUs (6ES7 21x-1xx30/31/40) share the 6ES7 21x numbers with
+// the S7-200 ones (6ES7 21x-xxx2x) : only the product generation tells them apart
+static const TFamilyCode FamilyCodes[] = {
+    { "6ES7 21?-1??3", plc1200_1500 }, // S7-1200 V1..V3
+    { "6ES7 21?-1??4", plc1200_1500 }, // S7-1200 V4
+    { "6ES7 51",  plc1200_1500 }, // S7-1500, ET 200SP CPU
+    { "6ES7 15",  plc300_400   }, // ET 200S/M CPU
+    { "6ES7 3",   plc300_400   },
+    { "6ES7 4",   plc300_400   },
+    { "6ES7 2",   plcLogo_200  },
+    { "6ED1",     plcLogo_200  },
+    { "6SL3",     plcSinamics  },
+    { "6SE7",     plcSinamics  }
+};
+
+typedef struct {
+    int ParallelJobs;
+    int Connections;
+} TFamilyProfile;
+
+// Indexed by family, plcUnknown uses the last one
+static const TFamilyProfile FamilyProfiles[] = {
+    { 4, 8 }, // plc300_400
+    { 3, 6 }, // plc1200_1500
+    { 1, 4 }, // plcLogo_200
+    { 1, 2 }, // plcSinamics
+    { 1, 4 }  // plcUnknown
+};
+//---------------------------------------------------------------------------
+static bool OrderCodeMatch(const char *Code, const char *Prefix)
+{
+    for (; *Prefix!='\0'; Prefix++, Code++)
+        if ((*Code=='\0') || ((*Prefix!='?') && (*Prefix!=*Code)))
+            return false;
+    return true;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::DetectFamily()
+{
+    TS7OrderCode OC;
+    int Result, c;
+
+    Result=GetOrderCode(&OC);
+    if (Result==0)
+    {
+        Family=plcUnknown;
+        for (c = 0; c < int(sizeof(FamilyCodes)/sizeof(TFamilyCode)); c++)
+            if (OrderCodeMatch(OC.Code, FamilyCodes[c].Prefix))
+            {
+                Family=FamilyCodes[c].Family;
+                break;
+            }
+    }
+    else
+        // The CPU answered but has no SZL : LOGO or S7-200. Any other error
+        // is returned and the family stays unknown (detected again later).
+        if ((Result==int(errCliFunNotAvailable)) || (Result==int(errCliItemNotAvailable)) ||
+            (Result==int(errCliInvalidPlcAnswer)))
+        {
+            Family=plcLogo_200;
+            Result=0;
+        }
+    return Result;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetCapabilities(PS7Capabilities pCaps)
+{
+    TS7CpInfo CpInfo;
+    TFamilyProfile Profile;
+    int Result;
+
+    if (pCaps==NULL)
+        return errCliInvalidParams;
+    if (Family==plcUnknown)
+    {
+        Result=DetectFamily();
+        if (Result!=0)
+            return Result;
+    }
+    Profile=FamilyProfiles[Family==plcUnknown ? plcSinamics+1 : Family];
+    pCaps->Family=Family;
+    pCaps->PDURequested=PDURequested;
+    pCaps->PDUGranted=PDULength;
+    pCaps->MaxAmqCaller=MaxAmqCaller;
+    pCaps->MaxAmqCallee=MaxAmqCallee;
+    pCaps->ParallelJobs=Profile.ParallelJobs;
+    if ((MaxAmqCaller>0) && (MaxAmqCaller<pCaps->ParallelJobs))
+        pCaps->ParallelJobs=MaxAmqCaller;
+    pCaps->MaxConnections=Profile.Connections;
+    if ((Family!=plcLogo_200) && (GetCpInfo(&CpInfo)==0) && (CpInfo.MaxConnections>0))
+        pCaps->MaxConnections=CpInfo.MaxConnections;
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetJobStamps(PS7JobStamps pStamps)
+{
+    if (pStamps==NULL)
+        return errCliInvalidParams;
+    *pStamps=JobStamps;
+    return 0;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::CancelJob()
+{
+    // Under JobCS the job can't end meanwhile : the request and the deadline
+    // always refer to the job in progress, a finished one is simply ignored.
+    JobCS->Enter();
+    if (Job.Pending)
+    {
+        CancelRequest=JobSerial;
+        // Expires the current exchange : no more PDUs are sent and the pending
+        // receive returns. A late answer will be discarded by its Sequence number.
+        Deadline=SysGetTick() | 1;
+        AbortIO();
+    }
+    JobCS->Leave();
+    return 0;
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::Disconnect()
 {
      JobStart=SysGetTick();
      PeerDisconnect();
+     DetachBucket();
+     ClearDBLengths();
      Job.Time=SysGetTick()-JobStart;
 	 Job.Pending=false;
      return 0;
@@ -2658,7 +3755,11 @@ int TSnap7MicroClient::Connect()
 {
 	 int Result;
 	 JobStart=SysGetTick();
+	 Family  =plcUnknown;
+	 ClearDBLengths(); // The blocks may have changed meanwhile
 	 Result  =PeerConnect();
+	 if (Result==0)
+	     AttachBucket();
 	 Job.Time=SysGetTick()-JobStart;
 	 return Result;
 }
@@ -2675,6 +3776,24 @@ void TSnap7MicroClient::SetConnectionParams(const char *RemAddress, word LocalTS
      strncpy(RemoteAddress, RemAddress, 16);
 }
 //---------------------------------------------------------------------------
+void TSnap7MicroClient::CopySettings(TSnap7MicroClient *Source)
+{
+    SetConnectionParams(Source->RemoteAddress, Source->SrcTSap, Source->DstTSap);
+    ConnectionType = Source->ConnectionType;
+    RemotePort     = Source->RemotePort;
+    PingTimeout    = Source->PingTimeout;
+    SendTimeout    = Source->SendTimeout;
+    RecvTimeout    = Source->RecvTimeout;
+    PDURequest     = Source->PDURequest;
+    SocketBackend  = Source->SocketBackend;
+    JobTimeout     = Source->JobTimeout;
+    RateLimitPDU   = Source->RateLimitPDU;
+    RateLimitBytes = Source->RateLimitBytes;
+    RateLimitMode  = Source->RateLimitMode;
+    RecvStamps     = Source->RecvStamps;
+    AmqRequest     = Source->AmqRequest;
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::ConnectTo(const char *RemAddress, int Rack, int Slot)
 {
     word RemoteTSAP = (ConnectionType<<8)+(Rack*0x20)+Slot;
@@ -2713,6 +3832,27 @@ int TSnap7MicroClient::GetParam(int ParamNumber, void *pValue)
 	case p_i32_PDURequest:
 		*Pint32_t(pValue)=PDURequest;
 		break;
+	case p_i32_SocketBackend:
+		*Pint32_t(pValue)=IoBackend();
+		break;
+	case p_i32_JobTimeout:
+		*Pint32_t(pValue)=JobTimeout;
+		break;
+	case p_i32_RateLimitPDU:
+		*Pint32_t(pValue)=RateLimitPDU;
+		break;
+	case p_i32_RateLimitBytes:
+		*Pint32_t(pValue)=RateLimitBytes;
+		break;
+	case p_i32_RateLimitMode:
+		*Pint32_t(pValue)=RateLimitMode;
+		break;
+	case p_i32_RecvStamps:
+		*Pint32_t(pValue)=RecvStamps;
+		break;
+	case p_i32_PipeDepth:
+		*Pint32_t(pValue)=AmqRequest;
+		break;
 	default: return errCliInvalidParamNumber;
     }
     return 0;
@@ -2752,6 +3892,44 @@ int TSnap7MicroClient::SetParam(int ParamNumber, void *pValue)
 	case p_i32_PDURequest:
 		PDURequest=*Pint32_t(pValue);
 		break;
+	case p_i32_SocketBackend:
+		if (!Connected)
+			SocketBackend=*Pint32_t(pValue);
+		else
+			return errCliCannotChangeParam;
+		break;
+	case p_i32_JobTimeout:
+		JobTimeout=*Pint32_t(pValue);
+		break;
+	case p_i32_RateLimitPDU:
+	case p_i32_RateLimitBytes:
+		if (*Pint32_t(pValue)<0)
+			return errCliInvalidParams;
+		if (ParamNumber==p_i32_RateLimitPDU)
+			RateLimitPDU=*Pint32_t(pValue);
+		else
+			RateLimitBytes=*Pint32_t(pValue);
+		if (FBucket!=NULL)
+			FBucket->SetRates(RateLimitPDU, RateLimitBytes);
+		break;
+	case p_i32_RateLimitMode:
+		if ((*Pint32_t(pValue)!=rlBlock) && (*Pint32_t(pValue)!=rlFailFast))
+			return errCliInvalidParams;
+		RateLimitMode=*Pint32_t(pValue);
+		break;
+	case p_i32_RecvStamps:
+		// The socket option is set at connection time
+		if (!Connected)
+			RecvStamps=*Pint32_t(pValue)!=0;
+		else
+			return errCliCannotChangeParam;
+		break;
+	case p_i32_PipeDepth:
+		// Asked to the CPU at the next connection
+		if ((*Pint32_t(pValue)<1) || (*Pint32_t(pValue)>AmqRequestMax))
+			return errCliInvalidParams;
+		AmqRequest=*Pint32_t(pValue);
+		break;
 	default: return errCliInvalidParamNumber;
     }
     return 0;
@@ -2916,6 +4094,21 @@ int TSnap7MicroClient::GetAgBlockInfo(int BlockType, int BlockNum, PS7BlockInfo
         return SetError(errCliJobPending);
 }
 //---------------------------------------------------------------------------
+int TSnap7MicroClient::GetAgBlockInfoMulti(PS7BlockInfoItem Items, int ItemsCount)
+{
+    if (!Job.Pending)
+    {
+        Job.Pending  =true;
+        Job.Op       =s7opAgBlockInfoMulti;
+        Job.pData    =Items;
+        Job.Amount   =ItemsCount;
+        JobStart     =SysGetTick();
+        return PerformOperation();
+    }
+    else
+        return SetError(errCliJobPending);
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::GetPgBlockInfo(void * pBlock, PS7BlockInfo pUsrData, int Size)
 {
     PS7CompactBlockInfo Info;
@@ -2933,13 +4126,13 @@ int TSnap7MicroClient::GetPgBlockInfo(void * pBlock, PS7BlockInfo pUsrData, int
         pUsrData->LoadSize =SwapDWord(Info->LenLoadMem);
         pUsrData->LocalData=SwapDWord(Info->LocDataLen);
         pUsrData->SBBLength=SwapDWord(Info->SbbLen);
-        pUsrData->CheckSum =0; // this info is not available
         pUsrData->Version  =0; // this info is not available
         FillTime(SwapWord(Info->CodeTime_dy),pUsrData->CodeDate);
         FillTime(SwapWord(Info->IntfTime_dy),pUsrData->IntfDate);
 
         Footer=PS7BlockFooter(pbyte(Info)+pUsrData->LoadSize-sizeof(TS7BlockFooter));
 
+        pUsrData->CheckSum =SwapWord(Footer->Chksum);
         memcpy(pUsrData->Author,Footer->Author,8);
         memcpy(pUsrData->Family,Footer->Family,8);
         memcpy(pUsrData->Header,Footer->Header,8);
@@ -2947,6 +4140,75 @@ int TSnap7MicroClient::GetPgBlockInfo(void * pBlock, PS7BlockInfo pUsrData, int
     return SetError(Result);
 }
 //---------------------------------------------------------------------------
+int TSnap7MicroClient::CompareBlocks(PS7BlockCompare Items, int ItemsCount, int &Mismatches)
+{
+    PS7BlockCompare Item;
+    PS7BlockInfoItem Online;
+    int Count, Result, c, n;
+
+    Mismatches=0;
+    if ((Items==NULL) || (ItemsCount<1))
+        return SetError(errCliInvalidParams);
+    if (Job.Pending)
+        return SetError(errCliJobPending);
+
+    // Offline side : the images not valid are not asked online
+    Online=new TS7BlockInfoItem[ItemsCount];
+    Count=0;
+    for (c = 0; c < ItemsCount; c++)
+    {
+        Item=&Items[c];
+        Item->Diff=0;
+        memset(&Item->Offline,0,sizeof(TS7BlockInfo));
+        memset(&Item->Online,0,sizeof(TS7BlockInfo));
+        if (Item->pBlock!=NULL)
+            Item->Result=GetPgBlockInfo(Item->pBlock, &Item->Offline, Item->Size);
+        else
+            Item->Result=errCliInvalidParams;
+        if (Item->Result==0)
+        {
+            Item->BlkType  =SubBlockToBlock(Item->Offline.BlkType);
+            Item->BlkNumber=Item->Offline.BlkNumber;
+            Online[Count].BlkType  =Item->BlkType;
+            Online[Count].BlkNumber=Item->BlkNumber;
+            Count++;
+        }
+    }
+
+    // Online side : all the block infos in one pipelined job
+    Result=0;
+    if (Count>0)
+        Result=GetAgBlockInfoMulti(Online, Count);
+
+    n=0;
+    for (c = 0; c < ItemsCount; c++)
+    {
+        Item=&Items[c];
+        if (Item->Result!=0)
+            continue;
+        if (Online[n].Result==0)
+        {
+            Item->Online=Online[n].Info;
+            if (Item->Online.CheckSum!=Item->Offline.CheckSum)
+                Item->Diff|=cdCheckSum;
+            if (Item->Online.MC7Size!=Item->Offline.MC7Size)
+                Item->Diff|=cdLength;
+            if (strcmp(Item->Online.IntfDate,Item->Offline.IntfDate)!=0)
+                Item->Diff|=cdIntfDate;
+        }
+        else
+            if (Online[n].Result==errCliItemNotAvailable)
+                Item->Diff=cdMissing;
+            else
+                Item->Result=Online[n].Result;
+        if (Item->Diff!=0)
+            Mismatches++;
+        n++;
+    }
+    delete[] Online;
+    return SetError(Result);
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::ListBlocksOfType(int BlockType, TS7BlocksOfType *pUsrData, int &ItemsCount)
 {
     if (!Job.Pending)
@@ -3014,7 +4276,8 @@ int TSnap7MicroClient::Download(int BlockNum,  void * pUsrData,  int Size)
     {
         Job.Pending  =true;
         Job.Op       =s7opDownload;
-        memcpy(&opData, pUsrData, Size);
+        NeedData();
+        memcpy(opData, pUsrData, Size);
         Job.Number   =BlockNum;
         Job.Amount   =Size;
         JobStart     =SysGetTick();
@@ -3073,6 +4336,21 @@ int TSnap7MicroClient::DBFill(int DBNumber,  int FillChar)
         return SetError(errCliJobPending);
 }
 //---------------------------------------------------------------------------
+int TSnap7MicroClient::DBGetMulti(PS7DBItem Items, int ItemsCount)
+{
+    if (!Job.Pending)
+    {
+        Job.Pending  =true;
+        Job.Op       =s7opDBGetMulti;
+        Job.pData    =Items;
+        Job.Amount   =ItemsCount;
+        JobStart     =SysGetTick();
+        return PerformOperation();
+    }
+    else
+        return SetError(errCliJobPending);
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::GetPlcDateTime(tm &DateTime)
 {
     if (!Job.Pending)
@@ -3080,6 +4358,7 @@ int TSnap7MicroClient::GetPlcDateTime(tm &DateTime)
         Job.Pending  =true;
         Job.Op       =s7opGetDateTime;
         Job.pData    =&DateTime;
+        Job.pAmount  =NULL;
         JobStart     =SysGetTick();
         return PerformOperation();
     }
@@ -3087,6 +4366,38 @@ int TSnap7MicroClient::GetPlcDateTime(tm &DateTime)
         return SetError(errCliJobPending);
 }
 //---------------------------------------------------------------------------
+// Days from 1970-01-01 of a proleptic gregorian date (any time zone)
+static int64_t DaysFromCivil(int Year, int Month, int Day)
+{
+    int Era, Yoe, Doy, Doe;
+    Year-=Month<=2;
+    Era=(Year>=0 ? Year : Year-399)/400;
+    Yoe=Year-Era*400;
+    Doy=(153*(Month+(Month>2 ? -3 : 9))+2)/5+Day-1;
+    Doe=Yoe*365+Yoe/4-Yoe/100+Doy;
+    return int64_t(Era)*146097+Doe-719468;
+}
+//---------------------------------------------------------------------------
+int TSnap7MicroClient::GetPlcClock(int64_t &PlcTime)
+{
+    tm DateTime;
+    int Msec = 0;
+    int Result;
+
+    if (Job.Pending)
+        return SetError(errCliJobPending);
+    Job.Pending  =true;
+    Job.Op       =s7opGetDateTime;
+    Job.pData    =&DateTime;
+    Job.pAmount  =&Msec;
+    JobStart     =SysGetTick();
+    Result=PerformOperation();
+    if (Result==0)
+        PlcTime=(DaysFromCivil(DateTime.tm_year+1900, DateTime.tm_mon+1, DateTime.tm_mday)*86400+
+            DateTime.tm_hour*3600+DateTime.tm_min*60+DateTime.tm_sec)*1000000000LL+int64_t(Msec)*1000000;
+    return Result;
+}
+//---------------------------------------------------------------------------
 int TSnap7MicroClient::SetPlcDateTime(tm * DateTime)
 {
     if (!Job.Pending)
@@ -3301,9 +4612,10 @@ int TSnap7MicroClient::SetSessionPassword(char *Password)
            return SetError(errCliInvalidParams);
         Job.Pending  =true;
         // prepares an 8 char string filled with spaces
-        memset(&opData,0x20,8);
+        NeedData();
+        memset(opData,0x20,8);
         // copies
-        strncpy((char*)&opData,Password,L);
+        strncpy((char*)opData,Password,L);
         Job.Op       =s7opSetPassword;
         JobStart     =SysGetTick();
         return PerformOperation();
@@ -26,6 +26,7 @@
 #ifndef s7_micro_client_h
 #define s7_micro_client_h
 //---------------------------------------------------------------------------
+#include "snap_threads.h"
 #include "s7_peer.h"
 //---------------------------------------------------------------------------
 
@@ -69,6 +70,11 @@ const longword errCliFunctionRefused        = 0x02300000;
 const longword errCliDestroying             = 0x02400000;
 const longword errCliInvalidParamNumber     = 0x02500000;
 const longword errCliCannotChangeParam      = 0x02600000;
+const longword errCliJobCanceled            = 0x02700000;
+const longword errCliLinkDown               = 0x02800000;
+const longword errCliThrottled              = 0x02900000;
+const longword errCliClockNotSynced         = 0x02A00000;
+const longword errCliBackupFile             = 0x02B00000;
 
 const time_t DeltaSecs = 441763200; // Seconds between 1970/1/1 (C time base) and 1984/1/1 (Siemens base)
 
@@ -85,6 +91,25 @@ typedef struct{
    void  *pdata;
 } TS7DataItem, *PS7DataItem;
 
+// Bit write batch : one tuple per bit, Result is filled per bit
+typedef struct{
+   int   Area;
+   int   DBNumber;
+   int   Byte;
+   int   Bit;
+   int   Value;
+   int   Result;
+} TS7BitItem, *PS7BitItem;
+
+// Whole DB snapshot (DBGetMulti) : Size is the buffer size in input and the
+// bytes read in output
+typedef struct{
+   int   DBNumber;
+   int   Result;
+   int   Size;
+   void  *pdata;
+} TS7DBItem, *PS7DBItem;
+
 typedef int TS7ResultItems[MaxVars];
 typedef TS7ResultItems *PS7ResultItems;
 
@@ -117,6 +142,34 @@ typedef struct {
    char Header[9];
 } TS7BlockInfo, *PS7BlockInfo ;
 
+// Block infos of many blocks (GetAgBlockInfoMulti) : BlkType and BlkNumber
+// in input, Result and Info in output
+typedef struct{
+   int   BlkType;   // Block_OB, Block_DB ...
+   int   BlkNumber;
+   int   Result;
+   TS7BlockInfo Info;
+} TS7BlockInfoItem, *PS7BlockInfoItem;
+
+// Online/offline comparison (CompareBlocks) : pBlock and Size in input (an
+// offline block image as returned by FullUpload), the rest in output
+typedef struct{
+   void  *pBlock;
+   int   Size;
+   int   BlkType;   // Block_OB, Block_DB ... taken from the image
+   int   BlkNumber;
+   int   Result;    // Image not valid or online block info failed
+   int   Diff;      // cdXXX mask, 0 : the online block is the same
+   TS7BlockInfo Offline;
+   TS7BlockInfo Online;
+} TS7BlockCompare, *PS7BlockCompare;
+
+// Block differences (TS7BlockCompare.Diff)
+const int cdCheckSum = 0x01;
+const int cdLength   = 0x02; // MC7 size
+const int cdIntfDate = 0x04; // Interface time stamp
+const int cdMissing  = 0x08; // The block is not in the PLC
+
 typedef word TS7BlocksOfType[0x2000];
 typedef TS7BlocksOfType *PS7BlocksOfType;
 
@@ -198,6 +251,8 @@ typedef struct {
 #define s7opSetPassword       26
 #define s7opClearPassword     27
 #define s7opDBFill            28
+#define s7opDBGetMulti        29
+#define s7opAgBlockInfoMulti  30
 
 // Param Number (to use with setparam)
 
@@ -243,8 +298,185 @@ struct TSnap7Job
     int *pAmount;  // Items amount/Size in output
     // Generic
     int IParam;   // Used for full upload and CopyRamToRom extended timeout
+    longword Deadline; // Absolute deadline (SysGetTick) for all the job PDUs, 0 = none
+};
+
+//---------------------------------------------------------------------------
+// Request rate limit : token buckets (PDUs/s and bytes/s) shared by all the
+// clients connected to the same PLC address, whatever their TSAPs, sessions
+// or pools. A client with p_i32_RateLimitPDU or p_i32_RateLimitBytes set
+// configures the bucket of its PLC on connection, the others just obey it.
+// The burst allowed is 1/10 s of traffic; the answers are charged when
+// received, so a big answer delays the next requests.
+//---------------------------------------------------------------------------
+const int rlBlock    = 0; // Requests wait for their tokens (up to the job deadline)
+const int rlFailFast = 1; // Requests fail with errCliThrottled
+
+typedef struct {
+    longword PDUs;          // Requests sent
+    longword Bytes;         // Bytes exchanged (requests + answers)
+    longword Throttled;     // Requests delayed
+    longword Rejected;      // Requests refused (rlFailFast)
+    longword ThrottledTime; // Total delay (ms)
+} TS7RateStats, *PS7RateStats;
+
+class TSnap7Bucket
+{
+private:
+    char Address[16];
+    TSnap7Bucket *Next;  // Registry list
+    int RefCount;
+    PSnapCriticalSection CS;
+    int PDURate;
+    int ByteRate;
+    double PDUTokens;
+    double ByteTokens;
+    longword Last;
+    TS7RateStats Stats;
+    void Refill();
+public:
+    TSnap7Bucket(const char *PlcAddress);
+    ~TSnap7Bucket();
+    void SetRates(int PDUsPerSec, int BytesPerSec);
+    // Takes the tokens for a request : 0 if granted, else the ms to wait
+    int Take(int Size);
+    void Charge(int Size);
+    void Throttled(longword Time, bool Rejected);
+    static TSnap7Bucket *Attach(const char *PlcAddress);
+    static void Detach(TSnap7Bucket *Bucket);
+    static void GetStats(const char *PlcAddress, PS7RateStats pStats, bool DoReset);
 };
 
+//---------------------------------------------------------------------------
+// CPU capabilities : the family is detected from the order code (SZL 0x0011),
+// a CPU which refuses the SZL (LOGO, S7-200) is taken as plcLogo_200.
+// Every family has a profile of the parallel jobs and connections safe to use.
+// The jobs granted in the PDU negotiation lower the profile, the connections
+// declared by the CPU (CP info, SZL 0x0131) replace it.
+//---------------------------------------------------------------------------
+// Same values as S7_PLC_xxx of s7.h
+const int plcUnknown   = -1;
+const int plc300_400   = 0;
+const int plc1200_1500 = 1;
+const int plcLogo_200  = 2;
+const int plcSinamics  = 3;
+
+typedef struct {
+    int Family;         // plcXXX
+    int PDURequested;   // PDU size asked
+    int PDUGranted;     // PDU size granted
+    int MaxAmqCaller;   // Parallel jobs granted (calling side)
+    int MaxAmqCallee;   // Parallel jobs granted (called side)
+    int ParallelJobs;   // Parallel jobs advised
+    int MaxConnections; // Connections advised
+} TS7Capabilities, *PS7Capabilities;
+
+// Wall clock stamps of the last job (p_i32_RecvStamps), ns since 1970-01-01 UTC
+typedef struct {
+    uint64_t Sent;      // First request sent
+    uint64_t Received;  // Last answer received
+    int Kernel;         // Received is the kernel arrival time (else taken after the read)
+    int PDUs;           // Exchanges of the job
+} TS7JobStamps, *PS7JobStamps;
+
+// The opData buffers (64 KB) are borrowed from a pool shared by all the clients
+// of the process, only for the jobs that use them (blocks, SZL, fill, password)
+TS7BufferPool *ClientDataPool();
+
+//---------------------------------------------------------------------------
+// Client statistics : every job is timed in microseconds and counted in the
+// histogram of its operation, log-linear with HistSubBuckets per power of 2
+// (the values are within 1/8). Counters and histograms are written only by
+// the thread performing the jobs : GetStats reads them without locking it,
+// and a reset takes a baseline subtracted from the next snapshots. Retries
+// is the exception (also counted by the hedge and reconnection threads) and
+// is updated inside StatsCS.
+// The PDU, byte and frame counters are those of the client's connection (on
+// a shared session they stay with the session).
+//---------------------------------------------------------------------------
+const int MaxStatOps     = s7opAgBlockInfoMulti+1;
+const int HistSubBuckets = 8;
+const int HistBuckets    = 240; // 0 .. 2^32 us
+
+typedef struct {
+    longword Count;  // Jobs performed
+    longword Errors; // Jobs failed
+    longword MeanUs; // Execution times (us)
+    longword MinUs;
+    longword P50Us;
+    longword P90Us;
+    longword P99Us;
+    longword MaxUs;
+} TS7OpStats;
+
+typedef struct {
+    longword Jobs;
+    longword PDUsSent;
+    longword PDUsRecv;
+    longword BytesSent;
+    longword BytesRecv;
+    longword Slices;     // PDUs exchanged by the jobs
+    longword Retries;    // Requests repeated (PDU negotiation, hedged reads, reconnections)
+    longword Mismatches; // Frames out of sequence (parked, late or stray)
+    longword Timeouts;   // Jobs expired or failed on a receive timeout
+    TS7OpStats Ops[MaxStatOps]; // Indexed by s7opXXX
+} TS7ClientStats, *PS7ClientStats;
+
+// Raw histogram of an operation
+typedef struct {
+    longword Low[HistBuckets];    // Lower bound of the bucket (us)
+    longword Counts[HistBuckets];
+} TS7Histogram, *PS7Histogram;
+
+typedef struct {
+    longword Count;
+    longword Errors;
+    double SumUs;
+    longword Buckets[HistBuckets];
+} TOpHistogram, *POpHistogram;
+
+typedef struct {
+    longword Jobs;
+    longword Slices;
+    longword Timeouts;
+} TJobCounters;
+
+//---------------------------------------------------------------------------
+// Whole DB transfers (DBGet, DBFill, DBGetMulti) are pipelined : up to
+// PipeWindow() requests in flight, in full PDU slices. The DB lengths are
+// cached per connection, so the block info of a known DB travels with its
+// first slices instead of before them : its answer validates the length
+// (and the checksum), a DB changed meanwhile is transferred again. An entry
+// is dropped on any error of a transfer using it. The block infos of the DBs
+// not cached are pipelined as well, ahead of their data.
+//---------------------------------------------------------------------------
+typedef struct {
+    word Number;
+    word CheckSum;
+    int Size;
+} TDBLength, *PDBLength;
+
+typedef struct {
+    bool InfoSent;
+    bool InfoDone;
+    bool Known;     // Size is known (cached or from the block info)
+    bool RoomError;
+    word CheckSum;
+    int Gen;        // Bumped when the transfer restarts : older answers are ignored
+    int DBSize;
+    int Size;       // Bytes to transfer
+    int Next;       // Next offset to request
+    int InFlight;   // Requests waiting for their answer
+} TDBPipeItem, *PDBPipeItem;
+
+typedef struct {
+    int Slot;
+    int Item;
+    int Gen;        // -1 : block info
+    int Start;
+    int Size;
+} TPipeRequest;
+
 class TSnap7MicroClient: public TSnap7Peer
 {
 private:
@@ -279,6 +511,25 @@ private:
     int opGetProtection();
     int opSetPassword();
     int opClearPassword();
+    int opDBGetMulti();
+    int opAgBlockInfoMulti();
+    // Block info request/answer (also pipelined)
+    int BlockInfoRequest(int BlockType, int BlockNum);
+    int BlockInfoAnswer(PS7BlockInfo BlockInfo);
+    // Pipelined DB transfers
+    PDBLength DBLengths;
+    int DBLengthsCount;
+    int DBLengthsSize;
+    PDBLength FindDBLength(int Number);
+    void SetDBLength(int Number, int Size, int CheckSum);
+    void DropDBLength(int Number);
+    void ClearDBLengths();
+    int PipeDBTransfer(PS7DBItem Items, int ItemsCount, bool Fill, byte FillChar);
+    int PipeSend(PS7DBItem Items, PDBPipeItem Pipe, int ItemsCount, int &First, TPipeRequest &Req, bool Fill, byte FillChar);
+    void PipeAnswer(PS7DBItem Items, PDBPipeItem Pipe, TPipeRequest &Req, int Size, bool Fill);
+    int DBSliceMax(bool Fill);
+    int DBSliceRequest(int DBNumber, int Start, int Size, bool Fill, byte FillChar);
+    int DBSliceAnswer(pbyte Target, int Start, int Size, int IsoSize, bool Fill);
     int CpuError(int Error);
     longword DWordAt(void * P);
     int CheckBlock(int BlockType, int BlockNum,  void *pBlock,  int Size);
@@ -287,24 +538,74 @@ protected:
     word ConnectionType;
     longword JobStart;
     TSnap7Job Job;
-    int DataSizeByte(int WordLength);
+    int JobTimeout;                  // Job deadline relative to its start (ms), 0 = none
+    volatile longword JobSerial;     // Incremented at the end of every job
+    volatile longword CancelRequest; // JobSerial of the job to cancel
+    PSnapCriticalSection JobCS;      // End of the job (Deadline, Pending, JobSerial) vs CancelJob
     int opSize; // last operation size
+    TSnap7Bucket *FBucket;  // Rate limit of the PLC
+    int RateLimitPDU;
+    int RateLimitBytes;
+    int RateLimitMode;
+    void AttachBucket();
+    void DetachBucket();
+    int Family;             // CPU family, plcUnknown until detected
+    int DetectFamily();
+    // Statistics
+    POpHistogram Hists[MaxStatOps];     // Allocated at the first job of the operation
+    POpHistogram HistsBase[MaxStatOps];
+    TJobCounters JobCounters;
+    TJobCounters JobBase;
+    TIsoCounters IsoBase;
+    longword RetriesBase;
+    longword MismatchesBase;
+    PSnapCriticalSection StatsCS;
+    void RecordJob(int Op, longword Time, longword Slices, int Result);
+    void AddRetry();
+    TS7JobStamps JobStamps;
+    // opData is borrowed before the job and given back at its end
+    void NeedData();
+    void FreeData();
+    int ThrottleExchange(int Size);
+    void ExchangeReceived(int Size);
+    // Runs a single operation filling Job.Result, descendants can route it elsewhere
+    virtual void RunOperation(int Operation);
+    // Called at the end of every job, before it's seen completed (Pending)
+    virtual void JobCompleted(){};
     int PerformOperation();
 public:
-    TS7Buffer opData;
+    pbyte opData; // NULL out of the jobs using it
+    int DataSizeByte(int WordLength);
 	TSnap7MicroClient();
     ~TSnap7MicroClient();
     int Reset(bool DoReconnect);
     void SetConnectionParams(const char *RemAddress, word LocalTSAP, word RemoteTsap);
     void SetConnectionType(word ConnType);
+    // Takes address, TSAPs and connection params of another client (same PLC)
+    void CopySettings(TSnap7MicroClient *Source);
 	int ConnectTo(const char *RemAddress, int Rack, int Slot);
-    int Connect();
-	int Disconnect();
+    virtual int Connect();
+	virtual int Disconnect();
 	int GetParam(int ParamNumber, void *pValue);
 	int SetParam(int ParamNumber, void *pValue);
+    // Performs a job prepared by another client (session sharing)
+    int PerformJob(TSnap7Job &Source, longword Start, int Timeout);
+    // Cancels the job queued or in progress (can be called from another thread)
+    int CancelJob();
+    // Rate limit counters of the PLC
+    int GetRateStats(PS7RateStats pStats, bool DoReset);
+    // Negotiated PDU, CPU family and the limits advised for it
+    int GetCapabilities(PS7Capabilities pCaps);
+    // Counters and latency statistics since the last reset
+    int GetStats(PS7ClientStats pStats, bool DoReset);
+    int GetHistogram(int Op, PS7Histogram pHist);
+    // Send/receive stamps of the last job
+    int GetJobStamps(PS7JobStamps pStamps);
+    // Working buffers held now (bytes)
+    longword BuffersSize();
     // Fundamental Data I/O functions
     int ReadArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void * pUsrData);
-    int WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void * pUsrData);
+    virtual int WriteArea(int Area, int DBNumber, int Start, int Amount, int WordLen, void * pUsrData);
     int ReadMultiVars(PS7DataItem Item, int ItemsCount);
     int WriteMultiVars(PS7DataItem Item, int ItemsCount);
     // Data I/O Helper functions
@@ -323,7 +624,11 @@ public:
     // Directory functions
     int ListBlocks(PS7BlocksList pUsrData);
     int GetAgBlockInfo(int BlockType, int BlockNum, PS7BlockInfo pUsrData);
+    // Block infos pipelined in one job
+    int GetAgBlockInfoMulti(PS7BlockInfoItem Items, int ItemsCount);
     int GetPgBlockInfo(void * pBlock, PS7BlockInfo pUsrData, int Size);
+    // Offline images vs online blocks, Mismatches = items with Diff<>0
+    int CompareBlocks(PS7BlockCompare Items, int ItemsCount, int &Mismatches);
     int ListBlocksOfType(int BlockType, TS7BlocksOfType *pUsrData, int & ItemsCount);
     // Blocks functions
     int Upload(int BlockType, int BlockNum, void * pUsrData, int & Size);
@@ -332,8 +637,12 @@ public:
     int Delete(int BlockType, int BlockNum);
     int DBGet(int DBNumber, void * pUsrData, int & Size);
     int DBFill(int DBNumber, int FillChar);
+    // Whole DBs in one job, the block infos and the slices pipelined
+    int DBGetMulti(PS7DBItem Items, int ItemsCount);
     // Date/Time functions
     int GetPlcDateTime(tm &DateTime);
+    // PLC clock in ns since 1970-01-01 read as UTC, ms resolution
+    int GetPlcClock(int64_t &PlcTime);
     int SetPlcDateTime(tm * DateTime);
     int SetPlcSystemDateTime();
     // System Info functions
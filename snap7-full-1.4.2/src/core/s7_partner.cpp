@@ -404,6 +404,8 @@ TSnap7Partner::TSnap7Partner(bool CreateActive)
     memset(&FRecvLast,0,sizeof(TRecvLast));
     FSendElapsed  = 0;
 	Destroying    = false;
+    AmqRequest    = 1; // BSend/BRecv don't pipeline
+    PDURequest    = 480; // The partners keep the classic request (not PDURequestDef)
     // public
     Linked        =false;
     Running       =false;
@@ -29,7 +29,12 @@
 TSnap7Peer::TSnap7Peer()
 {
     PDUH_out=PS7ReqHeader(&PDU.Payload);
-    PDURequest=480; // Our request, FPDULength will contain the CPU answer
+    PDURequest=PDURequestDef; // Our request, FPDULength will contain the CPU answer
+    PDURequested=0;
+    AmqRequest=AmqRequestDef;
+    MaxAmqCaller=0;
+    MaxAmqCallee=0;
+    Retries=0;
     LastError=0;
 	cntword = 0;
     Destroying = false;
@@ -63,7 +68,7 @@ word TSnap7Peer::GetNextWord()
      return cntword++;
 }
 //---------------------------------------------------------------------------
-int TSnap7Peer::NegotiatePDULength( )
+int TSnap7Peer::NegotiatePDU(int Request)
 {
     int Result, IsoSize = 0;
     PReqFunNegotiateParams ReqNegotiate;
@@ -82,9 +87,10 @@ int TSnap7Peer::NegotiatePDULength( )
     // Params
     ReqNegotiate->FunNegotiate = pduNegotiate;
     ReqNegotiate->Unknown = 0x00;
-    ReqNegotiate->ParallelJobs_1 = 0x0100;
+    ReqNegotiate->ParallelJobs_1 = SwapWord(AmqRequest);
     ReqNegotiate->ParallelJobs_2 = 0x0100;
-    ReqNegotiate->PDULength = SwapWord(PDURequest);
+    ReqNegotiate->PDULength = SwapWord(Request);
+    PDURequested = Request;
     IsoSize = sizeof( TS7ReqHeader ) + sizeof( TReqFunNegotiateParams );
     Result = isoExchangeBuffer(NULL, IsoSize);
     if ((Result == 0) && (IsoSize == int(sizeof(TS7ResHeader23) + sizeof(TResFunNegotiateParams))))
@@ -95,11 +101,53 @@ int TSnap7Peer::NegotiatePDULength( )
         if ( Answer->Error != 0 )
 	    Result = SetError(errNegotiatingPDU);
         if ( Result == 0 )
+        {
 	    PDULength = SwapWord(ResNegotiate->PDULength);
+            // Never more than asked, our buffers are sized on it
+            if (PDULength > Request)
+                PDULength = Request;
+            MaxAmqCaller = SwapWord(ResNegotiate->ParallelJobs_1);
+            MaxAmqCallee = SwapWord(ResNegotiate->ParallelJobs_2);
+        }
     }
     return Result;
 }
 //---------------------------------------------------------------------------
+int TSnap7Peer::NegotiatePDULength( )
+{
+    static const int Fallback[] = { 960, 480, 240 };
+    int Result, Request, c;
+
+    Request = PDURequest;
+    if ((Request <= 0) || (Request > PDURequestDef))
+        Request = PDURequestDef;
+    Result = NegotiatePDU(Request);
+    for (c = 0; (Result == int(errNegotiatingPDU)) && (c < 3); c++)
+        if (Fallback[c] < Request)
+        {
+            AddRetry();
+            Result = NegotiatePDU(Fallback[c]);
+        }
+    return Result;
+}
+//---------------------------------------------------------------------------
+void TSnap7Peer::AddRetry()
+{
+    Retries++;
+}
+//---------------------------------------------------------------------------
+int TSnap7Peer::PipeWindow()
+{
+    int Result = AmqRequest;
+    if (Result > MaxAmqCaller)
+        Result = MaxAmqCaller;
+    if (Result > AmqRequestMax)
+        Result = AmqRequestMax;
+    if (Result < 1)
+        Result = 1;
+    return Result;
+}
+//---------------------------------------------------------------------------
 void TSnap7Peer::PeerDisconnect( )
 {
     ClrError();
@@ -34,6 +34,16 @@ const longword errPeerMask 	     = 0xFFF00000;
 const longword errPeerBase       = 0x000FFFFF;
 const longword errNegotiatingPDU = 0x00100000;
 
+// PDU negotiation : we ask for PDURequest (by default the biggest PDU an ISO
+// telegram carries) and the CPU answers with what it grants. A CPU refusing
+// the request instead of lowering it gets the standard sizes, down to 240.
+const int PDURequestDef = int(IsoPayload_Size-DataHeaderSize);
+
+// Parallel jobs (AMQ) asked at the connection : the pipelined transfers keep
+// in flight at most what the CPU grants, and never more than AmqRequestMax.
+const int AmqRequestDef = 4;
+const int AmqRequestMax = DemuxSlots/2; // the others are left to the demux
+
 class TSnap7Peer: public TIsoTcpSocket
 {
 private:
@@ -43,12 +53,22 @@ protected:
     PS7ReqHeader PDUH_out;
     word GetNextWord();
     int SetError(int Error);
+    int NegotiatePDU(int Request);
     int NegotiatePDULength();
     void ClrError();
+    // Requests that a pipelined transfer can keep in flight
+    int PipeWindow();
+    // Counts a repeated request, descendants written by many threads lock it
+    virtual void AddRetry();
 public:
     int LastError;
     int PDULength;
     int PDURequest;
+    int PDURequested;  // Size asked in the last negotiation
+    int AmqRequest;    // Parallel jobs asked
+    int MaxAmqCaller;  // Parallel jobs granted by the CPU
+    int MaxAmqCallee;
+    longword Retries;  // Requests repeated (statistics)
     TSnap7Peer();
     ~TSnap7Peer();
     void PeerDisconnect();
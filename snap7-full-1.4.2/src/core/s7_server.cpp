@@ -28,6 +28,14 @@
 
 const byte BitMask[8] = {0x01,0x02,0x04,0x08,0x10,0x20,0x40,0x80};
 
+// SZL answer frames, borrowed by the workers only for the SZL requests
+static TS7BufferPool *SZLPool()
+{
+    // Never destroyed : workers may outlive the static objects at exit
+    static TS7BufferPool *Pool = new TS7BufferPool(sizeof(TSZL));
+    return Pool;
+}
+
 //------------------------------------------------------------------------------
 // ISO/TCP WORKER  CLASS
 //------------------------------------------------------------------------------
@@ -106,6 +114,7 @@ TS7Worker::TS7Worker()
     FPDULength=2048;
     DBCnt     =0;
     LastBlk   =Block_DB;
+    SZL       =NULL;
 }
 
 bool TS7Worker::ExecuteRecv()
@@ -135,8 +144,10 @@ byte TS7Worker::BCD(word Value)
 //------------------------------------------------------------------------------
 void TS7Worker::FillTime(PS7Time PTime)
 {
-    time_t Now;
-    time(&Now);
+    // Milliseconds too, as a real CPU does
+    uint64_t Stamp = SysGetRealTime();
+    time_t Now = time_t(Stamp / 1000000000ULL);
+    int Msec = int((Stamp / 1000000ULL) % 1000);
     struct tm *DT = localtime (&Now);
 
     PTime->bcd_year=BCD(DT->tm_year-100);
@@ -145,8 +156,8 @@ void TS7Worker::FillTime(PS7Time PTime)
     PTime->bcd_hour=BCD(DT->tm_hour);
     PTime->bcd_min =BCD(DT->tm_min);
     PTime->bcd_sec =BCD(DT->tm_sec);
-    PTime->bcd_himsec=0;
-    PTime->bcd_dow =BCD(DT->tm_wday);
+    PTime->bcd_himsec=BCD(Msec / 10);
+    PTime->bcd_dow =BCD(DT->tm_wday) | ((Msec % 10) << 4);
 }
 //------------------------------------------------------------------------------
 void TS7Worker::DoEvent(longword Code, word RetCode, word Param1, word Param2,
@@ -1234,19 +1245,19 @@ bool TS7Worker::PerformGroupBlockInfo()
 //==============================================================================
 void TS7Worker::SZLNotAvailable()
 {
-    SZL.Answer.Header.DataLen=SwapWord(sizeof(SZLNotAvail));
-	SZL.ResParams->Err = 0x02D4;
-    memcpy(SZL.ResData, &SZLNotAvail, sizeof(SZLNotAvail));
-    isoSendBuffer(&SZL.Answer,26);
-    SZL.SZLDone=false;
+    SZL->Answer.Header.DataLen=SwapWord(sizeof(SZLNotAvail));
+	SZL->ResParams->Err = 0x02D4;
+    memcpy(SZL->ResData, &SZLNotAvail, sizeof(SZLNotAvail));
+    isoSendBuffer(&SZL->Answer,26);
+    SZL->SZLDone=false;
 }
 void TS7Worker::SZLSystemState()
 {
-    SZL.Answer.Header.DataLen=SwapWord(sizeof(SZLSysState));
-    SZL.ResParams->Err =0x0000;
-    memcpy(SZL.ResData,&SZLNotAvail,sizeof(SZLSysState));
-    isoSendBuffer(&SZL.Answer,28);
-	SZL.SZLDone=true;
+    SZL->Answer.Header.DataLen=SwapWord(sizeof(SZLSysState));
+    SZL->ResParams->Err =0x0000;
+    memcpy(SZL->ResData,&SZLNotAvail,sizeof(SZLSysState));
+    isoSendBuffer(&SZL->Answer,28);
+	SZL->SZLDone=true;
 
 }
 void TS7Worker::SZLData(void *P, int len)
@@ -1257,16 +1268,16 @@ void TS7Worker::SZLData(void *P, int len)
 		len=MaxSzl;
 	}
 
-	SZL.Answer.Header.DataLen=SwapWord(word(len));
-	SZL.ResParams->Err  =0x0000;
-	SZL.ResParams->resvd=0x0000; // this is the end, no more packets
-	memcpy(SZL.ResData, P, len);
+	SZL->Answer.Header.DataLen=SwapWord(word(len));
+	SZL->ResParams->Err  =0x0000;
+	SZL->ResParams->resvd=0x0000; // this is the end, no more packets
+	memcpy(SZL->ResData, P, len);
 
-	SZL.ResData[2]=((len-4)>>8) & 0xFF;
-	SZL.ResData[3]=(len-4) & 0xFF;
+	SZL->ResData[2]=((len-4)>>8) & 0xFF;
+	SZL->ResData[3]=(len-4) & 0xFF;
 
-	isoSendBuffer(&SZL.Answer,22+len);
-	SZL.SZLDone=true;
+	isoSendBuffer(&SZL->Answer,22+len);
+	SZL->SZLDone=true;
 }
 // this block is dynamic (contains date/time and cpu status)
 void TS7Worker::SZL_ID424()
@@ -1274,75 +1285,86 @@ void TS7Worker::SZL_ID424()
 	PS7Time PTime;
 	pbyte PStatus;
 
-	SZL.Answer.Header.DataLen=SwapWord(sizeof(SZL_ID_0424_IDX_XXXX));
-	SZL.ResParams->Err  =0x0000;
-	PTime=PS7Time(pbyte(SZL.ResData)+24);
-	PStatus =pbyte(SZL.ResData)+15;
-	memcpy(SZL.ResData,&SZL_ID_0424_IDX_XXXX,sizeof(SZL_ID_0424_IDX_XXXX));
+	SZL->Answer.Header.DataLen=SwapWord(sizeof(SZL_ID_0424_IDX_XXXX));
+	SZL->ResParams->Err  =0x0000;
+	PTime=PS7Time(pbyte(SZL->ResData)+24);
+	PStatus =pbyte(SZL->ResData)+15;
+	memcpy(SZL->ResData,&SZL_ID_0424_IDX_XXXX,sizeof(SZL_ID_0424_IDX_XXXX));
 	FillTime(PTime);
 	*PStatus=FServer->CpuStatus;
-	SZL.SZLDone=true;
-	isoSendBuffer(&SZL.Answer,22+sizeof(SZL_ID_0424_IDX_XXXX));
+	SZL->SZLDone=true;
+	isoSendBuffer(&SZL->Answer,22+sizeof(SZL_ID_0424_IDX_XXXX));
 }
 
 void TS7Worker::SZL_ID131_IDX003()
 {
 	word len = sizeof(SZL_ID_0131_IDX_0003);
-	SZL.Answer.Header.DataLen=SwapWord(len);
-	SZL.ResParams->Err  =0x0000;
-	SZL.ResParams->resvd=0x0000; // this is the end, no more packets
-	memcpy(SZL.ResData, &SZL_ID_0131_IDX_0003, len);
+	SZL->Answer.Header.DataLen=SwapWord(len);
+	SZL->ResParams->Err  =0x0000;
+	SZL->ResParams->resvd=0x0000; // this is the end, no more packets
+	memcpy(SZL->ResData, &SZL_ID_0131_IDX_0003, len);
     // Set the max consistent data window to PDU size
-	SZL.ResData[18]=((FPDULength)>>8) & 0xFF;
-	SZL.ResData[19]=(FPDULength) & 0xFF;
+	SZL->ResData[18]=((FPDULength)>>8) & 0xFF;
+	SZL->ResData[19]=(FPDULength) & 0xFF;
 
-	isoSendBuffer(&SZL.Answer,22+len);
-	SZL.SZLDone=true;
+	isoSendBuffer(&SZL->Answer,22+len);
+	SZL->SZLDone=true;
 }
 
 bool TS7Worker::PerformGroupSZL()
 {
-  SZL.SZLDone=false;
+  bool Result;
+
+  SZL=PSZL(SZLPool()->Borrow());
+  Result=PerformSZLRequest();
+  SZLPool()->Release(pbyte(SZL));
+  SZL=NULL;
+  return Result;
+}
+//------------------------------------------------------------------------------
+bool TS7Worker::PerformSZLRequest()
+{
+  SZL->SZLDone=false;
   // Setup pointers
-  SZL.ReqParams=PReqFunReadSZLFirst(pbyte(PDUH_in)+ReqHeaderSize);
-  SZL.ResParams=PS7ResParams7(pbyte(&SZL.Answer)+ResHeaderSize17);
-  SZL.ResData  =pbyte(&SZL.Answer)+ResHeaderSize17+sizeof(TS7Params7);
+  SZL->ReqParams=PReqFunReadSZLFirst(pbyte(PDUH_in)+ReqHeaderSize);
+  SZL->ResParams=PS7ResParams7(pbyte(&SZL->Answer)+ResHeaderSize17);
+  SZL->ResData  =pbyte(&SZL->Answer)+ResHeaderSize17+sizeof(TS7Params7);
   // Prepare Answer header
-  SZL.Answer.Header.P=0x32;
-  SZL.Answer.Header.PDUType=PduType_userdata;
-  SZL.Answer.Header.AB_EX=0x0000;
-  SZL.Answer.Header.Sequence=PDUH_in->Sequence;
-  SZL.Answer.Header.ParLen =SwapWord(sizeof(TS7Params7));
-
-  SZL.ResParams->Head[0]=SZL.ReqParams->Head[0];
-  SZL.ResParams->Head[1]=SZL.ReqParams->Head[1];
-  SZL.ResParams->Head[2]=SZL.ReqParams->Head[2];
-  SZL.ResParams->Plen  =0x08;
-  SZL.ResParams->Uk    =0x12;
-  SZL.ResParams->Tg    =0x84; // Type response + group szl
-  SZL.ResParams->SubFun=SZL.ReqParams->SubFun;
-  SZL.ResParams->Seq   =SZL.ReqParams->Seq;
-  SZL.ResParams->resvd=0x0000; // this is the end, no more packets
+  SZL->Answer.Header.P=0x32;
+  SZL->Answer.Header.PDUType=PduType_userdata;
+  SZL->Answer.Header.AB_EX=0x0000;
+  SZL->Answer.Header.Sequence=PDUH_in->Sequence;
+  SZL->Answer.Header.ParLen =SwapWord(sizeof(TS7Params7));
+
+  SZL->ResParams->Head[0]=SZL->ReqParams->Head[0];
+  SZL->ResParams->Head[1]=SZL->ReqParams->Head[1];
+  SZL->ResParams->Head[2]=SZL->ReqParams->Head[2];
+  SZL->ResParams->Plen  =0x08;
+  SZL->ResParams->Uk    =0x12;
+  SZL->ResParams->Tg    =0x84; // Type response + group szl
+  SZL->ResParams->SubFun=SZL->ReqParams->SubFun;
+  SZL->ResParams->Seq   =SZL->ReqParams->Seq;
+  SZL->ResParams->resvd=0x0000; // this is the end, no more packets
 
   // only two subfunction are defined : 0x01 read, 0x02 system state
-  if (SZL.ResParams->SubFun==0x02)   // 0x02 = subfunction system state
+  if (SZL->ResParams->SubFun==0x02)   // 0x02 = subfunction system state
   {
       SZLSystemState();
       return true;
   };
-  if (SZL.ResParams->SubFun!=0x01)
+  if (SZL->ResParams->SubFun!=0x01)
   {
       SZLNotAvailable();
       return true;
   };
   // From here we assume subfunction = 0x01
-  SZL.ReqData=PS7ReqSZLData(pbyte(PDUH_in)+ReqHeaderSize+sizeof(TReqFunReadSZLFirst));// Data after params
+  SZL->ReqData=PS7ReqSZLData(pbyte(PDUH_in)+ReqHeaderSize+sizeof(TReqFunReadSZLFirst));// Data after params
 
-  SZL.ID=SwapWord(SZL.ReqData->ID);
-  SZL.Index=SwapWord(SZL.ReqData->Index);
+  SZL->ID=SwapWord(SZL->ReqData->ID);
+  SZL->Index=SwapWord(SZL->ReqData->Index);
 
   // Switch prebuilt Data Bank (they come from a physical CPU)
-  switch (SZL.ID)
+  switch (SZL->ID)
   {
     case 0x0000 : SZLData(&SZL_ID_0000_IDX_XXXX,sizeof(SZL_ID_0000_IDX_XXXX));break;
     case 0x0F00 : SZLData(&SZL_ID_0F00_IDX_XXXX,sizeof(SZL_ID_0F00_IDX_XXXX));break;
@@ -1396,66 +1418,66 @@ bool TS7Worker::PerformGroupSZL()
     case 0x003A : SZLData(&SZL_ID_003A_IDX_XXXX,sizeof(SZL_ID_003A_IDX_XXXX));break;
     case 0x0F3A : SZLData(&SZL_ID_0F3A_IDX_XXXX,sizeof(SZL_ID_0F3A_IDX_XXXX));break;
     case 0x0F9A : SZLData(&SZL_ID_0F9A_IDX_XXXX,sizeof(SZL_ID_0F9A_IDX_XXXX));break;
-    case 0x0D91 : switch(SZL.Index){
+    case 0x0D91 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0D91_IDX_0000,sizeof(SZL_ID_0D91_IDX_0000));break;
                     default: SZLNotAvailable();break;
                   };
                   break;
-    case 0x0092 : switch(SZL.Index){
+    case 0x0092 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0092_IDX_0000,sizeof(SZL_ID_0092_IDX_0000));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0292 : switch(SZL.Index){
+    case 0x0292 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0292_IDX_0000,sizeof(SZL_ID_0292_IDX_0000));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0692 : switch(SZL.Index){
+    case 0x0692 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0692_IDX_0000,sizeof(SZL_ID_0692_IDX_0000));break;
                     default     : SZLNotAvailable();break;
                   };break;
-	case 0x0094 : switch(SZL.Index){
+	case 0x0094 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0094_IDX_0000,sizeof(SZL_ID_0094_IDX_0000));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0D97 : switch(SZL.Index){
+    case 0x0D97 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0D97_IDX_0000,sizeof(SZL_ID_0D97_IDX_0000));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0111 : switch(SZL.Index){
+    case 0x0111 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0111_IDX_0001,sizeof(SZL_ID_0111_IDX_0001));break;
                     case 0x0006 : SZLData(&SZL_ID_0111_IDX_0006,sizeof(SZL_ID_0111_IDX_0006));break;
                     case 0x0007 : SZLData(&SZL_ID_0111_IDX_0007,sizeof(SZL_ID_0111_IDX_0007));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0F11 : switch(SZL.Index){
+    case 0x0F11 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0F11_IDX_0001,sizeof(SZL_ID_0F11_IDX_0001));break;
                     case 0x0006 : SZLData(&SZL_ID_0F11_IDX_0006,sizeof(SZL_ID_0F11_IDX_0006));break;
                     case 0x0007 : SZLData(&SZL_ID_0F11_IDX_0007,sizeof(SZL_ID_0F11_IDX_0007));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0112 : switch(SZL.Index){
+    case 0x0112 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0112_IDX_0000,sizeof(SZL_ID_0112_IDX_0000));break;
                     case 0x0100 : SZLData(&SZL_ID_0112_IDX_0100,sizeof(SZL_ID_0112_IDX_0100));break;
                     case 0x0200 : SZLData(&SZL_ID_0112_IDX_0200,sizeof(SZL_ID_0112_IDX_0200));break;
                     case 0x0400 : SZLData(&SZL_ID_0112_IDX_0400,sizeof(SZL_ID_0112_IDX_0400));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0F12 : switch(SZL.Index){
+    case 0x0F12 : switch(SZL->Index){
                    case 0x0000 : SZLData(&SZL_ID_0F12_IDX_0000,sizeof(SZL_ID_0F12_IDX_0000));break;
                    case 0x0100 : SZLData(&SZL_ID_0F12_IDX_0100,sizeof(SZL_ID_0F12_IDX_0100));break;
                    case 0x0200 : SZLData(&SZL_ID_0F12_IDX_0200,sizeof(SZL_ID_0F12_IDX_0200));break;
                    case 0x0400 : SZLData(&SZL_ID_0F12_IDX_0400,sizeof(SZL_ID_0F12_IDX_0400));break;
                    default     : SZLNotAvailable();break;
                   };break;
-    case 0x0113 : switch(SZL.Index){
+    case 0x0113 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0113_IDX_0001,sizeof(SZL_ID_0113_IDX_0001));break;
                     default     : SZLNotAvailable();break;
                   };break;
-	case 0x0115 : switch(SZL.Index){
+	case 0x0115 : switch(SZL->Index){
                     case 0x0800 : SZLData(&SZL_ID_0115_IDX_0800,sizeof(SZL_ID_0115_IDX_0800));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x011C : switch(SZL.Index){
+    case 0x011C : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_011C_IDX_0001,sizeof(SZL_ID_011C_IDX_0001));break;
                     case 0x0002 : SZLData(&SZL_ID_011C_IDX_0002,sizeof(SZL_ID_011C_IDX_0002));break;
                     case 0x0003 : SZLData(&SZL_ID_011C_IDX_0003,sizeof(SZL_ID_011C_IDX_0003));break;
@@ -1468,7 +1490,7 @@ bool TS7Worker::PerformGroupSZL()
                     case 0x000B : SZLData(&SZL_ID_011C_IDX_000B,sizeof(SZL_ID_011C_IDX_000B));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0222 : switch(SZL.Index){
+    case 0x0222 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0222_IDX_0001,sizeof(SZL_ID_0222_IDX_0001));break;
                     case 0x000A : SZLData(&SZL_ID_0222_IDX_000A,sizeof(SZL_ID_0222_IDX_000A));break;
                     case 0x0014 : SZLData(&SZL_ID_0222_IDX_0014,sizeof(SZL_ID_0222_IDX_0014));break;
@@ -1477,16 +1499,16 @@ bool TS7Worker::PerformGroupSZL()
                     case 0x0064 : SZLData(&SZL_ID_0222_IDX_0064,sizeof(SZL_ID_0222_IDX_0064));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0125 : switch(SZL.Index){
+    case 0x0125 : switch(SZL->Index){
                     case 0x0000 : SZLData(&SZL_ID_0125_IDX_0000,sizeof(SZL_ID_0125_IDX_0000));break;
                     case 0x0001 : SZLData(&SZL_ID_0125_IDX_0001,sizeof(SZL_ID_0125_IDX_0001));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0225 : switch(SZL.Index){
+    case 0x0225 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0225_IDX_0001,sizeof(SZL_ID_0225_IDX_0001));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0131 : switch(SZL.Index){
+    case 0x0131 : switch(SZL->Index){
 					case 0x0001 : SZLData(&SZL_ID_0131_IDX_0001,sizeof(SZL_ID_0131_IDX_0001));break;
 					case 0x0002 : SZLData(&SZL_ID_0131_IDX_0002,sizeof(SZL_ID_0131_IDX_0002));break;
 					case 0x0003 : SZL_ID131_IDX003();break;
@@ -1498,7 +1520,7 @@ bool TS7Worker::PerformGroupSZL()
                     case 0x0009 : SZLData(&SZL_ID_0131_IDX_0009,sizeof(SZL_ID_0131_IDX_0009));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0117 : switch(SZL.Index){
+    case 0x0117 : switch(SZL->Index){
                      case 0x0000 : SZLData(&SZL_ID_0117_IDX_0000,sizeof(SZL_ID_0117_IDX_0000));break;
                      case 0x0001 : SZLData(&SZL_ID_0117_IDX_0001,sizeof(SZL_ID_0117_IDX_0001));break;
                      case 0x0002 : SZLData(&SZL_ID_0117_IDX_0002,sizeof(SZL_ID_0117_IDX_0002));break;
@@ -1506,14 +1528,14 @@ bool TS7Worker::PerformGroupSZL()
                      case 0x0004 : SZLData(&SZL_ID_0117_IDX_0004,sizeof(SZL_ID_0117_IDX_0004));break;
                      default     : SZLNotAvailable();break;
                    };break;
-    case 0x0118 : switch(SZL.Index){
+    case 0x0118 : switch(SZL->Index){
                      case 0x0000 : SZLData(&SZL_ID_0118_IDX_0000,sizeof(SZL_ID_0118_IDX_0000));break;
                      case 0x0001 : SZLData(&SZL_ID_0118_IDX_0001,sizeof(SZL_ID_0118_IDX_0001));break;
                      case 0x0002 : SZLData(&SZL_ID_0118_IDX_0002,sizeof(SZL_ID_0118_IDX_0002));break;
                      case 0x0003 : SZLData(&SZL_ID_0118_IDX_0003,sizeof(SZL_ID_0118_IDX_0003));break;
                      default     : SZLNotAvailable();break;
                    };break;
-    case 0x0132 : switch(SZL.Index){
+    case 0x0132 : switch(SZL->Index){
                      case 0x0001 : SZLData(&SZL_ID_0132_IDX_0001,sizeof(SZL_ID_0132_IDX_0001));break;
                      case 0x0002 : SZLData(&SZL_ID_0132_IDX_0002,sizeof(SZL_ID_0132_IDX_0002));break;
                      case 0x0003 : SZLData(&SZL_ID_0132_IDX_0003,sizeof(SZL_ID_0132_IDX_0003));break;
@@ -1528,11 +1550,11 @@ bool TS7Worker::PerformGroupSZL()
                      case 0x000C : SZLData(&SZL_ID_0132_IDX_000C,sizeof(SZL_ID_0132_IDX_000C));break;
                      default     : SZLNotAvailable();break;
                    };break;
-    case 0x0137 : switch(SZL.Index){
+    case 0x0137 : switch(SZL->Index){
                     case 0x07FE : SZLData(&SZL_ID_0137_IDX_07FE,sizeof(SZL_ID_0137_IDX_07FE));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x01A0 : switch(SZL.Index){
+    case 0x01A0 : switch(SZL->Index){
                      case 0x0000 : SZLData(&SZL_ID_01A0_IDX_0000,sizeof(SZL_ID_01A0_IDX_0000));break;
                      case 0x0001 : SZLData(&SZL_ID_01A0_IDX_0001,sizeof(SZL_ID_01A0_IDX_0001));break;
                      case 0x0002 : SZLData(&SZL_ID_01A0_IDX_0002,sizeof(SZL_ID_01A0_IDX_0002));break;
@@ -1557,7 +1579,7 @@ bool TS7Worker::PerformGroupSZL()
                      case 0x0015 : SZLData(&SZL_ID_01A0_IDX_0015,sizeof(SZL_ID_01A0_IDX_0015));break;
                      default     : SZLNotAvailable();break;
                    };break;
-    case 0x0174 : switch(SZL.Index){
+    case 0x0174 : switch(SZL->Index){
                     case 0x0001 : SZLData(&SZL_ID_0174_IDX_0001,sizeof(SZL_ID_0174_IDX_0001));break;
                     case 0x0004 : SZLData(&SZL_ID_0174_IDX_0004,sizeof(SZL_ID_0174_IDX_0004));break;
                     case 0x0005 : SZLData(&SZL_ID_0174_IDX_0005,sizeof(SZL_ID_0174_IDX_0005));break;
@@ -1566,30 +1588,30 @@ bool TS7Worker::PerformGroupSZL()
                     case 0x000C : SZLData(&SZL_ID_0174_IDX_000C,sizeof(SZL_ID_0174_IDX_000C));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0194 : switch(SZL.Index){
+    case 0x0194 : switch(SZL->Index){
                     case 0x0064 : SZLData(&SZL_ID_0194_IDX_0064,sizeof(SZL_ID_0194_IDX_0064));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0694 : switch(SZL.Index){
+    case 0x0694 : switch(SZL->Index){
                     case 0x0064 : SZLData(&SZL_ID_0694_IDX_0064,sizeof(SZL_ID_0694_IDX_0064));break;
                     default     : SZLNotAvailable();break;
                   };break;
-    case 0x0232 : switch(SZL.Index){
+    case 0x0232 : switch(SZL->Index){
                      case 0x0001 : SZLData(&SZL_ID_0232_IDX_0001,sizeof(SZL_ID_0232_IDX_0001));break;
                      case 0x0004 : SZLData(&SZL_ID_0232_IDX_0004,sizeof(SZL_ID_0232_IDX_0004));break;
                      default     : SZLNotAvailable();break;
                    };break;
-    case 0x0C91 : switch(SZL.Index){
+    case 0x0C91 : switch(SZL->Index){
                     case 0x07FE : SZLData(&SZL_ID_0C91_IDX_07FE,sizeof(SZL_ID_0C91_IDX_07FE));break;
                     default     : SZLNotAvailable();break;
                   };break;
     default : SZLNotAvailable();break;
   }
   // Event
-  if (SZL.SZLDone)
-      DoEvent(evcReadSZL,evrNoError,SZL.ID,SZL.Index,0,0);
+  if (SZL->SZLDone)
+      DoEvent(evcReadSZL,evrNoError,SZL->ID,SZL->Index,0,0);
   else
-      DoEvent(evcReadSZL,evrInvalidSZL,SZL.ID,SZL.Index,0,0);
+      DoEvent(evcReadSZL,evrInvalidSZL,SZL->ID,SZL->Index,0,0);
   return true;
 }
 //------------------------------------------------------------------------------
@@ -2077,6 +2099,23 @@ int TSnap7Server::SetRWAreaCallBack(pfn_RWAreaCallBack PCallBack, void *UsrPtr)
 	return 0;
 }
 //---------------------------------------------------------------------------
+int TSnap7Server::GetMemory(PS7MemoryInfo pInfo)
+{
+	longword Session = sizeof(TS7Worker)+sizeof(TMsgWorkerThread);
+
+	if (pInfo==NULL)
+		return errSrvInvalidParams;
+	pInfo->Sessions = ClientsCount;
+	pInfo->Fixed = longword(ClientsCount)*Session;
+	// The SZL frames in use (they are shared by all the servers of the process)
+	SZLPool()->Usage(pInfo->Buffers, pInfo->Pooled);
+	if (ClientsCount>0)
+		pInfo->PerSession = (pInfo->Fixed+pInfo->Buffers)/ClientsCount;
+	else
+		pInfo->PerSession = Session;
+	return 0;
+}
+//---------------------------------------------------------------------------
 void TSnap7Server::DoReadEvent(int Sender, longword Code, word RetCode, word Param1,
   word Param2, word Param3, word Param4)
 {
@@ -91,7 +91,7 @@ typedef struct{
     int                 ID;
     int                 Index;
     bool                SZLDone;
-}TSZL;
+}TSZL, *PSZL;
 
 // Current Event Info
 typedef struct{
@@ -119,7 +119,7 @@ private:
     PS7ReqHeader PDUH_in;
 	int DBCnt;
     byte LastBlk;
-    TSZL SZL;
+    PSZL SZL; // Borrowed only while answering a SZL request
     byte BCD(word Value);
     // Checks the consistence of the incoming PDU
     bool CheckPDU_in(int PayloadSize);
@@ -183,6 +183,7 @@ protected:
     bool PerformSetClock();
     // SZL Group
     bool PerformGroupSZL();
+    bool PerformSZLRequest();
     // Subfunctions (called by PerformGroupSZL)
     void SZLNotAvailable();
 	void SZLSystemState();
@@ -253,6 +254,8 @@ public:
     // Sets Event callback
     int SetReadEventsCallBack(pfn_SrvCallBack PCallBack, void *UsrPtr);
 	int SetRWAreaCallBack(pfn_RWAreaCallBack PCallBack, void *UsrPtr);
+    // Memory taken by the sessions
+    int GetMemory(PS7MemoryInfo pInfo);
     friend class TS7Worker;
 };
 typedef TSnap7Server *PSnap7Server;
@@ -190,6 +190,7 @@ char* IsoTextOf(int Error, char* Result)
 		case errIsoSendPacket:       strcpy(Result," ISO : An error occurred during send\0");break;
 		case errIsoRecvPacket:       strcpy(Result," ISO : An error occurred during recv\0");break;
 		case errIsoInvalidParams:    strcpy(Result," ISO : Invalid connection params (wrong TSAPs)\0");break;
+		case errIsoNoSlot:           strcpy(Result," ISO : Too many exchanges in flight\0");break;
 		default:
 		{
 			char CNumber[16];
@@ -245,6 +246,11 @@ char* CliTextOf(int Error, char* Result)
 	  case errCliDestroying             : strcpy(Result,"CLI : Cannot perform (destroying)\0");break;
 	  case errCliInvalidParamNumber     : strcpy(Result,"CLI : Invalid Param Number\0");break;
 	  case errCliCannotChangeParam      : strcpy(Result,"CLI : Cannot change this param now\0");break;
+	  case errCliJobCanceled            : strcpy(Result,"CLI : Job canceled\0");break;
+	  case errCliLinkDown               : strcpy(Result,"CLI : Link down, reconnecting\0");break;
+	  case errCliThrottled              : strcpy(Result,"CLI : Request rate limit exceeded\0");break;
+	  case errCliClockNotSynced         : strcpy(Result,"CLI : PLC clock not estimated yet\0");break;
+	  case errCliBackupFile             : strcpy(Result,"CLI : Backup folder or index not accessible\0");break;
 	  default                           :
 	  {
 		  char CNumber[16];
@@ -170,6 +170,28 @@ const int p_i32_BSendTimeout    = 12;
 const int p_i32_BRecvTimeout    = 13;
 const int p_u32_RecoveryTime    = 14;
 const int p_u32_KeepAliveTime   = 15;
+const int p_i32_SocketBackend   = 16;
+const int p_i32_JobTimeout      = 17;
+const int p_i32_HedgePercentile = 18;
+const int p_i32_HedgeDelay      = 19;
+const int p_i32_PoolSize        = 20;
+const int p_i32_PoolReserve     = 21;
+const int p_i32_ReconnectMode   = 22;
+const int p_i32_ReconnectMin    = 23;
+const int p_i32_ReconnectMax    = 24;
+const int p_i32_ShareSession    = 25;
+const int p_i32_AdaptTarget     = 26;
+const int p_i32_AdaptMin        = 27;
+const int p_i32_AdaptMax        = 28;
+const int p_i32_AdaptCycle      = 29;
+const int p_i32_RateLimitPDU    = 30;
+const int p_i32_RateLimitBytes  = 31;
+const int p_i32_RateLimitMode   = 32;
+const int p_i32_JobPriority     = 33;
+const int p_i32_WriteWindow     = 34;
+const int p_i32_WriteMaxItems   = 35;
+const int p_i32_RecvStamps      = 36;
+const int p_i32_PipeDepth       = 37;
 
 // Bool param is passed as int32_t : 0->false, 1->true
 // String param (only set) is passed as pointer
@@ -152,6 +152,14 @@ int S7API Cli_SetAsCallback(S7Object Client, pfn_CliCompletion pCompletion, void
         return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Cli_GetAsCallback(S7Object Client, pfn_CliCompletion &pCompletion, void * &usrPtr)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetAsCallback(pCompletion, usrPtr);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Cli_ReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
 {
     if (Client)
@@ -184,6 +192,14 @@ int S7API Cli_WriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount)
         return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Cli_WriteBits(S7Object Client, PS7BitItem Item, int ItemsCount)
+{
+    if (Client)
+        return PSnap7Client(Client)->WriteBits(Item, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Cli_DBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData)
 {
     if (Client)
@@ -296,6 +312,22 @@ int S7API Cli_GetAgBlockInfo(S7Object Client, int BlockType, int BlockNum, TS7Bl
         return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Cli_GetAgBlockInfoMulti(S7Object Client, TS7BlockInfoItem *Items, int ItemsCount)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetAgBlockInfoMulti(Items, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_CompareBlocks(S7Object Client, TS7BlockCompare *Items, int ItemsCount, int &Mismatches)
+{
+    if (Client)
+        return PSnap7Client(Client)->CompareBlocks(Items, ItemsCount, Mismatches);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Cli_GetPgBlockInfo(S7Object Client, void *pBlock, TS7BlockInfo *pUsrData, int Size)
 {
     if (Client)
@@ -360,6 +392,14 @@ int S7API Cli_DBFill(S7Object Client, int DBNumber, int FillChar)
         return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Cli_DBGetMulti(S7Object Client, TS7DBItem *Items, int ItemsCount)
+{
+    if (Client)
+        return PSnap7Client(Client)->DBGetMulti(Items, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Cli_GetPlcDateTime(S7Object Client, tm &DateTime)
 {
     if (Client)
@@ -578,6 +618,22 @@ int S7API Cli_AsWriteArea(S7Object Client, int Area, int DBNumber, int Start, in
         return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Cli_AsReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount)
+{
+    if (Client)
+        return PSnap7Client(Client)->AsReadMultiVars(Item, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_AsWriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount)
+{
+    if (Client)
+        return PSnap7Client(Client)->AsWriteMultiVars(Item, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Cli_AsDBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData)
 {
     if (Client)
@@ -774,6 +830,472 @@ int S7API Cli_WaitAsCompletion(S7Object Client, int Timeout)
     else
         return errLibInvalidObject;
 }
+//---------------------------------------------------------------------------
+int S7API Cli_GetAsCompletionFd(S7Object Client, int &Fd)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetAsCompletionFd(Fd);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_CancelJob(S7Object Client)
+{
+    if (Client)
+        return PSnap7Client(Client)->CancelJob();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetHedgeStats(S7Object Client, TS7HedgeStats *pStats, int Reset)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetHedgeStats(pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetRateStats(S7Object Client, TS7RateStats *pStats, int Reset)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetRateStats(pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetCapabilities(S7Object Client, TS7Capabilities *pCaps)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetCapabilities(pCaps);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetDemuxStats(S7Object Client, TS7DemuxStats *pStats, int Reset)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetDemuxStats(pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_SetDemuxCallback(S7Object Client, pfn_DemuxLog pCallback, void *usrPtr)
+{
+    if (Client)
+        return PSnap7Client(Client)->SetDemuxCallback(pCallback, usrPtr);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetStats(S7Object Client, TS7ClientStats *pStats, int Reset)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetStats(pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetHistogram(S7Object Client, int Op, TS7Histogram *pHist)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetHistogram(Op, pHist);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetJobStamps(S7Object Client, TS7JobStamps *pStamps)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetJobStamps(pStamps);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetMemory(S7Object Client, TS7MemoryInfo *pInfo)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetMemory(pInfo);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_SetLinkCallback(S7Object Client, pfn_CliLinkState pCallback, void *usrPtr)
+{
+    if (Client)
+        return PSnap7Client(Client)->SetLinkCallback(pCallback, usrPtr);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_GetLinkState(S7Object Client, int &State)
+{
+    if (Client)
+        return PSnap7Client(Client)->GetLinkState(State);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_SetDiagCallback(S7Object Client, pfn_CliDiagEvent pCallback, void *usrPtr)
+{
+    if (Client)
+        return PSnap7Client(Client)->SetDiagCallback(pCallback, usrPtr);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_DiagTail(S7Object Client, int &NewEvents)
+{
+    if (Client)
+        return PSnap7Client(Client)->DiagTail(NewEvents);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Cli_ConnectFleet(TS7FleetItem *Items, int ItemsCount, int MaxParallel, int Timeout)
+{
+    return TSnap7Client::ConnectFleet(Items, ItemsCount, MaxParallel, Timeout);
+}
+//***************************************************************************
+// CLIENT POOL
+//***************************************************************************
+S7Object S7API Pool_Create()
+{
+    return S7Object(new TSnap7Pool());
+}
+//---------------------------------------------------------------------------
+void S7API Pool_Destroy(S7Object &Pool)
+{
+    if (Pool)
+    {
+        delete PSnap7Pool(Pool);
+        Pool=0;
+    }
+}
+//---------------------------------------------------------------------------
+int S7API Pool_SetConnectionParams(S7Object Pool, const char *Address, word LocalTSAP, word RemoteTSAP)
+{
+    if (Pool)
+    {
+        PSnap7Pool(Pool)->SetConnectionParams(Address, LocalTSAP, RemoteTSAP);
+        return 0;
+    }
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_SetConnectionType(S7Object Pool, word ConnectionType)
+{
+    if (Pool)
+    {
+        PSnap7Pool(Pool)->SetConnectionType(ConnectionType);
+        return 0;
+    }
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_ConnectTo(S7Object Pool, const char *Address, int Rack, int Slot)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->ConnectTo(Address, Rack, Slot);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_Connect(S7Object Pool)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->Connect();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_Disconnect(S7Object Pool)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->Disconnect();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_GetParam(S7Object Pool, int ParamNumber, void *pValue)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->GetParam(ParamNumber, pValue);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_SetParam(S7Object Pool, int ParamNumber, void *pValue)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->SetParam(ParamNumber, pValue);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_ReadArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->ReadArea(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_WriteArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->WriteArea(Area, DBNumber, Start, Amount, WordLen, pUsrData);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_ReadMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->ReadMultiVars(Item, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_WriteMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->WriteMultiVars(Item, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_AcquireSession(S7Object Pool, S7Object &Client, int Timeout)
+{
+    TSnap7Client *Session;
+    int Result;
+    if (Pool)
+    {
+        Result=PSnap7Pool(Pool)->AcquireSession(Session, Timeout);
+        Client=S7Object(Session);
+        return Result;
+    }
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_ReleaseSession(S7Object Pool, S7Object Client)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->ReleaseSession(PSnap7Client(Client));
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Pool_GetSessions(S7Object Pool, TS7PoolSession *pUsrData, int &ItemsCount)
+{
+    if (Pool)
+        return PSnap7Pool(Pool)->GetSessions(pUsrData, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//***************************************************************************
+// SCHEDULER
+//***************************************************************************
+S7Object S7API Sched_Create(S7Object Client)
+{
+    if (Client)
+        return S7Object(new TSnap7Scheduler(PSnap7Client(Client)));
+    else
+        return 0;
+}
+//---------------------------------------------------------------------------
+void S7API Sched_Destroy(S7Object &Sched)
+{
+    if (Sched)
+    {
+        delete PSnap7Scheduler(Sched);
+        Sched=0;
+    }
+}
+//---------------------------------------------------------------------------
+int S7API Sched_AddGroup(S7Object Sched, int Interval, PS7DataItem Items, int ItemsCount, pfn_SchedGroupDone pCallback, void *usrPtr, int &GroupId)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->AddGroup(Interval, Items, ItemsCount, pCallback, usrPtr, GroupId);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_RemoveGroup(S7Object Sched, int GroupId)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->RemoveGroup(GroupId);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_Start(S7Object Sched)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->Start();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_Stop(S7Object Sched)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->Stop();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_GetGroupStats(S7Object Sched, int GroupId, TS7GroupStats *pStats, int Reset)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->GetGroupStats(GroupId, pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_GetStats(S7Object Sched, TS7SchedStats *pStats)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->GetStats(pStats);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_GetParam(S7Object Sched, int ParamNumber, void *pValue)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->GetParam(ParamNumber, pValue);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_SetParam(S7Object Sched, int ParamNumber, void *pValue)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->SetParam(ParamNumber, pValue);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Sched_GetAdaptStats(S7Object Sched, TS7AdaptStats *pStats, int Reset)
+{
+    if (Sched)
+        return PSnap7Scheduler(Sched)->GetAdaptStats(pStats, Reset!=0);
+    else
+        return errLibInvalidObject;
+}
+//***************************************************************************
+// PLC CLOCK ESTIMATOR
+//***************************************************************************
+S7Object S7API Clock_Create(S7Object Client)
+{
+    if (Client)
+        return S7Object(new TSnap7ClockSync(PSnap7Client(Client)));
+    else
+        return 0;
+}
+//---------------------------------------------------------------------------
+void S7API Clock_Destroy(S7Object &Clock)
+{
+    if (Clock)
+    {
+        delete PSnap7ClockSync(Clock);
+        Clock=0;
+    }
+}
+//---------------------------------------------------------------------------
+int S7API Clock_Start(S7Object Clock, int Interval)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->Start(Interval);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Clock_Stop(S7Object Clock)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->Stop();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Clock_Sample(S7Object Clock)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->Sample();
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Clock_GetStats(S7Object Clock, TS7ClockStats *pStats)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->GetStats(pStats);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Clock_PlcToHost(S7Object Clock, int64_t PlcTime, int64_t &HostTime)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->PlcToHost(PlcTime, HostTime);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Clock_HostToPlc(S7Object Clock, int64_t HostTime, int64_t &PlcTime)
+{
+    if (Clock)
+        return PSnap7ClockSync(Clock)->HostToPlc(HostTime, PlcTime);
+    else
+        return errLibInvalidObject;
+}
+//***************************************************************************
+// BLOCK BACKUP
+//***************************************************************************
+S7Object S7API Bak_Create(S7Object Pool)
+{
+    if (Pool)
+        return S7Object(new TSnap7Backup(PSnap7Pool(Pool)));
+    else
+        return 0;
+}
+//---------------------------------------------------------------------------
+void S7API Bak_Destroy(S7Object &Backup)
+{
+    if (Backup)
+    {
+        delete PSnap7Backup(Backup);
+        Backup=0;
+    }
+}
+//---------------------------------------------------------------------------
+int S7API Bak_Run(S7Object Backup, const char *Folder, const char *IndexName)
+{
+    if (Backup)
+        return PSnap7Backup(Backup)->Run(Folder, IndexName);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Bak_GetEntries(S7Object Backup, TS7BackupEntry *pUsrData, int &ItemsCount)
+{
+    if (Backup)
+        return PSnap7Backup(Backup)->GetEntries(pUsrData, ItemsCount);
+    else
+        return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
+int S7API Bak_GetStats(S7Object Backup, TS7BackupStats *pStats)
+{
+    if (Backup)
+        return PSnap7Backup(Backup)->GetStats(pStats);
+    else
+        return errLibInvalidObject;
+}
 //***************************************************************************
 // SERVER
 //***************************************************************************
@@ -890,6 +1412,14 @@ int S7API Srv_SetCpuStatus(S7Object Server, int CpuStatus)
 		return errLibInvalidObject;
 }
 //---------------------------------------------------------------------------
+int S7API Srv_GetMemory(S7Object Server, TS7MemoryInfo *pInfo)
+{
+	if (Server)
+		return PSnap7Server(Server)->GetMemory(pInfo);
+	else
+		return errLibInvalidObject;
+}
+//---------------------------------------------------------------------------
 int S7API Srv_ErrorText(int Error, char *Text, int TextLen)
 {
 	try{
@@ -50,11 +50,13 @@ EXPORTSPEC int S7API Cli_Disconnect(S7Object Client);
 EXPORTSPEC int S7API Cli_GetParam(S7Object Client, int ParamNumber, void *pValue);
 EXPORTSPEC int S7API Cli_SetParam(S7Object Client, int ParamNumber, void *pValue);
 EXPORTSPEC int S7API Cli_SetAsCallback(S7Object Client, pfn_CliCompletion pCompletion, void *usrPtr);
+EXPORTSPEC int S7API Cli_GetAsCallback(S7Object Client, pfn_CliCompletion &pCompletion, void * &usrPtr);
 // Data I/O functions
 EXPORTSPEC int S7API Cli_ReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 EXPORTSPEC int S7API Cli_WriteArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 EXPORTSPEC int S7API Cli_ReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
 EXPORTSPEC int S7API Cli_WriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
+EXPORTSPEC int S7API Cli_WriteBits(S7Object Client, PS7BitItem Item, int ItemsCount);
 // Data I/O Lean functions
 EXPORTSPEC int S7API Cli_DBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 EXPORTSPEC int S7API Cli_DBWrite(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
@@ -71,6 +73,8 @@ EXPORTSPEC int S7API Cli_CTWrite(S7Object Client, int Start, int Amount, void *p
 // Directory functions
 EXPORTSPEC int S7API Cli_ListBlocks(S7Object Client, TS7BlocksList *pUsrData);
 EXPORTSPEC int S7API Cli_GetAgBlockInfo(S7Object Client, int BlockType, int BlockNum, TS7BlockInfo *pUsrData);
+EXPORTSPEC int S7API Cli_GetAgBlockInfoMulti(S7Object Client, TS7BlockInfoItem *Items, int ItemsCount);
+EXPORTSPEC int S7API Cli_CompareBlocks(S7Object Client, TS7BlockCompare *Items, int ItemsCount, int &Mismatches);
 EXPORTSPEC int S7API Cli_GetPgBlockInfo(S7Object Client, void *pBlock, TS7BlockInfo *pUsrData, int Size);
 EXPORTSPEC int S7API Cli_ListBlocksOfType(S7Object Client, int BlockType, TS7BlocksOfType *pUsrData, int &ItemsCount);
 // Blocks functions
@@ -80,6 +84,7 @@ EXPORTSPEC int S7API Cli_Download(S7Object Client, int BlockNum, void *pUsrData,
 EXPORTSPEC int S7API Cli_Delete(S7Object Client, int BlockType, int BlockNum);
 EXPORTSPEC int S7API Cli_DBGet(S7Object Client, int DBNumber, void *pUsrData, int &Size);
 EXPORTSPEC int S7API Cli_DBFill(S7Object Client, int DBNumber, int FillChar);
+EXPORTSPEC int S7API Cli_DBGetMulti(S7Object Client, TS7DBItem *Items, int ItemsCount);
 // Date/Time functions
 EXPORTSPEC int S7API Cli_GetPlcDateTime(S7Object Client, tm &DateTime);
 EXPORTSPEC int S7API Cli_SetPlcDateTime(S7Object Client, tm *DateTime);
@@ -114,6 +119,8 @@ EXPORTSPEC int S7API Cli_GetConnected(S7Object Client, int &Connected);
 //==============================================================================
 EXPORTSPEC int S7API Cli_AsReadArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
 EXPORTSPEC int S7API Cli_AsWriteArea(S7Object Client, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+EXPORTSPEC int S7API Cli_AsReadMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
+EXPORTSPEC int S7API Cli_AsWriteMultiVars(S7Object Client, PS7DataItem Item, int ItemsCount);
 EXPORTSPEC int S7API Cli_AsDBRead(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 EXPORTSPEC int S7API Cli_AsDBWrite(S7Object Client, int DBNumber, int Start, int Size, void *pUsrData);
 EXPORTSPEC int S7API Cli_AsMBRead(S7Object Client, int Start, int Size, void *pUsrData);
@@ -138,6 +145,74 @@ EXPORTSPEC int S7API Cli_AsDBGet(S7Object Client, int DBNumber, void *pUsrData,
 EXPORTSPEC int S7API Cli_AsDBFill(S7Object Client, int DBNumber, int FillChar);
 EXPORTSPEC int S7API Cli_CheckAsCompletion(S7Object Client, int &opResult);
 EXPORTSPEC int S7API Cli_WaitAsCompletion(S7Object Client, int Timeout);
+EXPORTSPEC int S7API Cli_GetAsCompletionFd(S7Object Client, int &Fd);
+EXPORTSPEC int S7API Cli_CancelJob(S7Object Client);
+EXPORTSPEC int S7API Cli_GetHedgeStats(S7Object Client, TS7HedgeStats *pStats, int Reset);
+EXPORTSPEC int S7API Cli_GetRateStats(S7Object Client, TS7RateStats *pStats, int Reset);
+EXPORTSPEC int S7API Cli_GetCapabilities(S7Object Client, TS7Capabilities *pCaps);
+EXPORTSPEC int S7API Cli_GetDemuxStats(S7Object Client, TS7DemuxStats *pStats, int Reset);
+EXPORTSPEC int S7API Cli_SetDemuxCallback(S7Object Client, pfn_DemuxLog pCallback, void *usrPtr);
+EXPORTSPEC int S7API Cli_GetStats(S7Object Client, TS7ClientStats *pStats, int Reset);
+EXPORTSPEC int S7API Cli_GetHistogram(S7Object Client, int Op, TS7Histogram *pHist);
+EXPORTSPEC int S7API Cli_GetJobStamps(S7Object Client, TS7JobStamps *pStamps);
+EXPORTSPEC int S7API Cli_GetMemory(S7Object Client, TS7MemoryInfo *pInfo);
+EXPORTSPEC int S7API Cli_SetLinkCallback(S7Object Client, pfn_CliLinkState pCallback, void *usrPtr);
+EXPORTSPEC int S7API Cli_GetLinkState(S7Object Client, int &State);
+EXPORTSPEC int S7API Cli_SetDiagCallback(S7Object Client, pfn_CliDiagEvent pCallback, void *usrPtr);
+EXPORTSPEC int S7API Cli_DiagTail(S7Object Client, int &NewEvents);
+EXPORTSPEC int S7API Cli_ConnectFleet(TS7FleetItem *Items, int ItemsCount, int MaxParallel, int Timeout);
+//==============================================================================
+//  CLIENT POOL EXPORT LIST
+//==============================================================================
+EXPORTSPEC S7Object S7API Pool_Create();
+EXPORTSPEC void S7API Pool_Destroy(S7Object &Pool);
+EXPORTSPEC int S7API Pool_SetConnectionParams(S7Object Pool, const char *Address, word LocalTSAP, word RemoteTSAP);
+EXPORTSPEC int S7API Pool_SetConnectionType(S7Object Pool, word ConnectionType);
+EXPORTSPEC int S7API Pool_ConnectTo(S7Object Pool, const char *Address, int Rack, int Slot);
+EXPORTSPEC int S7API Pool_Connect(S7Object Pool);
+EXPORTSPEC int S7API Pool_Disconnect(S7Object Pool);
+EXPORTSPEC int S7API Pool_GetParam(S7Object Pool, int ParamNumber, void *pValue);
+EXPORTSPEC int S7API Pool_SetParam(S7Object Pool, int ParamNumber, void *pValue);
+EXPORTSPEC int S7API Pool_ReadArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+EXPORTSPEC int S7API Pool_WriteArea(S7Object Pool, int Area, int DBNumber, int Start, int Amount, int WordLen, void *pUsrData);
+EXPORTSPEC int S7API Pool_ReadMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount);
+EXPORTSPEC int S7API Pool_WriteMultiVars(S7Object Pool, PS7DataItem Item, int ItemsCount);
+EXPORTSPEC int S7API Pool_AcquireSession(S7Object Pool, S7Object &Client, int Timeout);
+EXPORTSPEC int S7API Pool_ReleaseSession(S7Object Pool, S7Object Client);
+EXPORTSPEC int S7API Pool_GetSessions(S7Object Pool, TS7PoolSession *pUsrData, int &ItemsCount);
+//==============================================================================
+//  SCHEDULER EXPORT LIST
+//==============================================================================
+EXPORTSPEC S7Object S7API Sched_Create(S7Object Client);
+EXPORTSPEC void S7API Sched_Destroy(S7Object &Sched);
+EXPORTSPEC int S7API Sched_AddGroup(S7Object Sched, int Interval, PS7DataItem Items, int ItemsCount, pfn_SchedGroupDone pCallback, void *usrPtr, int &GroupId);
+EXPORTSPEC int S7API Sched_RemoveGroup(S7Object Sched, int GroupId);
+EXPORTSPEC int S7API Sched_Start(S7Object Sched);
+EXPORTSPEC int S7API Sched_Stop(S7Object Sched);
+EXPORTSPEC int S7API Sched_GetGroupStats(S7Object Sched, int GroupId, TS7GroupStats *pStats, int Reset);
+EXPORTSPEC int S7API Sched_GetStats(S7Object Sched, TS7SchedStats *pStats);
+EXPORTSPEC int S7API Sched_GetParam(S7Object Sched, int ParamNumber, void *pValue);
+EXPORTSPEC int S7API Sched_SetParam(S7Object Sched, int ParamNumber, void *pValue);
+EXPORTSPEC int S7API Sched_GetAdaptStats(S7Object Sched, TS7AdaptStats *pStats, int Reset);
+//==============================================================================
+//  PLC CLOCK ESTIMATOR EXPORT LIST
+//==============================================================================
+EXPORTSPEC S7Object S7API Clock_Create(S7Object Client);
+EXPORTSPEC void S7API Clock_Destroy(S7Object &Clock);
+EXPORTSPEC int S7API Clock_Start(S7Object Clock, int Interval);
+EXPORTSPEC int S7API Clock_Stop(S7Object Clock);
+EXPORTSPEC int S7API Clock_Sample(S7Object Clock);
+EXPORTSPEC int S7API Clock_GetStats(S7Object Clock, TS7ClockStats *pStats);
+EXPORTSPEC int S7API Clock_PlcToHost(S7Object Clock, int64_t PlcTime, int64_t &HostTime);
+EXPORTSPEC int S7API Clock_HostToPlc(S7Object Clock, int64_t HostTime, int64_t &PlcTime);
+//==============================================================================
+//  BLOCK BACKUP EXPORT LIST
+//==============================================================================
+EXPORTSPEC S7Object S7API Bak_Create(S7Object Pool);
+EXPORTSPEC void S7API Bak_Destroy(S7Object &Backup);
+EXPORTSPEC int S7API Bak_Run(S7Object Backup, const char *Folder, const char *IndexName);
+EXPORTSPEC int S7API Bak_GetEntries(S7Object Backup, TS7BackupEntry *pUsrData, int &ItemsCount);
+EXPORTSPEC int S7API Bak_GetStats(S7Object Backup, TS7BackupStats *pStats);
 //==============================================================================
 //  SERVER EXPORT LIST
 //==============================================================================
@@ -165,6 +240,7 @@ EXPORTSPEC int S7API Srv_SetRWAreaCallback(S7Object Server, pfn_RWAreaCallBack p
 // Misc
 EXPORTSPEC int S7API Srv_GetStatus(S7Object Server, int &ServerStatus, int &CpuStatus, int &ClientsCount);
 EXPORTSPEC int S7API Srv_SetCpuStatus(S7Object Server, int CpuStatus);
+EXPORTSPEC int S7API Srv_GetMemory(S7Object Server, TS7MemoryInfo *pInfo);
 EXPORTSPEC int S7API Srv_ErrorText(int Error, char *Text, int TextLen);
 //==============================================================================
 //  PARTNER EXPORT LIST
@@ -25,6 +25,18 @@
 |=============================================================================*/
 
 #include "snap_msgsock.h"
+#ifdef SNAP_IO_URING
+#include "snap_threads.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#endif
 
 //---------------------------------------------------------------------------
 
@@ -79,6 +91,470 @@ longword Msg_GetSockAddr(socket_t FSocket)
         return 0;
 }
 //---------------------------------------------------------------------------
+TMsgNotifier::TMsgNotifier()
+{
+    FRead=INVALID_SOCKET;
+    FWrite=INVALID_SOCKET;
+#if defined(__linux__)
+    FRead=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (FRead<0)
+        FRead=INVALID_SOCKET;
+    FWrite=FRead;
+#elif defined(OS_WINDOWS)
+    sockaddr_in Sin;
+    int Len = sizeof(Sin);
+    u_long NonBlocking = 1;
+    memset(&Sin, 0, sizeof(Sin));
+    Sin.sin_family = AF_INET;
+    Sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+    FRead=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    FWrite=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if ((FRead==INVALID_SOCKET) || (FWrite==INVALID_SOCKET) ||
+        (bind(FRead, (struct sockaddr*)&Sin, sizeof(Sin))!=0) ||
+        (getsockname(FRead, (struct sockaddr*)&Sin, &Len)!=0) ||
+        (connect(FWrite, (struct sockaddr*)&Sin, sizeof(Sin))!=0) ||
+        (ioctlsocket(FRead, FIONBIO, &NonBlocking)!=0))
+    {
+        if (FRead!=INVALID_SOCKET)
+            closesocket(FRead);
+        if (FWrite!=INVALID_SOCKET)
+            closesocket(FWrite);
+        FRead=INVALID_SOCKET;
+        FWrite=INVALID_SOCKET;
+    }
+#else
+    int fd[2];
+    if (pipe(fd)==0)
+    {
+        fcntl(fd[0], F_SETFL, fcntl(fd[0], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd[1], F_SETFL, fcntl(fd[1], F_GETFL, 0) | O_NONBLOCK);
+        FRead=fd[0];
+        FWrite=fd[1];
+    }
+#endif
+}
+//---------------------------------------------------------------------------
+TMsgNotifier::~TMsgNotifier()
+{
+    if (FRead!=INVALID_SOCKET)
+        Msg_CloseSocket(FRead);
+    if ((FWrite!=INVALID_SOCKET) && (FWrite!=FRead))
+        Msg_CloseSocket(FWrite);
+}
+//---------------------------------------------------------------------------
+bool TMsgNotifier::Valid()
+{
+    return FRead!=INVALID_SOCKET;
+}
+//---------------------------------------------------------------------------
+int TMsgNotifier::Handle()
+{
+    return Valid() ? int(FRead) : -1;
+}
+//---------------------------------------------------------------------------
+void TMsgNotifier::Signal()
+{
+    if (!Valid())
+        return;
+#if defined(__linux__)
+    uint64_t Value = 1;
+    if (write(FWrite, &Value, sizeof(Value))<0) {} // counter saturated : already readable
+#elif defined(OS_WINDOWS)
+    char Value = 1;
+    send(FWrite, &Value, 1, 0);
+#else
+    char Value = 1;
+    if (write(FWrite, &Value, 1)<0) {} // pipe full : already readable
+#endif
+}
+//---------------------------------------------------------------------------
+void TMsgNotifier::Clear()
+{
+    if (!Valid())
+        return;
+#if defined(__linux__)
+    uint64_t Value;
+    if (read(FRead, &Value, sizeof(Value))<0) {} // EAGAIN : nothing to clear
+#elif defined(OS_WINDOWS)
+    char Trash[64];
+    while (recv(FRead, Trash, sizeof(Trash), 0)>0);
+#else
+    char Trash[64];
+    while (read(FRead, Trash, sizeof(Trash))>0);
+#endif
+}
+//==============================================================================
+// IO_URING
+//==============================================================================
+#ifdef SNAP_IO_URING
+//
+// A single ring is shared by all the sockets of the process : every thread
+// queues its SQEs and the first io_uring_enter() submits all of them, so when
+// many PLCs are polled at high rate several requests share the same syscall.
+// A reaper thread harvests the completions and wakes up their owners.
+// Receive and send are linked to a timeout (RecvTimeout/SendTimeout), the
+// S7 protocol is stop-and-wait so each socket has at most one request queued.
+//
+const unsigned UringEntries   = 256;
+const unsigned UringCQEntries = 4096;
+const __u64 UringTagNone      = 0; // linked timeouts (not notified)
+const __u64 UringTagStop      = 1; // reaper shutdown
+
+class TUringRequest
+{
+public:
+    PSnapEvent Done;
+    int Result;
+    struct __kernel_timespec Timeout;
+    TUringRequest()
+    {
+        Done = new TSnapEvent(false);
+        Result = 0;
+    };
+    ~TUringRequest()
+    {
+        delete Done;
+    };
+};
+//---------------------------------------------------------------------------
+class TSnapUring
+{
+private:
+    int FRing;
+    bool FTried;
+    bool FAvail;
+    PSnapCriticalSection cs;
+    PSnapThread Reaper;
+    // Submission queue
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned FTail;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    // Completion queue
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    bool Setup();
+    void Teardown();
+    bool Probe();
+    int Enter(unsigned ToSubmit, unsigned MinComplete, unsigned Flags);
+    struct io_uring_sqe *GetSqe();
+    void Reserve(unsigned Count);
+    void Flush();
+public:
+    TSnapUring();
+    ~TSnapUring();
+    // Creates the ring the first time (and only the first time) it's called
+    bool Available();
+    // Queues the operation (with its timeout if Timeout>0) and waits for it
+    int Perform(TUringRequest *Req, int Op, socket_t fd, void *Data, int Size, int Flags, int Timeout);
+    // Reaper thread body
+    // Asks the kernel to cancel the request in progress (if any)
+    void Cancel(TUringRequest *Req);
+    void Reap();
+};
+//---------------------------------------------------------------------------
+class TUringReaper : public TSnapThread
+{
+private:
+    TSnapUring *FRing;
+public:
+    TUringReaper(TSnapUring *Ring)
+    {
+        FRing = Ring;
+    };
+    void Execute()
+    {
+        while (!Terminated)
+            FRing->Reap();
+    };
+};
+//---------------------------------------------------------------------------
+TSnapUring::TSnapUring()
+{
+    FRing = -1;
+    FTried = false;
+    FAvail = false;
+    Reaper = NULL;
+    sq_ptr = cq_ptr = NULL;
+    sqes = NULL;
+    cs = new TSnapCriticalSection();
+}
+//---------------------------------------------------------------------------
+TSnapUring::~TSnapUring()
+{
+    Teardown();
+    delete cs;
+}
+//---------------------------------------------------------------------------
+int TSnapUring::Enter(unsigned ToSubmit, unsigned MinComplete, unsigned Flags)
+{
+    return int(syscall(__NR_io_uring_enter, FRing, ToSubmit, MinComplete, Flags, NULL, 0));
+}
+//---------------------------------------------------------------------------
+bool TSnapUring::Probe()
+{
+    // We need Send, Recv (5.6) and LinkTimeout (5.5)
+    size_t Size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *Ops = (struct io_uring_probe *)calloc(1, Size);
+    bool Result = false;
+    if (Ops!=NULL)
+    {
+        if (syscall(__NR_io_uring_register, FRing, IORING_REGISTER_PROBE, Ops, 256) == 0)
+        {
+            Result = (Ops->last_op >= IORING_OP_RECV) &&
+                     (Ops->ops[IORING_OP_SEND].flags & IO_URING_OP_SUPPORTED) &&
+                     (Ops->ops[IORING_OP_RECV].flags & IO_URING_OP_SUPPORTED) &&
+                     (Ops->ops[IORING_OP_LINK_TIMEOUT].flags & IO_URING_OP_SUPPORTED) &&
+                     (Ops->ops[IORING_OP_ASYNC_CANCEL].flags & IO_URING_OP_SUPPORTED);
+        }
+        free(Ops);
+    }
+    return Result;
+}
+//---------------------------------------------------------------------------
+bool TSnapUring::Setup()
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = UringCQEntries;
+    FRing = int(syscall(__NR_io_uring_setup, UringEntries, &p));
+    if (FRing < 0)
+        return false; // ENOSYS, EPERM (seccomp, sysctl) ...
+
+    if (!(p.features & IORING_FEAT_NODROP) || !(p.features & IORING_FEAT_SUBMIT_STABLE) || !Probe())
+    {
+        close(FRing);
+        FRing = -1;
+        return false;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cq_size > sq_size)
+            sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    sq_ptr = mmap(0, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, FRing, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        sq_ptr = NULL;
+    if (sq_ptr != NULL)
+    {
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ptr = sq_ptr;
+        else
+        {
+            cq_ptr = mmap(0, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, FRing, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED)
+                cq_ptr = NULL;
+        }
+    }
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (cq_ptr != NULL)
+    {
+        sqes = (struct io_uring_sqe *)mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, FRing, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            sqes = NULL;
+    }
+    if (sqes == NULL)
+    {
+        Teardown();
+        return false;
+    }
+
+    sq_head    = (unsigned *)(pbyte(sq_ptr) + p.sq_off.head);
+    sq_tail    = (unsigned *)(pbyte(sq_ptr) + p.sq_off.tail);
+    sq_mask    = (unsigned *)(pbyte(sq_ptr) + p.sq_off.ring_mask);
+    sq_array   = (unsigned *)(pbyte(sq_ptr) + p.sq_off.array);
+    sq_entries = p.sq_entries;
+    FTail      = *sq_tail;
+
+    cq_head    = (unsigned *)(pbyte(cq_ptr) + p.cq_off.head);
+    cq_tail    = (unsigned *)(pbyte(cq_ptr) + p.cq_off.tail);
+    cq_mask    = (unsigned *)(pbyte(cq_ptr) + p.cq_off.ring_mask);
+    cqes       = (struct io_uring_cqe *)(pbyte(cq_ptr) + p.cq_off.cqes);
+
+    Reaper = new TUringReaper(this);
+    Reaper->Start();
+    return true;
+}
+//---------------------------------------------------------------------------
+void TSnapUring::Teardown()
+{
+    struct io_uring_sqe *sqe;
+    if (Reaper != NULL)
+    {
+        // Wakes up the reaper with a NOP
+        Reaper->Terminate();
+        cs->Enter();
+        Reserve(1);
+        sqe = GetSqe();
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = UringTagStop;
+        __atomic_store_n(sq_tail, FTail, __ATOMIC_RELEASE);
+        cs->Leave();
+        Flush();
+        if (Reaper->WaitFor(3000) != WAIT_TIMEOUT)
+            delete Reaper;
+        Reaper = NULL;
+    }
+    if (sqes != NULL)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != NULL && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != NULL)
+        munmap(sq_ptr, sq_size);
+    sqes = NULL;
+    sq_ptr = cq_ptr = NULL;
+    if (FRing >= 0)
+        close(FRing);
+    FRing = -1;
+    FAvail = false;
+}
+//---------------------------------------------------------------------------
+bool TSnapUring::Available()
+{
+    if (!FTried)
+    {
+        cs->Enter();
+        if (!FTried)
+        {
+            FAvail = Setup();
+            FTried = true;
+        }
+        cs->Leave();
+    }
+    return FAvail;
+}
+//---------------------------------------------------------------------------
+void TSnapUring::Reserve(unsigned Count)
+{
+    // Called inside cs : makes room for Count linked SQEs
+    while (FTail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) + Count > sq_entries)
+    {
+        __atomic_store_n(sq_tail, FTail, __ATOMIC_RELEASE);
+        if (Enter(FTail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE), 0, 0) < 0)
+            SysSleep(1); // EAGAIN/EBUSY : CQ is being drained
+    }
+}
+//---------------------------------------------------------------------------
+struct io_uring_sqe *TSnapUring::GetSqe()
+{
+    // Called inside cs
+    unsigned Index = FTail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[Index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sq_array[Index] = Index;
+    FTail++;
+    return sqe;
+}
+//---------------------------------------------------------------------------
+void TSnapUring::Flush()
+{
+    // If another thread already submitted our SQEs there is nothing to do
+    unsigned Pending;
+    int Retry = 0;
+    do
+    {
+        Pending = __atomic_load_n(sq_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (Pending == 0 || Enter(Pending, 0, 0) >= 0)
+            return;
+        if (errno != EINTR)
+            SysSleep(1);
+    } while (++Retry < 100);
+}
+//---------------------------------------------------------------------------
+int TSnapUring::Perform(TUringRequest *Req, int Op, socket_t fd, void *Data, int Size, int Flags, int Timeout)
+{
+    struct io_uring_sqe *sqe;
+
+    cs->Enter();
+    Reserve(Timeout > 0 ? 2 : 1);
+    sqe = GetSqe();
+    sqe->opcode = byte(Op);
+    sqe->fd = fd;
+    sqe->addr = __u64(uintptr_t(Data));
+    sqe->len = Size;
+    sqe->msg_flags = Flags;
+    sqe->user_data = __u64(uintptr_t(Req));
+    if (Timeout > 0)
+    {
+        Req->Timeout.tv_sec = Timeout / 1000;
+        Req->Timeout.tv_nsec = (Timeout % 1000) * 1000000;
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = GetSqe();
+        sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = __u64(uintptr_t(&Req->Timeout));
+        sqe->len = 1;
+        sqe->user_data = UringTagNone;
+    }
+    __atomic_store_n(sq_tail, FTail, __ATOMIC_RELEASE);
+    cs->Leave();
+
+    Flush();
+    Req->Done->WaitForever();
+    return Req->Result;
+}
+//---------------------------------------------------------------------------
+void TSnapUring::Cancel(TUringRequest *Req)
+{
+    struct io_uring_sqe *sqe;
+
+    cs->Enter();
+    Reserve(1);
+    sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = __u64(uintptr_t(Req));
+    sqe->user_data = UringTagNone; // -ENOENT if nothing was in progress
+    __atomic_store_n(sq_tail, FTail, __ATOMIC_RELEASE);
+    cs->Leave();
+    Flush();
+}
+//---------------------------------------------------------------------------
+void TSnapUring::Reap()
+{
+    unsigned Head, Tail;
+    struct io_uring_cqe *cqe;
+    TUringRequest *Req;
+
+    if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        SysSleep(1);
+
+    Head = *cq_head;
+    Tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (Head != Tail)
+    {
+        cqe = &cqes[Head & *cq_mask];
+        if (cqe->user_data > UringTagStop)
+        {
+            Req = (TUringRequest *)uintptr_t(cqe->user_data);
+            Req->Result = cqe->res;
+            Req->Done->Set();
+        }
+        Head++;
+    }
+    __atomic_store_n(cq_head, Head, __ATOMIC_RELEASE);
+}
+//---------------------------------------------------------------------------
+static TSnapUring SharedRing;
+
+#endif // SNAP_IO_URING
+//---------------------------------------------------------------------------
 TMsgSocket::TMsgSocket()
 {
     Pinger = new TPinger();
@@ -95,12 +571,25 @@ TMsgSocket::TMsgSocket()
     FSocket=INVALID_SOCKET;
     LastTcpError=0;
     LocalBind=0;
+    Deadline=0;
+    SocketBackend=sbClassic;
+    RecvStamps=false;
+    RecvStamp=0;
+    RecvStampKernel=false;
+    StampArmed=false;
+#ifdef SNAP_IO_URING
+    FUring=NULL;
+#endif
 }
 //---------------------------------------------------------------------------
 TMsgSocket::~TMsgSocket()
 {
     DestroySocket();
     delete Pinger;
+#ifdef SNAP_IO_URING
+    if (FUring!=NULL)
+        delete FUring;
+#endif
 }
 //---------------------------------------------------------------------------
 void TMsgSocket::SetSin(sockaddr_in &sin, char *Address, u_short Port)
@@ -251,8 +740,8 @@ int TMsgSocket::WaitForData(int Size, int Timeout)
         Elapsed =SysGetTick();
         while((WaitingData()<Size) && (LastTcpError==0))
         {
-            // Checks timeout
-            if (DeltaTime(Elapsed)>=(longword)(Timeout))
+            // Checks timeout (Deadline can be moved back by AbortIO)
+            if ((DeltaTime(Elapsed)>=(longword)(Timeout)) || DeadlineExpired())
                 LastTcpError =WSAETIMEDOUT;
             else
                 SysSleep(1);
@@ -264,6 +753,49 @@ int TMsgSocket::WaitForData(int Size, int Timeout)
     return LastTcpError;
 }
 //---------------------------------------------------------------------------
+bool TMsgSocket::DeadlineExpired()
+{
+    longword Limit = Deadline;
+    return (Limit!=0) && (int(Limit-SysGetTick())<=0);
+}
+//---------------------------------------------------------------------------
+int TMsgSocket::RecvTimeoutLeft()
+{
+    longword Limit = Deadline;
+    int Left;
+    if (Limit==0)
+        return RecvTimeout;
+    Left=int(Limit-SysGetTick());
+    if (Left<1)
+        Left=1; // expired : just check what is already there
+    return Left<RecvTimeout ? Left : RecvTimeout;
+}
+//---------------------------------------------------------------------------
+// 0 means no timeout (SendTimeout=0 and no Deadline)
+int TMsgSocket::SendTimeoutLeft()
+{
+    longword Limit = Deadline;
+    int Left;
+    if (Limit==0)
+        return SendTimeout>0 ? SendTimeout : 0;
+    Left=int(Limit-SysGetTick());
+    if (Left<1)
+        Left=1; // expired (or canceled) : don't wait for room
+    if (SendTimeout<=0)
+        return Left;
+    return Left<SendTimeout ? Left : SendTimeout;
+}
+//---------------------------------------------------------------------------
+void TMsgSocket::AbortIO()
+{
+    // The classic path polls the Deadline, io_uring needs to be woken up
+#ifdef SNAP_IO_URING
+    TUringRequest *Req = FUring;
+    if ((Req!=NULL) && (SocketBackend==sbIoUring))
+        SharedRing.Cancel(Req);
+#endif
+}
+//---------------------------------------------------------------------------
 void TMsgSocket::SetSocketOptions()
 {
     int NoDelay = 1;
@@ -273,6 +805,14 @@ void TMsgSocket::SetSocketOptions()
 
 	if (LastTcpError==0)
         SockCheck(setsockopt(FSocket, SOL_SOCKET, SO_KEEPALIVE,(char*)&KeepAlive, sizeof(KeepAlive)));
+#ifdef SO_TIMESTAMPNS
+    // Not fatal : without it RecvStamped() falls back to the library clock
+    if ((LastTcpError==0) && RecvStamps)
+    {
+        int Stamps = 1;
+        setsockopt(FSocket, SOL_SOCKET, SO_TIMESTAMPNS,(char*)&Stamps, sizeof(Stamps));
+    }
+#endif
 }
 //---------------------------------------------------------------------------
 int TMsgSocket::SockCheck(int SockResult)
@@ -528,12 +1068,17 @@ socket_t TMsgSocket::SckAccept()
 //---------------------------------------------------------------------------
 int TMsgSocket::SendPacket(void *Data, int Size)
 {
-    int Result;
-    
+    int Result, Timeout;
+
+#ifdef SNAP_IO_URING
+    if (UringReady())
+        return UringSend(Data, Size);
+#endif
     LastTcpError=0;
-    if (SendTimeout>0)
+    Timeout=SendTimeoutLeft();
+    if (Timeout>0)
     {
-        if (!CanWrite(SendTimeout))
+        if (!CanWrite(Timeout))
         {
             LastTcpError = WSAETIMEDOUT;
             return LastTcpError;
@@ -580,10 +1125,17 @@ int TMsgSocket::Receive(void *Data, int BufSize, int &SizeRecvd)
 int TMsgSocket::RecvPacket(void *Data, int Size)
 {
     int BytesRead;
-    WaitForData(Size, RecvTimeout);
+#ifdef SNAP_IO_URING
+    if (UringReady())
+        return UringRecv(Data, Size, false);
+#endif
+    WaitForData(Size, RecvTimeoutLeft());
     if (LastTcpError==0)
     {
-        BytesRead=recv(FSocket, (char*)Data, Size, MSG_NOSIGNAL);
+        if (StampArmed)
+            BytesRead=RecvStamped(Data, Size);
+        else
+            BytesRead=recv(FSocket, (char*)Data, Size, MSG_NOSIGNAL);
         if (BytesRead==0)
             LastTcpError = WSAECONNRESET;  // Connection reset by Peer
         else
@@ -600,10 +1152,62 @@ int TMsgSocket::RecvPacket(void *Data, int Size)
     return LastTcpError;
 }
 //---------------------------------------------------------------------------
+void TMsgSocket::ArmRecvStamp()
+{
+    RecvStamp=0;
+    RecvStampKernel=false;
+    StampArmed=true;
+}
+//---------------------------------------------------------------------------
+// Same syscall count as recv() : the kernel stamp travels as ancillary data
+int TMsgSocket::RecvStamped(void *Data, int Size)
+{
+    int BytesRead;
+#ifdef SO_TIMESTAMPNS
+    struct msghdr Msg;
+    struct iovec Iov;
+    struct cmsghdr *Cmsg;
+    struct timespec Stamp;
+    char Control[CMSG_SPACE(sizeof(struct timespec))+64];
+
+    Iov.iov_base=Data;
+    Iov.iov_len=Size;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov=&Iov;
+    Msg.msg_iovlen=1;
+    Msg.msg_control=Control;
+    Msg.msg_controllen=sizeof(Control);
+    BytesRead=recvmsg(FSocket, &Msg, MSG_NOSIGNAL);
+    if (BytesRead>0)
+    {
+        for (Cmsg=CMSG_FIRSTHDR(&Msg); Cmsg!=NULL; Cmsg=CMSG_NXTHDR(&Msg, Cmsg))
+            if ((Cmsg->cmsg_level==SOL_SOCKET) && (Cmsg->cmsg_type==SCM_TIMESTAMPNS))
+            {
+                memcpy(&Stamp, CMSG_DATA(Cmsg), sizeof(Stamp));
+                RecvStamp=uint64_t(Stamp.tv_sec) * 1000000000ULL + uint64_t(Stamp.tv_nsec);
+                RecvStampKernel=true;
+                StampArmed=false;
+            }
+    }
+#else
+    BytesRead=recv(FSocket, (char*)Data, Size, MSG_NOSIGNAL);
+#endif
+    if ((BytesRead>0) && StampArmed)
+    {
+        RecvStamp=SysGetRealTime();
+        StampArmed=false;
+    }
+    return BytesRead;
+}
+//---------------------------------------------------------------------------
 int TMsgSocket::PeekPacket(void *Data, int Size)
 {
     int BytesRead;
-    WaitForData(Size, RecvTimeout);
+#ifdef SNAP_IO_URING
+    if (UringReady())
+        return UringRecv(Data, Size, true);
+#endif
+    WaitForData(Size, RecvTimeoutLeft());
     if (LastTcpError==0)
     {
         BytesRead=recv(FSocket, (char*)Data, Size, MSG_PEEK | MSG_NOSIGNAL );
@@ -623,6 +1227,134 @@ int TMsgSocket::PeekPacket(void *Data, int Size)
     return LastTcpError;
 }
 //---------------------------------------------------------------------------
+int TMsgSocket::IoBackend()
+{
+#ifdef SNAP_IO_URING
+    if ((SocketBackend==sbIoUring) && SharedRing.Available())
+        return sbIoUring;
+#endif
+    return sbClassic;
+}
+//---------------------------------------------------------------------------
+#ifdef SNAP_IO_URING
+bool TMsgSocket::UringReady()
+{
+    if ((SocketBackend!=sbIoUring) || (FSocket==INVALID_SOCKET) || !SharedRing.Available())
+        return false;
+    if (FUring==NULL)
+        FUring = new TUringRequest();
+    return true;
+}
+//---------------------------------------------------------------------------
+int TMsgSocket::UringSend(void *Data, int Size)
+{
+    int Result, Left, Timeout;
+    int Done = 0;
+    longword Start = SysGetTick();
+
+    LastTcpError=0;
+    Timeout=SendTimeoutLeft();
+    // A short send is resumed from where it stopped, within the time left
+    do
+    {
+        Left=0; // no timeout
+        if (Timeout>0)
+        {
+            Left=Timeout-int(DeltaTime(Start));
+            if (Left<1)
+                Left=1;
+        }
+        Result=SharedRing.Perform(FUring, IORING_OP_SEND, FSocket, pbyte(Data)+Done, Size-Done, MSG_NOSIGNAL, Left);
+        if (Result<=0)
+            break;
+        Done+=Result;
+    }
+    while ((Done<Size) && ((Timeout<=0) || (int(DeltaTime(Start))<Timeout)) && !DeadlineExpired());
+
+    if (Done==Size)
+        return 0;
+    if ((Result<0) && (Result!=-ECANCELED))
+        LastTcpError = -Result;
+    else
+        LastTcpError = WSAETIMEDOUT;
+    return SOCKET_ERROR;
+}
+//---------------------------------------------------------------------------
+int TMsgSocket::UringRecv(void *Data, int Size, bool Peek)
+{
+    int Result, Left, Timeout;
+    int Done = 0;
+    longword Start;
+    int Flags = MSG_WAITALL | MSG_NOSIGNAL;
+    if (Peek)
+        Flags |= MSG_PEEK;
+    LastTcpError=0;
+    Timeout=RecvTimeoutLeft();
+    Start=SysGetTick();
+    // A single recv replaces select() + the FIONREAD polling loop + recv().
+    // A short one (signal, partial segment) is resumed within the time left,
+    // a peek is simply repeated from the start.
+    do
+    {
+        Left=Timeout-int(DeltaTime(Start));
+        if (Left<1)
+            Left=1;
+        if (Peek)
+        {
+            Result=SharedRing.Perform(FUring, IORING_OP_RECV, FSocket, Data, Size, Flags, Left);
+            if (Result<=0)
+                break;
+            Done=Result;
+            if (Done<Size)
+                SysSleep(1);
+        }
+        else
+        {
+            Result=SharedRing.Perform(FUring, IORING_OP_RECV, FSocket, pbyte(Data)+Done, Size-Done, Flags, Left);
+            if (Result<=0)
+                break;
+            Done+=Result;
+        }
+    }
+    while ((Done<Size) && (int(DeltaTime(Start))<Timeout) && !DeadlineExpired());
+
+    if (Done==Size)
+    {
+        if (StampArmed && !Peek)
+        {
+            // No ancillary data through the ring
+            RecvStamp=SysGetRealTime();
+            StampArmed=false;
+        }
+    }
+    else
+        if (Result==0)
+            LastTcpError = WSAECONNRESET;  // Connection reset by Peer
+        else
+            if ((Result<0) && (Result!=-ECANCELED))
+                LastTcpError = -Result;
+            else
+            {
+                LastTcpError = WSAETIMEDOUT;
+                if ((Done>0) && !Peek)
+                {
+                    // Timed out in the middle of a packet : the stream framing is lost
+                    ForceClose();
+                    Connected = false;
+                    LastTcpError = WSAETIMEDOUT;
+                    return LastTcpError;
+                }
+            }
+
+    if (LastTcpError==WSAETIMEDOUT)
+        Purge();
+    if (LastTcpError==WSAECONNRESET)
+        Connected =false;
+
+    return LastTcpError;
+}
+#endif
+//---------------------------------------------------------------------------
 bool TMsgSocket::Execute()
 {
     return true;
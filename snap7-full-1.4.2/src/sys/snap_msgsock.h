@@ -44,6 +44,17 @@
     #include <fcntl.h>
 #endif
 //----------------------------------------------------------------------------
+// io_uring transport (Linux, kernel 5.6+ at runtime).
+// It's built by default but a socket uses it only if asked (SocketBackend),
+// otherwise, or if the kernel refuses it, the classic path is used.
+// Define SNAP_NO_IO_URING to leave it out.
+//----------------------------------------------------------------------------
+#if defined(__linux__) && !defined(SNAP_NO_IO_URING) && defined(__has_include)
+  #if __has_include(<linux/io_uring.h>)
+    #define SNAP_IO_URING
+  #endif
+#endif
+//----------------------------------------------------------------------------
 /*
   In Windows sizeof socket varies depending of the platform :
     win32 -> sizeof(SOCKET) = 4
@@ -70,6 +81,10 @@ typedef int socket_t;
 #define  SD_BOTH         0x02
 #define  MaxPacketSize   65536
 
+// Socket backends
+const int sbClassic  = 0; // select() + ioctl(FIONREAD) + recv()
+const int sbIoUring  = 1; // io_uring shared ring (Linux only)
+
 //----------------------------------------------------------------------------
 // For other platform we need to re-define next constants
 #if defined(PLATFORM_UNIX) || defined(OS_OSX)
@@ -232,10 +247,22 @@ public:
 		TSnapBase();
 };
 //---------------------------------------------------------------------------
+#ifdef SNAP_IO_URING
+class TUringRequest; // see snap_msgsock.cpp
+#endif
+//---------------------------------------------------------------------------
 class TMsgSocket : public TSnapBase
 {
 private:
         PPinger Pinger;
+#ifdef SNAP_IO_URING
+        TUringRequest *FUring;
+        bool UringReady();
+        int UringSend(void *Data, int Size);
+        int UringRecv(void *Data, int Size, bool Peek);
+#endif
+        bool StampArmed;
+        int RecvStamped(void *Data, int Size);
         int GetLastSocketError();
         int SockCheck(int SockResult);
         void DestroySocket();
@@ -260,6 +287,12 @@ protected:
         int WaitForData(int Size, int Timeout);
         // Clear socket input buffer
         void Purge();
+        // Recv/Send timeouts bounded by the Deadline
+        int RecvTimeoutLeft();
+        int SendTimeoutLeft();
+        bool DeadlineExpired();
+        // The next RecvPacket stores its arrival time into RecvStamp
+        void ArmRecvStamp();
 public:
         longword ClientHandle;
         longword LocalBind;
@@ -280,6 +313,17 @@ public:
         int PingTimeout;
         int RecvTimeout;
         int SendTimeout;
+        // Backend requested for Send/Recv Packet (sbClassic or sbIoUring)
+        int SocketBackend;
+        // Absolute limit (SysGetTick) for the receives, 0 = none.
+        // When it's set no receive waits beyond it regardless of RecvTimeout.
+        volatile longword Deadline;
+        // Asks the kernel to stamp the incoming packets (SO_TIMESTAMPNS), set before connecting
+        bool RecvStamps;
+        // Output : arrival of the packet armed by ArmRecvStamp (ns since the epoch, 0 = none)
+        uint64_t RecvStamp;
+        // Output : RecvStamp comes from the kernel, otherwise it was taken after the receive
+        bool RecvStampKernel;
         //int ConnTimeout;
         // Output : Last operation error
         int LastTcpError;
@@ -315,8 +359,12 @@ public:
         int Receive(void *Data, int BufSize, int & SizeRecvd);
         // Receives a packet of size specified.
         int RecvPacket(void *Data, int Size);
+        // Wakes up a receive in progress (to use along with Deadline from another thread)
+        void AbortIO();
         // Peeks a packet of size specified without extract it from the socket queue
         int PeekPacket(void *Data, int Size);
+        // Returns the backend really in use (sbIoUring falls back to sbClassic if unavailable)
+        int IoBackend();
         virtual bool Execute();
 };
 
@@ -325,6 +373,29 @@ typedef TMsgSocket *PMsgSocket;
 void Msg_CloseSocket(socket_t FSocket);
 longword Msg_GetSockAddr(socket_t FSocket);
 //---------------------------------------------------------------------------
+// Pollable notification : the handle becomes readable when Signal() is
+// called and stays readable until Clear(), so it can be watched by
+// epoll/poll/select (or libuv) loops.
+//   Linux   : eventfd
+//   Unix    : non blocking pipe
+//   Windows : loopback UDP socket pair (select/WSAPoll)
+//---------------------------------------------------------------------------
+class TMsgNotifier
+{
+private:
+    socket_t FRead;
+    socket_t FWrite;
+public:
+    TMsgNotifier();
+    ~TMsgNotifier();
+    bool Valid();
+    // Descriptor to watch for readability
+    int Handle();
+    void Signal();
+    void Clear();
+};
+typedef TMsgNotifier *PMsgNotifier;
+//---------------------------------------------------------------------------
 class SocketsLayer
 {
 private:
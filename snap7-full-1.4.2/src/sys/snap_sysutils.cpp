@@ -50,6 +50,38 @@ longword SysGetTick()
 #endif
 }
 //---------------------------------------------------------------------------
+longword SysGetMicroTick()
+{
+#ifdef OS_WINDOWS
+    LARGE_INTEGER Counter, Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    // Split to avoid the overflow of Counter * 1000000
+    return (longword) ((Counter.QuadPart / Frequency.QuadPart) * 1000000 +
+        (Counter.QuadPart % Frequency.QuadPart) * 1000000 / Frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (longword) (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
+//---------------------------------------------------------------------------
+uint64_t SysGetRealTime()
+{
+#ifdef OS_WINDOWS
+    FILETIME ft;
+    uint64_t Stamp;
+    GetSystemTimeAsFileTime(&ft);
+    Stamp=(uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    // 100 ns units since 1601-01-01
+    return (Stamp - 116444736000000000ULL) * 100;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+#endif
+}
+//---------------------------------------------------------------------------
 void SysSleep(longword Delay_ms)
 {
 #ifdef OS_WINDOWS
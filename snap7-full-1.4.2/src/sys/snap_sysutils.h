@@ -30,9 +30,16 @@
 //---------------------------------------------------------------------------
 #ifdef OS_OSX
 # define CLOCK_MONOTONIC 0
+# ifndef CLOCK_REALTIME
+#   define CLOCK_REALTIME 0
+# endif
 #endif
 
 longword SysGetTick();
+// Monotonic microseconds, wraps every ~71 minutes : use it for differences
+longword SysGetMicroTick();
+// Wall clock in nanoseconds since 1970-01-01 UTC (same base as the kernel socket stamps)
+uint64_t SysGetRealTime();
 void SysSleep(longword Delay_ms);
 longword DeltaTime(longword &Elapsed);
 
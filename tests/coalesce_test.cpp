@@ -0,0 +1,88 @@
+//*************************************************************************************
+// Write coalescing (p_i32_WriteWindow) : a merged write refused by the PLC is
+// retried alone for each of its writes, and a write waiting in a batch
+// leaves it at its job timeout.
+//*************************************************************************************
+
+#include <cstring>
+#include <thread>
+#include "s7_test.h"
+
+static byte DB[100];
+
+int main()
+{
+    S7Object Server = StartServer();
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    S7Object Client = Cli_Create();
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+
+    // Touching ranges, the second one out of the DB : merged, refused, then
+    // retried alone
+    int Window = 20;
+    Cli_SetParam(Client, p_i32_WriteWindow, &Window);
+    byte Good[10], Bad[4];
+    memset(Good, 5, sizeof(Good));
+    memset(Bad, 6, sizeof(Bad));
+    int GoodResult = -1, BadResult = -1;
+    std::thread T1([&] { GoodResult = Cli_DBWrite(Client, 1, 90, sizeof(Good), Good); });
+    SysSleep(2);
+    std::thread T2([&] { BadResult = Cli_DBWrite(Client, 1, 100, sizeof(Bad), Bad); });
+    T1.join();
+    T2.join();
+    CHECK_RESULT(GoodResult, 0);
+    CHECK(DB[95] == 5);
+    CHECK_RESULT(BadResult, errCliAddressOutOfRange);
+
+    // A follower past its deadline leaves before the batch is sent
+    Window = 300;
+    Cli_SetParam(Client, p_i32_WriteWindow, &Window);
+    byte Leader[2] = {8, 8}, Follower[2] = {9, 9};
+    int LeaderResult = -1, FollowerResult = -1;
+    longword FollowerTime = 0;
+    std::thread T3([&] { LeaderResult = Cli_DBWrite(Client, 1, 0, 2, Leader); });
+    SysSleep(5);
+    int Timeout = 50;
+    Cli_SetParam(Client, p_i32_JobTimeout, &Timeout);
+    std::thread T4([&] {
+        longword Start = SysGetTick();
+        FollowerResult = Cli_DBWrite(Client, 1, 10, 2, Follower);
+        FollowerTime = Elapsed(Start);
+    });
+    T4.join();
+    T3.join();
+    CHECK_RESULT(FollowerResult, errCliJobTimeout);
+    CHECK(FollowerTime < 250);
+    CHECK(DB[10] != 9);
+    CHECK_RESULT(LeaderResult, 0);
+    CHECK(DB[0] == 8);
+
+    // A bit and a byte write to the same byte : the last call wins
+    Timeout = 0;
+    Cli_SetParam(Client, p_i32_JobTimeout, &Timeout);
+    Window = 50;
+    Cli_SetParam(Client, p_i32_WriteWindow, &Window);
+    DB[20] = 0x00;
+    DB[30] = 0x00;
+    byte One = 1, Cleared[2] = {0x00, 0x00}, Pattern[2] = {0xF0, 0xF0};
+    int Results[4] = {-1, -1, -1, -1};
+    std::thread T5([&] { Results[0] = Cli_WriteArea(Client, S7AreaDB, 1, 20 * 8, 1, S7WLBit, &One); });
+    SysSleep(5);
+    std::thread T6([&] { Results[1] = Cli_DBWrite(Client, 1, 20, 2, Cleared); });
+    SysSleep(5);
+    std::thread T7([&] { Results[2] = Cli_DBWrite(Client, 1, 30, 2, Pattern); });
+    SysSleep(5);
+    std::thread T8([&] { Results[3] = Cli_WriteArea(Client, S7AreaDB, 1, 30 * 8, 1, S7WLBit, &One); });
+    T5.join();
+    T6.join();
+    T7.join();
+    T8.join();
+    for (int c = 0; c < 4; c++)
+        CHECK_RESULT(Results[c], 0);
+    CHECK(DB[20] == 0x00);
+    CHECK(DB[30] == 0xF1);
+
+    Cli_Destroy(Client);
+    Srv_Destroy(Server);
+    return TestDone("coalesce_test");
+}
@@ -0,0 +1,127 @@
+//*************************************************************************************
+// Whole DB transfers (DBGet, DBFill, DBGetMulti) : pipelined slices and the
+// cache of the DB lengths, also when a DB changes size.
+//*************************************************************************************
+
+#include <cstring>
+#include "s7_test.h"
+
+const int DBs = 40;
+
+static byte DB[DBs + 1][3000];
+static byte Big[20000];
+static byte Out[DBs + 1][3000];
+static byte Buffer[20000];
+
+static void FillBig()
+{
+    for (int c = 0; c < int(sizeof(Big)); c++)
+        Big[c] = byte(c * 13);
+}
+
+static void Snapshot(S7Object Client)
+{
+    TS7DBItem Items[DBs];
+    int c;
+    for (c = 0; c < DBs; c++)
+    {
+        Items[c].DBNumber = c + 1;
+        Items[c].Size = sizeof(Out[c + 1]);
+        Items[c].pdata = Out[c + 1];
+        memset(Out[c + 1], 0, sizeof(Out[c + 1]));
+    }
+    CHECK_RESULT(Cli_DBGetMulti(Client, Items, DBs), 0);
+    for (c = 0; c < DBs; c++)
+    {
+        CHECK_RESULT(Items[c].Result, 0);
+        CHECK(Items[c].Size == (c + 1) * 70);
+        CHECK(memcmp(Out[c + 1], DB[c + 1], (c + 1) * 70) == 0);
+    }
+}
+
+// A missing DB fails alone (the answer of the server to the block info of a
+// missing block doesn't match the request, so the call reports it as well)
+static void SnapshotMissing(S7Object Client)
+{
+    TS7DBItem Items[2];
+    Items[0].DBNumber = 1;
+    Items[0].Size = sizeof(Out[1]);
+    Items[0].pdata = Out[1];
+    Items[1].DBNumber = 999;
+    Items[1].Size = 10;
+    Items[1].pdata = Out[0];
+    Cli_DBGetMulti(Client, Items, 2);
+    CHECK_RESULT(Items[0].Result, 0);
+    CHECK(Items[1].Result != 0);
+    Snapshot(Client);
+}
+
+static void Transfers(S7Object Server, S7Object Client, int Depth)
+{
+    int Size, c;
+    Cli_Disconnect(Client);
+    CHECK_RESULT(Cli_SetParam(Client, p_i32_PipeDepth, &Depth), 0);
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+
+    // Twice : the lengths come from the cache the second time
+    Snapshot(Client);
+    Snapshot(Client);
+    SnapshotMissing(Client);
+    for (c = 0; c < 2; c++)
+    {
+        memset(Buffer, 0, sizeof(Buffer));
+        Size = sizeof(Buffer);
+        CHECK_RESULT(Cli_DBGet(Client, 100, Buffer, Size), 0);
+        CHECK(Size == int(sizeof(Big)));
+        CHECK(memcmp(Buffer, Big, sizeof(Big)) == 0);
+    }
+    Size = 100;
+    CHECK_RESULT(Cli_DBGet(Client, 100, Buffer, Size), errCliBufferTooSmall);
+
+    // A cached DB grown and shrunk
+    Srv_UnregisterArea(Server, srvAreaDB, 5);
+    for (c = 0; c < 700; c++)
+        DB[5][c] = byte(c ^ 0x5A);
+    Srv_RegisterArea(Server, srvAreaDB, 5, DB[5], 700);
+    Size = sizeof(Buffer);
+    CHECK_RESULT(Cli_DBGet(Client, 5, Buffer, Size), 0);
+    CHECK(Size == 700);
+    CHECK(memcmp(Buffer, DB[5], 700) == 0);
+    Srv_UnregisterArea(Server, srvAreaDB, 5);
+    for (c = 0; c < 350; c++)
+        DB[5][c] = byte(5 * 7 + c);
+    Srv_RegisterArea(Server, srvAreaDB, 5, DB[5], 350);
+    Size = sizeof(Buffer);
+    CHECK_RESULT(Cli_DBGet(Client, 5, Buffer, Size), 0);
+    CHECK(Size == 350);
+
+    CHECK_RESULT(Cli_DBFill(Client, 100, 0x30 + Depth), 0);
+    for (c = 0; c < int(sizeof(Big)); c++)
+        if (Big[c] != 0x30 + Depth)
+            break;
+    CHECK(c == int(sizeof(Big)));
+    FillBig();
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    for (int n = 1; n <= DBs; n++)
+    {
+        for (int c = 0; c < n * 70; c++)
+            DB[n][c] = byte(n * 7 + c);
+        Srv_RegisterArea(Server, srvAreaDB, n, DB[n], n * 70);
+    }
+    FillBig();
+    Srv_RegisterArea(Server, srvAreaDB, 100, Big, sizeof(Big));
+
+    S7Object Client = Cli_Create();
+    Transfers(Server, Client, 1);
+    Transfers(Server, Client, 4);
+    int Depth = 9;
+    CHECK_RESULT(Cli_SetParam(Client, p_i32_PipeDepth, &Depth), errCliInvalidParams);
+
+    Cli_Destroy(Client);
+    Srv_Destroy(Server);
+    return TestDone("dbget_test");
+}
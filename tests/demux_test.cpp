@@ -0,0 +1,66 @@
+//*************************************************************************************
+// Response demultiplexer : duplicated and late answers are dropped by sequence
+// and never delivered to another exchange, whose slot is recycled.
+//*************************************************************************************
+
+#include <cstring>
+#include "s7_test.h"
+
+static byte DB[100];
+static int Events[4];
+
+static void S7API OnDemux(void *, int Event, int, int, int)
+{
+    if ((Event >= 0) && (Event < 4))
+        Events[Event]++;
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    // Past the 3rd answer every 5th is sent twice, the 12th comes after the
+    // receive timeout of its exchange
+    TTestProxy Proxy(10105);
+    Proxy.DupEvery = 5;
+    Proxy.LateFrame = 12;
+    Proxy.LateDelay = 600;
+    CHECK(Proxy.Start());
+
+    S7Object Client = Cli_Create();
+    word Port = 10105;
+    int Timeout = 300;
+    Cli_SetParam(Client, p_u16_RemotePort, &Port);
+    Cli_SetParam(Client, p_i32_RecvTimeout, &Timeout);
+    Cli_SetDemuxCallback(Client, OnDemux, NULL);
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+
+    byte Data[sizeof(DB)];
+    int Failed = 0;
+    for (int c = 0; c < 30; c++)
+    {
+        memset(DB, c + 1, sizeof(DB));
+        int Result = Cli_DBRead(Client, 1, 0, sizeof(Data), Data);
+        if (Result != 0)
+            Failed++;
+        else
+            CHECK(Data[0] == byte(c + 1) && Data[sizeof(Data) - 1] == byte(c + 1));
+        SysSleep(30);
+    }
+    SysSleep(400);
+    // Only the exchange whose answer was held failed
+    CHECK(Failed == 1);
+
+    TS7DemuxStats Stats;
+    CHECK_RESULT(Cli_GetDemuxStats(Client, &Stats, 0), 0);
+    CHECK(Stats.Late == 1);
+    CHECK(Stats.Stray > 0);
+    CHECK(Events[deLate] == int(Stats.Late));
+    CHECK(Events[deStray] == int(Stats.Stray));
+    CHECK_RESULT(Cli_DBRead(Client, 1, 0, sizeof(Data), Data), 0);
+
+    Cli_Disconnect(Client);
+    Cli_Destroy(Client);
+    Srv_Destroy(Server);
+    return TestDone("demux_test");
+}
@@ -0,0 +1,73 @@
+//*************************************************************************************
+// Hedged reads (p_i32_HedgePercentile) : a slow read is repeated on the second
+// connection; the main connection dropped by the hedge that won doesn't count
+// as a lost link (p_i32_ReconnectMode).
+//*************************************************************************************
+
+#include <cstring>
+#include "s7_test.h"
+
+static byte DB[1024];
+
+static void HedgedReads(int ReconnectMode)
+{
+    S7Object Client = Cli_Create();
+    word Port = 10106;
+    int Percentile = 75;
+    Cli_SetParam(Client, p_u16_RemotePort, &Port);
+    CHECK_RESULT(Cli_SetParam(Client, p_i32_HedgePercentile, &Percentile), 0);
+    CHECK_RESULT(Cli_SetParam(Client, p_i32_ReconnectMode, &ReconnectMode), 0);
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+
+    byte Data[100];
+    TS7DataItem Items[2];
+    int c;
+    for (c = 0; c < 2; c++)
+    {
+        Items[c].Area = S7AreaDB;
+        Items[c].WordLen = S7WLByte;
+        Items[c].DBNumber = 1;
+        Items[c].Start = c * 50;
+        Items[c].Amount = 50;
+        Items[c].pdata = Data + c * 50;
+    }
+    int Failed = 0;
+    for (c = 0; c < 100; c++)
+    {
+        memset(Data, 0, sizeof(Data));
+        int Result = (c % 2 == 0) ? Cli_DBRead(Client, 1, 0, sizeof(Data), Data) :
+            Cli_ReadMultiVars(Client, Items, 2);
+        if ((Result != 0) || (Data[0] != 0x5A) || (Data[sizeof(Data) - 1] != 0x5A))
+            Failed++;
+    }
+    CHECK(Failed == 0);
+    TS7HedgeStats Stats;
+    CHECK_RESULT(Cli_GetHedgeStats(Client, &Stats, 0), 0);
+    CHECK(Stats.Reads == 100);
+    CHECK(Stats.Won > 0);
+    int State = -1;
+    CHECK_RESULT(Cli_GetLinkState(Client, State), 0);
+    CHECK(State == lsConnected);
+    Cli_Disconnect(Client);
+    Cli_Destroy(Client);
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    memset(DB, 0x5A, sizeof(DB));
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    // Every 10th answer stalls in the middle : the main read is canceled
+    // while receiving it, so its connection is dropped
+    TTestProxy Proxy(10106);
+    Proxy.SplitEvery = 10;
+    Proxy.SplitDelay = 300;
+    CHECK(Proxy.Start());
+
+    HedgedReads(rmNone);
+    HedgedReads(rmFailFast);
+    HedgedReads(rmQueue);
+
+    Srv_Destroy(Server);
+    return TestDone("hedge_test");
+}
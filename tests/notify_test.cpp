@@ -0,0 +1,50 @@
+//*************************************************************************************
+// Completion descriptor (Cli_GetAsCompletionFd) : readable once per async job,
+// and no longer once the job is consumed by polling its status.
+//*************************************************************************************
+
+#include <poll.h>
+#include "s7_test.h"
+
+static byte DB[64];
+
+static bool Readable(int Fd)
+{
+    pollfd Poll = {Fd, POLLIN, 0};
+    return poll(&Poll, 1, 0) > 0;
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    S7Object Client = Cli_Create();
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+    int Fd = -1;
+    CHECK_RESULT(Cli_GetAsCompletionFd(Client, Fd), 0);
+    CHECK(Fd >= 0);
+
+    byte Data[64];
+    int Stale = 0;
+    for (int c = 0; c < 500; c++)
+    {
+        int Result = -1;
+        CHECK_RESULT(Cli_AsDBRead(Client, 1, 0, sizeof(Data), Data), 0);
+        // Consumed as soon as it's seen done, the descriptor not waited
+        while (Cli_CheckAsCompletion(Client, Result) != JobComplete);
+        CHECK_RESULT(Result, 0);
+        if (Readable(Fd))
+            Stale++;
+    }
+    CHECK(Stale == 0);
+
+    CHECK_RESULT(Cli_AsDBRead(Client, 1, 0, sizeof(Data), Data), 0);
+    pollfd Poll = {Fd, POLLIN, 0};
+    CHECK(poll(&Poll, 1, 5000) == 1);
+    CHECK_RESULT(Cli_WaitAsCompletion(Client, 1000), 0);
+    CHECK(!Readable(Fd));
+
+    Cli_Destroy(Client);
+    Srv_Destroy(Server);
+    return TestDone("notify_test");
+}
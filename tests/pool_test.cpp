@@ -0,0 +1,127 @@
+//*************************************************************************************
+// TSnap7Pool : striped transfers over the sessions and disconnection while
+// sessions are leased.
+//*************************************************************************************
+
+#include <cstring>
+#include <thread>
+#include "s7_test.h"
+
+static byte DB[65000];
+static byte Buffer[65000];
+
+static void StripedTransfers(S7Object Pool)
+{
+    int c;
+    for (c = 0; c < int(sizeof(DB)); c++)
+        DB[c] = byte(c * 7);
+    CHECK_RESULT(Pool_ReadArea(Pool, S7AreaDB, 1, 0, sizeof(Buffer), S7WLByte, Buffer), 0);
+    CHECK(memcmp(Buffer, DB, sizeof(DB)) == 0);
+
+    memset(Buffer, 0, sizeof(Buffer));
+    CHECK_RESULT(Pool_ReadArea(Pool, S7AreaDB, 1, 100, 3000, S7WLWord, Buffer), 0);
+    CHECK(memcmp(Buffer, DB + 100, 6000) == 0);
+
+    for (c = 0; c < int(sizeof(Buffer)); c++)
+        Buffer[c] = byte(c * 3);
+    CHECK_RESULT(Pool_WriteArea(Pool, S7AreaDB, 1, 0, sizeof(Buffer), S7WLByte, Buffer), 0);
+    CHECK(memcmp(Buffer, DB, sizeof(DB)) == 0);
+}
+
+// Striped jobs and leased sessions from several threads at once
+static void ConcurrentJobs(S7Object Pool)
+{
+    std::thread Threads[6];
+    int Errors[6];
+    int c;
+    for (c = 0; c < 6; c++)
+    {
+        Errors[c] = 0;
+        Threads[c] = std::thread([Pool, &Errors, c] {
+            byte Data[100];
+            S7Object Session;
+            for (int n = 0; n < 30; n++)
+            {
+                if (Pool_ReadArea(Pool, S7AreaDB, 1, n, sizeof(Data), S7WLByte, Data) != 0)
+                    Errors[c]++;
+                if (Pool_AcquireSession(Pool, Session, 1000) != 0)
+                    Errors[c]++;
+                else
+                {
+                    if (Cli_DBRead(Session, 1, 0, 10, Data) != 0)
+                        Errors[c]++;
+                    Pool_ReleaseSession(Pool, Session);
+                }
+            }
+        });
+    }
+    for (c = 0; c < 6; c++)
+    {
+        Threads[c].join();
+        CHECK(Errors[c] == 0);
+    }
+}
+
+static bool AllClosed(S7Object Pool)
+{
+    TS7PoolSession Info[16];
+    int Count = 16;
+    Pool_GetSessions(Pool, Info, Count);
+    for (int c = 0; c < Count; c++)
+        if (Info[c].Connected || Info[c].Busy)
+            return false;
+    return true;
+}
+
+// A session given back within the pool wait is closed by the disconnection
+static void DisconnectWaitsLease(S7Object Pool)
+{
+    S7Object Session;
+    CHECK_RESULT(Pool_Connect(Pool), 0);
+    CHECK_RESULT(Pool_AcquireSession(Pool, Session, 1000), 0);
+    std::thread Holder([Pool, Session] {
+        SysSleep(200);
+        Pool_ReleaseSession(Pool, Session);
+    });
+    longword Start = SysGetTick();
+    CHECK_RESULT(Pool_Disconnect(Pool), 0);
+    CHECK(Elapsed(Start) >= 150);
+    Holder.join();
+    CHECK(AllClosed(Pool));
+}
+
+// A session still leased after the pool wait (10 s) doesn't hold the
+// disconnection : it's closed when given back
+static void DisconnectBounded(S7Object Pool)
+{
+    S7Object Session;
+    byte Data[10];
+    CHECK_RESULT(Pool_Connect(Pool), 0);
+    CHECK_RESULT(Pool_AcquireSession(Pool, Session, 1000), 0);
+    longword Start = SysGetTick();
+    CHECK_RESULT(Pool_Disconnect(Pool), errCliJobTimeout);
+    CHECK(Elapsed(Start) < 12000);
+    CHECK(Cli_DBRead(Session, 1, 0, 10, Data) == 0);
+    CHECK_RESULT(Pool_ReleaseSession(Pool, Session), 0);
+    CHECK(AllClosed(Pool));
+    CHECK(Pool_ReadArea(Pool, S7AreaDB, 1, 0, 10, S7WLByte, Data) != 0);
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    S7Object Pool = Pool_Create();
+    int Size = 4;
+    Pool_SetParam(Pool, p_i32_PoolSize, &Size);
+    CHECK_RESULT(Pool_ConnectTo(Pool, "127.0.0.1", 0, 2), 0);
+
+    StripedTransfers(Pool);
+    ConcurrentJobs(Pool);
+    DisconnectWaitsLease(Pool);
+    DisconnectBounded(Pool);
+
+    Pool_Destroy(Pool);
+    Srv_Destroy(Server);
+    return TestDone("pool_test");
+}
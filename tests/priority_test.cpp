@@ -0,0 +1,90 @@
+//*************************************************************************************
+// Priority lanes of the shared sessions : a normal job yields the session to
+// a high priority one; suspended, it still honors its timeout and CancelJob
+// and keeps its own state.
+//*************************************************************************************
+
+#include <cstring>
+#include <thread>
+#include "s7_test.h"
+
+static byte DB[60000];
+static byte Big[60000];
+static byte Urgent[60000];
+
+int main()
+{
+    S7Object Server = StartServer();
+    for (int c = 0; c < int(sizeof(DB)); c++)
+        DB[c] = byte(c * 13);
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    TTestProxy Proxy(10104);
+    Proxy.AnswerDelay = 10;
+    CHECK(Proxy.Start());
+
+    S7Object Bulk = Cli_Create();
+    S7Object Op = Cli_Create();
+    int One = 1;
+    int High = jpHigh;
+    word Port = 10104;
+    Cli_SetParam(Bulk, p_i32_ShareSession, &One);
+    Cli_SetParam(Bulk, p_u16_RemotePort, &Port);
+    Cli_SetParam(Bulk, p_i32_RecvStamps, &One);
+    Cli_SetParam(Op, p_i32_ShareSession, &One);
+    Cli_SetParam(Op, p_u16_RemotePort, &Port);
+    Cli_SetParam(Op, p_i32_JobPriority, &High);
+    CHECK_RESULT(Cli_ConnectTo(Bulk, "127.0.0.1", 0, 2), 0);
+    CHECK_RESULT(Cli_ConnectTo(Op, "127.0.0.1", 0, 2), 0);
+
+    // Exchanges of the bulk read alone
+    TS7JobStamps Stamps;
+    CHECK_RESULT(Cli_DBRead(Bulk, 1, 0, sizeof(Big), Big), 0);
+    CHECK_RESULT(Cli_GetJobStamps(Bulk, &Stamps), 0);
+    int AlonePDUs = Stamps.PDUs;
+    CHECK(AlonePDUs > 1);
+
+    // The suspended job expires while the urgent one runs
+    int BulkResult = -1;
+    int Timeout = 150;
+    Cli_SetParam(Bulk, p_i32_JobTimeout, &Timeout);
+    std::thread T1([&] { BulkResult = Cli_DBRead(Bulk, 1, 0, sizeof(Big), Big); });
+    SysSleep(30);
+    CHECK_RESULT(Cli_DBRead(Op, 1, 0, sizeof(Urgent), Urgent), 0);
+    CHECK(memcmp(Urgent, DB, sizeof(DB)) == 0);
+    T1.join();
+    CHECK_RESULT(BulkResult, errCliJobTimeout);
+
+    // The suspended job is canceled at once
+    int OpResult = -1;
+    Timeout = 0;
+    Cli_SetParam(Bulk, p_i32_JobTimeout, &Timeout);
+    CHECK_RESULT(Cli_AsDBRead(Bulk, 1, 0, sizeof(Big), Big), 0);
+    SysSleep(30);
+    std::thread T2([&] { OpResult = Cli_DBRead(Op, 1, 0, sizeof(Urgent), Urgent); });
+    SysSleep(30);
+    longword Start = SysGetTick();
+    CHECK_RESULT(Cli_CancelJob(Bulk), 0);
+    CHECK_RESULT(Cli_WaitAsCompletion(Bulk, 5000), errCliJobCanceled);
+    CHECK(Elapsed(Start) < 300);
+    T2.join();
+    CHECK_RESULT(OpResult, 0);
+
+    // A preempted job completes with its data and its own stamps
+    byte Data[2];
+    BulkResult = -1;
+    memset(Big, 0, sizeof(Big));
+    std::thread T3([&] { BulkResult = Cli_DBRead(Bulk, 1, 0, sizeof(Big), Big); });
+    SysSleep(30);
+    CHECK_RESULT(Cli_DBRead(Op, 1, 100, 2, Data), 0);
+    T3.join();
+    CHECK_RESULT(BulkResult, 0);
+    CHECK(memcmp(Big, DB, sizeof(DB)) == 0);
+    CHECK_RESULT(Cli_GetJobStamps(Bulk, &Stamps), 0);
+    CHECK(Stamps.PDUs >= AlonePDUs);
+    CHECK(Stamps.Sent != 0);
+
+    Cli_Destroy(Op);
+    Cli_Destroy(Bulk);
+    Srv_Destroy(Server);
+    return TestDone("priority_test");
+}
@@ -0,0 +1,235 @@
+//*************************************************************************************
+// Helpers of the behaviour tests : checks, timing, the server and a relay to it.
+//
+// Each test is a small program which starts a TSnap7Server on 127.0.0.1, drives
+// it through the exported client objects and returns non zero if a check fails.
+//*************************************************************************************
+
+#ifndef S7_TEST_H
+#define S7_TEST_H
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "snap7_libmain.h"
+
+static int TestFailures = 0;
+
+#define CHECK(Cond) \
+    do { if (!(Cond)) { TestFailures++; \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #Cond); } } while (0)
+
+#define CHECK_RESULT(Expr, Expected) \
+    do { int Res_ = (Expr); if (Res_ != (Expected)) { TestFailures++; \
+        printf("%s:%d: %s returned 0x%08X, expected 0x%08X\n", __FILE__, __LINE__, #Expr, \
+            unsigned(Res_), unsigned(Expected)); } } while (0)
+
+// Milliseconds since Start (SysGetTick)
+static inline longword Elapsed(longword Start)
+{
+    return SysGetTick() - Start;
+}
+
+// Starts the server the clients connect to (127.0.0.1:102)
+static inline S7Object StartServer()
+{
+    S7Object Server = Srv_Create();
+    int Result = Srv_StartTo(Server, "127.0.0.1");
+    if (Result != 0)
+        printf("Server start failed : 0x%08X\n", unsigned(Result));
+    return Server;
+}
+
+//-------------------------------------------------------------------------------------
+// TCP relay between the clients (127.0.0.1:Port) and the server which alters
+// the answers as a slow or unreliable link would.
+//-------------------------------------------------------------------------------------
+class TTestProxy
+{
+private:
+    int Port;
+    int Listener;
+    std::mutex Lock;
+    std::vector<int> Sockets;
+    std::vector<std::thread> Threads;
+    std::thread Acceptor;
+
+    static bool ReadAll(int Sock, byte *Data, int Size)
+    {
+        while (Size > 0)
+        {
+            ssize_t Read = recv(Sock, Data, Size, 0);
+            if (Read <= 0)
+                return false;
+            Data += Read;
+            Size -= int(Read);
+        }
+        return true;
+    }
+
+    static void Close(int Client, int Server)
+    {
+        shutdown(Client, SHUT_RDWR);
+        shutdown(Server, SHUT_RDWR);
+    }
+
+    void Upstream(int Client, int Server)
+    {
+        byte Data[4096];
+        ssize_t Read;
+        while ((Read = recv(Client, Data, sizeof(Data), 0)) > 0)
+            if (send(Server, Data, Read, MSG_NOSIGNAL) != Read)
+                break;
+        Close(Client, Server);
+    }
+
+    // Answers are relayed a TPKT frame at time
+    void Downstream(int Client, int Server)
+    {
+        std::shared_ptr<std::mutex> SendLock = std::make_shared<std::mutex>();
+        std::vector<byte> Frame;
+        int Count = 0;
+        byte Header[4];
+        while (ReadAll(Server, Header, 4))
+        {
+            int Size = (Header[2] << 8) | Header[3];
+            if (Size < 4)
+                break;
+            Frame.assign(Header, Header + 4);
+            Frame.resize(Size);
+            if (!ReadAll(Server, &Frame[4], Size - 4))
+                break;
+            Count++;
+            if (AnswerDelay > 0)
+                SysSleep(AnswerDelay);
+            if ((LateDelay > 0) && (Count == LateFrame))
+            {
+                std::lock_guard<std::mutex> Guard(Lock);
+                Threads.push_back(std::thread([Client, Frame, SendLock, this] {
+                    SysSleep(LateDelay);
+                    std::lock_guard<std::mutex> Guard(*SendLock);
+                    send(Client, &Frame[0], Frame.size(), MSG_NOSIGNAL);
+                }));
+                continue;
+            }
+            std::lock_guard<std::mutex> Guard(*SendLock);
+            if ((SplitDelay > 0) && (Count > 3) && (Count % SplitEvery == 0))
+            {
+                send(Client, &Frame[0], Frame.size() / 2, MSG_NOSIGNAL);
+                SysSleep(SplitDelay);
+                send(Client, &Frame[Frame.size() / 2], Frame.size() - Frame.size() / 2, MSG_NOSIGNAL);
+            }
+            else
+                send(Client, &Frame[0], Frame.size(), MSG_NOSIGNAL);
+            if ((DupEvery > 0) && (Count > 3) && (Count % DupEvery == 0))
+                send(Client, &Frame[0], Frame.size(), MSG_NOSIGNAL);
+        }
+        Close(Client, Server);
+    }
+
+    void Listen()
+    {
+        int Client;
+        while ((Client = accept(Listener, NULL, NULL)) >= 0)
+        {
+            int Server = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in Addr;
+            memset(&Addr, 0, sizeof(Addr));
+            Addr.sin_family = AF_INET;
+            Addr.sin_port = htons(102);
+            Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(Server, (sockaddr *)&Addr, sizeof(Addr)) != 0)
+            {
+                close(Server);
+                close(Client);
+                continue;
+            }
+            int One = 1;
+            setsockopt(Server, IPPROTO_TCP, TCP_NODELAY, &One, sizeof(One));
+            setsockopt(Client, IPPROTO_TCP, TCP_NODELAY, &One, sizeof(One));
+            std::lock_guard<std::mutex> Guard(Lock);
+            Sockets.push_back(Client);
+            Sockets.push_back(Server);
+            Threads.push_back(std::thread(&TTestProxy::Upstream, this, Client, Server));
+            Threads.push_back(std::thread(&TTestProxy::Downstream, this, Client, Server));
+        }
+    }
+public:
+    int AnswerDelay; // ms before each answer is relayed
+    int DupEvery;    // Every DupEvery-th answer (past the 3rd) is relayed twice, 0 = none
+    int LateFrame;   // The LateFrame-th answer of each connection is held ...
+    int LateDelay;   // ... LateDelay ms while the next ones go, 0 = none
+    int SplitEvery;  // Every SplitEvery-th answer (past the 3rd) is relayed in two
+    int SplitDelay;  // halves SplitDelay ms apart, 0 = none
+
+    TTestProxy(int APort) : Port(APort), Listener(-1), AnswerDelay(0), DupEvery(0), LateFrame(0), LateDelay(0),
+        SplitEvery(1), SplitDelay(0) {}
+
+    bool Start()
+    {
+        sockaddr_in Addr;
+        int One = 1;
+        Listener = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+        memset(&Addr, 0, sizeof(Addr));
+        Addr.sin_family = AF_INET;
+        Addr.sin_port = htons(Port);
+        Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((bind(Listener, (sockaddr *)&Addr, sizeof(Addr)) != 0) || (listen(Listener, 8) != 0))
+        {
+            printf("Proxy on port %d failed\n", Port);
+            return false;
+        }
+        Acceptor = std::thread(&TTestProxy::Listen, this);
+        return true;
+    }
+
+    ~TTestProxy()
+    {
+        if (Listener < 0)
+            return;
+        shutdown(Listener, SHUT_RDWR);
+        if (Acceptor.joinable())
+            Acceptor.join();
+        close(Listener);
+        std::vector<std::thread> Pending;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            for (size_t c = 0; c < Sockets.size(); c++)
+                shutdown(Sockets[c], SHUT_RDWR);
+        }
+        // The late answers may add threads while these end
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> Guard(Lock);
+                Pending.swap(Threads);
+            }
+            if (Pending.empty())
+                break;
+            for (size_t c = 0; c < Pending.size(); c++)
+                Pending[c].join();
+            Pending.clear();
+        }
+        for (size_t c = 0; c < Sockets.size(); c++)
+            close(Sockets[c]);
+    }
+};
+
+static inline int TestDone(const char *Name)
+{
+    if (TestFailures == 0)
+        printf("%s : passed\n", Name);
+    else
+        printf("%s : %d check(s) failed\n", Name, TestFailures);
+    return TestFailures == 0 ? 0 : 1;
+}
+
+#endif // S7_TEST_H
@@ -0,0 +1,112 @@
+//*************************************************************************************
+// TSnap7Scheduler : the reads and the callbacks run outside its lock, so a
+// callback may use the scheduler and a slow read doesn't block its users.
+//*************************************************************************************
+
+#include <cstring>
+#include "s7_test.h"
+
+static byte DB[100];
+static S7Object Sched;
+static TS7DataItem ItemA, ItemB;
+static byte DataA[4], DataB[4];
+static int CallsA = 0, CallsB = 0, CallsBAtRemove = -1;
+static int GroupB = -1;
+static longword CyclesSeen = 0;
+
+static void S7API OnGroupB(void *, int, int)
+{
+    CallsB++;
+}
+
+static void S7API OnGroupA(void *, int GroupId, int Result)
+{
+    TS7GroupStats Stats;
+    CHECK_RESULT(Result, 0);
+    if (Sched_GetGroupStats(Sched, GroupId, &Stats, 0) == 0)
+        CyclesSeen = Stats.Cycles;
+    CallsA++;
+    if (CallsA == 5)
+        CHECK_RESULT(Sched_AddGroup(Sched, 20, &ItemB, 1, OnGroupB, NULL, GroupB), 0);
+    if ((CallsA == 15) && (GroupB >= 0))
+    {
+        CHECK_RESULT(Sched_RemoveGroup(Sched, GroupB), 0);
+        CallsBAtRemove = CallsB;
+    }
+}
+
+static void SetItem(TS7DataItem &Item, byte *Data)
+{
+    Item.Area = S7AreaDB;
+    Item.WordLen = S7WLByte;
+    Item.DBNumber = 1;
+    Item.Start = 0;
+    Item.Amount = 4;
+    Item.pdata = Data;
+}
+
+// Callbacks adding, removing and querying groups
+static void ReentrantCallbacks()
+{
+    S7Object Client = Cli_Create();
+    int GroupA;
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+    Sched = Sched_Create(Client);
+    CHECK_RESULT(Sched_AddGroup(Sched, 10, &ItemA, 1, OnGroupA, NULL, GroupA), 0);
+    CHECK_RESULT(Sched_Start(Sched), 0);
+    SysSleep(500);
+    CHECK_RESULT(Sched_Stop(Sched), 0);
+    CHECK(CallsA >= 15);
+    CHECK(CyclesSeen > 0);
+    CHECK(GroupB >= 0);
+    CHECK(CallsB > 0);
+    // No callback of a removed group
+    CHECK(CallsB == CallsBAtRemove);
+    Sched_Destroy(Sched);
+    Cli_Destroy(Client);
+}
+
+// The stats of a group are read while its read waits the answer
+static void SlowRead()
+{
+    TTestProxy Proxy(10103);
+    Proxy.AnswerDelay = 200;
+    CHECK(Proxy.Start());
+    S7Object Client = Cli_Create();
+    word Port = 10103;
+    int GroupId;
+    Cli_SetParam(Client, p_u16_RemotePort, &Port);
+    CHECK_RESULT(Cli_ConnectTo(Client, "127.0.0.1", 0, 2), 0);
+    Sched = Sched_Create(Client);
+    CHECK_RESULT(Sched_AddGroup(Sched, 10, &ItemB, 1, NULL, NULL, GroupId), 0);
+    CHECK_RESULT(Sched_Start(Sched), 0);
+    SysSleep(300);
+    longword Slowest = 0;
+    for (int c = 0; c < 10; c++)
+    {
+        TS7GroupStats Stats;
+        longword Start = SysGetTick();
+        CHECK_RESULT(Sched_GetGroupStats(Sched, GroupId, &Stats, 0), 0);
+        if (Elapsed(Start) > Slowest)
+            Slowest = Elapsed(Start);
+        SysSleep(30);
+    }
+    CHECK(Slowest < 100);
+    CHECK_RESULT(Sched_Stop(Sched), 0);
+    Sched_Destroy(Sched);
+    Cli_Destroy(Client);
+}
+
+int main()
+{
+    S7Object Server = StartServer();
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    SetItem(ItemA, DataA);
+    SetItem(ItemB, DataB);
+
+    ReentrantCallbacks();
+    SlowRead();
+
+    Srv_Destroy(Server);
+    return TestDone("sched_test");
+}
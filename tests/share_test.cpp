@@ -0,0 +1,69 @@
+//*************************************************************************************
+// Shared sessions : the wait for the turn on the session is bounded by the
+// job timeout and ended by CancelJob.
+//*************************************************************************************
+
+#include <cstring>
+#include <thread>
+#include "s7_test.h"
+
+static byte DB[60000];
+static byte Big[60000];
+
+int main()
+{
+    S7Object Server = StartServer();
+    for (int c = 0; c < int(sizeof(DB)); c++)
+        DB[c] = byte(c * 13);
+    Srv_RegisterArea(Server, srvAreaDB, 1, DB, sizeof(DB));
+    // 20 ms per answer : the bulk read below holds the session a while
+    TTestProxy Proxy(10102);
+    Proxy.AnswerDelay = 20;
+    CHECK(Proxy.Start());
+
+    S7Object Bulk = Cli_Create();
+    S7Object Op = Cli_Create();
+    int One = 1;
+    word Port = 10102;
+    Cli_SetParam(Bulk, p_i32_ShareSession, &One);
+    Cli_SetParam(Bulk, p_u16_RemotePort, &Port);
+    Cli_SetParam(Op, p_i32_ShareSession, &One);
+    Cli_SetParam(Op, p_u16_RemotePort, &Port);
+    CHECK_RESULT(Cli_ConnectTo(Bulk, "127.0.0.1", 0, 2), 0);
+    CHECK_RESULT(Cli_ConnectTo(Op, "127.0.0.1", 0, 2), 0);
+
+    int BulkResult = -1;
+    std::thread BulkThread([&] { BulkResult = Cli_DBRead(Bulk, 1, 0, sizeof(Big), Big); });
+    SysSleep(50);
+
+    // The job expires while waiting its turn
+    byte Data[2];
+    int Timeout = 60;
+    Cli_SetParam(Op, p_i32_JobTimeout, &Timeout);
+    longword Start = SysGetTick();
+    CHECK_RESULT(Cli_DBRead(Op, 1, 100, 2, Data), errCliJobTimeout);
+    CHECK(Elapsed(Start) < 300);
+
+    // An async job waiting its turn is canceled at once
+    Timeout = 0;
+    Cli_SetParam(Op, p_i32_JobTimeout, &Timeout);
+    CHECK_RESULT(Cli_AsDBRead(Op, 1, 100, 2, Data), 0);
+    SysSleep(20);
+    Start = SysGetTick();
+    CHECK_RESULT(Cli_CancelJob(Op), 0);
+    CHECK_RESULT(Cli_WaitAsCompletion(Op, 5000), errCliJobCanceled);
+    CHECK(Elapsed(Start) < 300);
+
+    // Neither disturbed the job holding the session nor the next ones
+    BulkThread.join();
+    CHECK_RESULT(BulkResult, 0);
+    CHECK(memcmp(Big, DB, sizeof(DB)) == 0);
+    CHECK_RESULT(Cli_DBRead(Op, 1, 100, 2, Data), 0);
+    CHECK(memcmp(Data, DB + 100, 2) == 0);
+    CHECK_RESULT(Cli_DBRead(Bulk, 1, 100, 2, Data), 0);
+
+    Cli_Destroy(Op);
+    Cli_Destroy(Bulk);
+    Srv_Destroy(Server);
+    return TestDone("share_test");
+}